@@ -38,9 +38,53 @@
 #include "usb_config.h"
 #include "usb_ch9.h"
 #include "usb_hid.h"
+#include "usb_cdc.h"
 
 #define LED_COUNT     18
 
+/* HID report IDs (see hid_report_descriptor[] in usb_descriptors.c) */
+#define REPORT_ID_BLINK1  0x01 /* the Blink(1) compatible command report */
+#define REPORT_ID_STATUS  0x02 /* blink0 status report */
+#define REPORT_ID_READBACK 0x03 /* blink0 readback of every LED's current colour */
+#define REPORT_ID_STATS   0x04 /* blink0 USB stack counters and SETUP trace (USB_STATS only) */
+
+/*
+the eighth byte of a Blink(1) command report is unused by Blink(1), so blink0 uses it as an optional sequence number;
+zero means "not sequenced", and a sequencing host counts 1 to 255 and then wraps back to 1
+*/
+#define REPORT_SEQ_INDEX  8
+
+/* layout of the status report */
+#define STATUS_SEQ        1 /* highest sequence number fully applied */
+#define STATUS_FLAGS      2 /* sticky STATUS_FLAG_* bits; cleared once the host has read them */
+#define STATUS_EVENTS     3 /* STATUS_EVENT_* bits that occurred since the previous EP1 IN report */
+#define STATUS_RECEIVED   4 /* USB frame number (low byte first) in which the most recent 'c' or 'n' command arrived */
+#define STATUS_APPLIED    6 /* frames from arrival until it was applied to the fade engine */
+#define STATUS_LIT        7 /* frames from arrival until the first WS281x frame carrying it began (0xFF if not yet) */
+#define STATUS_STAMPED_SEQ 8 /* sequence number of the command the three stamps above belong to (zero if it had none) */
+#define STATUS_LEN        EP_1_IN_LEN /* it is also the input report on EP1 IN, so it must fit in a single packet */
+
+#define STATUS_FLAG_DROPPED   0x01 /* a sequence number was skipped or a SET_REPORT data stage failed */
+#define STATUS_FLAG_OVERFLOW  0x02 /* a command was lost because the command queue or the schedule was full */
+
+#define STATUS_EVENT_FADE_DONE   0x01 /* at least one LED finished its fade */
+#define STATUS_EVENT_QUEUE_EMPTY 0x02 /* the last scheduled command has been applied */
+
+/* the vendor interface and its bulk OUT endpoint, when BLINK0_WINUSB is defined in usb_config.h */
+#define STREAM_INTERFACE 1
+#define STREAM_EP        2
+
+/* the CDC-ACM interfaces, when BLINK0_CDC is defined in usb_config.h; the serial data arrives on STREAM_EP */
+#define CDC_COMM_INTERFACE 1
+#define CDC_DATA_INTERFACE 2
+#define CDC_NOTIFICATION_EP 3
+
+/* how many commands can be waiting for the main loop to act upon them (must be a power of 2) */
+#define COMMAND_COUNT 4
+
+/* how many commands can be waiting for their scheduled time */
+#define SCHED_COUNT   4
+
 struct ws_led_struct
 {
 	uint8_t g, r, b; /* the order is critical: the WS281x expects green, red, then blue */
@@ -59,4 +103,18 @@ struct target_struct
 	struct bookkeep_struct bookkeep_g, bookkeep_r, bookkeep_b;
 };
 
+struct command_struct
+{
+	uint8_t report[EP_0_LEN + 1]; /* the SET_REPORT as received */
+	uint16_t frame;               /* the USB frame number it arrived in */
+};
+
+struct sched_struct
+{
+	uint16_t when; /* the tick at which to apply the command */
+	struct ws_led_struct leds;
+	uint16_t fade_delay;
+	uint8_t ledn;
+};
+
 #endif /* BLINK0_H__ */
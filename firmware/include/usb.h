@@ -337,6 +337,39 @@ void START_OF_FRAME_CALLBACK(void);
 void USB_RESET_CALLBACK(void);
 #endif
 
+#if defined(USB_SUSPEND_CALLBACK) != defined(USB_RESUME_CALLBACK)
+#error "Define both USB_SUSPEND_CALLBACK and USB_RESUME_CALLBACK, or neither"
+#endif
+
+#ifdef USB_SUSPEND_CALLBACK
+/** @brief USB Suspend Callback
+ *
+ * USB_SUSPEND_CALLBACK() is called when the bus has been idle for 3ms,
+ * meaning the host has suspended it.  By the time it is called, the SIE
+ * has been put into its low power state, and the activity interrupt has
+ * been enabled so that any activity on the bus will wake the MCU from
+ * sleep.  The device must now draw no more than the suspend current
+ * from the bus, so the application should shut down whatever it can and
+ * put the MCU to sleep.
+ *
+ * When not using interrupts, the USB interrupt enable bit (eg: USBIE) is
+ * left alone, and the application will need to set it before sleeping
+ * if the activity is to wake the MCU.
+ */
+void USB_SUSPEND_CALLBACK(void);
+#endif
+
+#ifdef USB_RESUME_CALLBACK
+/** @brief USB Resume Callback
+ *
+ * USB_RESUME_CALLBACK() is called when activity is detected on a
+ * suspended bus, after the SIE has been taken out of its low power
+ * state.  The activity may be a resume or a bus reset; in the latter
+ * case USB_RESET_CALLBACK() follows.
+ */
+void USB_RESUME_CALLBACK(void);
+#endif
+
 /* Doxygen end-of-group for static_callbacks */
 /** @}*/
 
@@ -386,6 +419,17 @@ uint8_t usb_get_configuration(void);
  */
 #define usb_is_configured() (usb_get_configuration() != 0)
 
+/** @brief Get the current USB frame number
+ *
+ * Return the 11-bit frame number from the most recent Start-of-Frame
+ * packet. The frame number is split across two registers, so they are
+ * read again if the frame number rolled over between them.
+ *
+ * @returns
+ *   Return the frame number (0 to 2047).
+ */
+uint16_t usb_get_frame_number(void);
+
 /** @brief Get a pointer to an endpoint's input buffer
  *
  * This function returns a pointer to an endpoint's input buffer. Call this
@@ -562,6 +606,58 @@ void usb_start_receive_ep0_data_stage(char *buffer, size_t len,
 void usb_send_data_stage(char *buffer, size_t len,
 	usb_ep0_data_stage_callback callback, void *context);
 
+#ifdef USB_STATS
+
+#ifndef USB_STATS_SETUP_COUNT
+#define USB_STATS_SETUP_COUNT 4
+#endif
+
+/** @brief A SETUP packet as recorded in the stack's trace
+ *
+ * @p frame is the USB frame number in which the SETUP packet was
+ * handled, and @p setup holds the eight bytes of the packet as they
+ * came off the bus.
+ */
+struct usb_setup_record {
+	uint16_t frame;
+	uint8_t setup[8];
+};
+
+/** @brief Stack event counters and SETUP trace
+ *
+ * Present only when @p USB_STATS is defined in @p usb_config.h.  The
+ * counters are kept by @p usb_service() and wrap around at 65535; they are
+ * never cleared by the stack, not even on a bus reset.  @p out[] and
+ * @p in[] count completed transactions on each endpoint number, with the
+ * SETUP transactions on endpoint 0 included in @p out[0].
+ *
+ * @p setup_trace[] is a ring holding the most recent SETUP packets;
+ * @p setup_next is the index at which the next one will be recorded, and
+ * so is also the oldest entry once the ring has filled.
+ *
+ * The stack never touches @p reserved, so that an application may put a
+ * header byte there (such as a HID report ID) and send the structure
+ * as it stands.
+ */
+struct usb_stats {
+	uint8_t reserved;
+	uint16_t resets;
+	uint16_t stalls;
+	uint16_t setups;
+	uint16_t unknown_requests;
+	uint16_t out[NUM_ENDPOINT_NUMBERS+1];
+	uint16_t in[NUM_ENDPOINT_NUMBERS+1];
+	uint8_t setup_next;
+	struct usb_setup_record setup_trace[USB_STATS_SETUP_COUNT];
+};
+
+/** @brief The stack's event counters and SETUP trace
+ *
+ * See @p struct @p usb_stats.  Only present when @p USB_STATS is defined.
+ */
+extern struct usb_stats usb_stats;
+
+#endif /* USB_STATS */
 
 /* Doxygen end-of-group for public_api */
 /** @}*/
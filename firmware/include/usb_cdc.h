@@ -258,6 +258,20 @@ struct cdc_line_coding {
 };
 
 
+#ifdef MULTI_CLASS_DEVICE
+/** Set the list of CDC interfaces on this device
+ *
+ * Provide a list to the CDC class implementation of the interfaces on this
+ * device which should be treated as CDC devices.  This is only necessary
+ * for multi-class composite devices to make sure that requests are not
+ * confused between interfaces.  It should be called before usb_init().
+ *
+ * @param interfaces      An array of interfaces which are CDC class.
+ * @param num_interfaces  The size of the @p interfaces array.
+ */
+void cdc_set_interface_list(uint8_t *interfaces, uint8_t num_interfaces);
+#endif
+
 /** Process CDC Setup Request
  *
  * Process a setup request which has been unhandled as if it is potentially
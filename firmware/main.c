@@ -30,17 +30,49 @@
 */
 
 #include "blink0.h"
+#include "stream.h"
 
 /* 
 since this is a downloaded app, configuration words (e.g. __CONFIG or #pragma config) are not relevant
 */
 
+#ifdef USB_USE_INTERRUPTS
+/*
+the USB stack runs in the ISR, so the main loop holds the USB interrupt off whilst it touches anything multi-byte
+that the USB callbacks also read; only USBIE is cleared, never GIE, so a WS281x frame going out is not held up at all,
+and usb_held stops the ISR letting the USB stack back in at the end of a frame until the main loop is done
+*/
+#define shared_begin() do { usb_held = true; PIE2bits.USBIE = 0; } while (0)
+#define shared_end()   do { usb_held = false; if (!PIE1bits.SSP1IE) PIE2bits.USBIE = 1; } while (0)
+#else
+/* the USB stack runs in the main loop, so there is nothing to guard against */
+#define shared_begin()
+#define shared_end()
+#endif
+
 /*
 local function prototyping
 */
 
+static void run_command(struct command_struct *cmd);
+#ifdef BLINK0_WINUSB
+static void stream_packet(void);
+#endif
+#ifdef BLINK0_CDC
+static void stream_serial(void);
+static void stream_latch(void);
+#endif
 static void set_target(uint8_t ledn);
+static void schedule_target(uint8_t ledn);
 static void adjust_led(volatile uint8_t *current, struct bookkeep_struct *bookkeep);
+static void fill_status(uint8_t *buf);
+static void push_status(void);
+static uint8_t frames_since(uint16_t frame);
+static bool tick_due(void);
+#ifdef BLINK0_SOF_TICK
+static uint8_t sof_tick_index(uint16_t frame);
+#endif
+static void low_power(void);
 
 /*
 local variables
@@ -55,11 +87,88 @@ static uint8_t *ptr;
 /* array storing the target LED values (and calculated step values to get there) */
 static struct target_struct targets[LED_COUNT + 1];
 
+/*
+commands from the PC, queued by the SET_REPORT callback and acted upon by the main loop in the order they arrived;
+the callback only ever advances command_head and the main loop only ever advances command_tail
+*/
+static struct command_struct commands[COMMAND_COUNT];
+static volatile uint8_t command_head, command_tail;
+
+/* sequence number of the last command applied, and any STATUS_FLAG_* events since the PC last asked */
+static uint8_t last_seq;
+static uint8_t status_flags;
+
+/* sequence number of the last command received, to spot any that go missing */
+static uint8_t received_seq;
+
+#ifdef BLINK0_CDC
+/*
+frames from the serial port are gathered in one half of stream_leds[] (stream_fill says which), and only go out once they have all arrived intact;
+a whole frame then waits in the other half for the next tick (stream_ready), so the next frame can arrive meanwhile without tearing it,
+and if that one is finished first, it takes the older one's place; stream_count is how many LEDs each half's frame has set
+*/
+static struct ws_led_struct stream_leds[2][LED_COUNT];
+static uint8_t stream_count[2];
+static uint8_t stream_fill;
+static bool stream_ready;
+#endif
+
+#ifdef MULTI_CLASS_DEVICE
+/* which interfaces belong to which USB class (see usb_descriptors.c) */
+static uint8_t hid_interfaces[] = { 0 };
+static uint8_t cdc_interfaces[] = { CDC_COMM_INTERFACE, CDC_DATA_INTERFACE };
+#endif
+
+/* STATUS_EVENT_* bits not yet pushed to the PC via EP1 IN */
+static uint8_t status_events;
+
+/*
+latency stamps of the most recent 'c' or 'n' command applied straight away: its sequence number (zero if it had none),
+the USB frame number it arrived in, and how many frames later it was applied to targets[] and first went out to the WS281x;
+it is awaiting_lit until the fade loop has written it into leds[], and then lit_due until the next WS281x frame, the first to carry it, begins
+*/
+static uint8_t stamped_seq;
+static uint16_t received_frame;
+static uint8_t applied_frames, lit_frames;
+static bool awaiting_lit, lit_due;
+
+/* count of 10ms ticks since power-up; the timebase for scheduled commands */
+static uint16_t ticks;
+
+#ifdef BLINK0_SOF_TICK
+/*
+ticks fall on the USB frame numbers that are a multiple of ten (0, 10, ... 2040), so every device on the same host ticks in the same millisecond;
+frame numbers wrap at 2048, so there are SOF_TICKS_PER_WRAP ticks every 2048ms, and the one just before the wrap is only 8ms long
+*/
+#define SOF_TICKS_PER_WRAP 205
+static uint16_t next_tick_frame;
+#endif
+
+/* commands waiting for their time to come, in the order they are to be applied */
+static struct sched_struct sched[SCHED_COUNT];
+static uint8_t sched_count;
+
+/* set by the '@' command: if the very next command is a 'c' or 'n', it is to be scheduled for this tick rather than applied now */
+static bool sched_armed;
+static uint16_t sched_when;
+
+/* HID idle rate converted to 10ms ticks (zero means only report events), and the countdown to the next periodic report */
+static uint8_t idle_rate, idle_ticks, idle_count;
+
+/* set whilst the host has the USB bus suspended */
+static volatile bool suspended;
+
+#ifdef USB_USE_INTERRUPTS
+/* set whilst the main loop holds the USB interrupt off (see shared_begin()) */
+static volatile bool usb_held;
+#endif
+
 int main(void)
 {
 	uint8_t count;
 	struct target_struct *tpnt;
 	struct ws_led_struct *lpnt;
+	bool finishing, finished = false;
 
 	/* SPI (WS281x) init */
 	SSP1STAT = 0x40;
@@ -69,27 +178,93 @@ int main(void)
 
 	/* enable everything but global interrupts in preparation for SPI interrupt */
 	PIR1bits.SSP1IF = 0;
+#ifdef USB_USE_INTERRUPTS
+	PIE1bits.SSP1IE = 0; /* interrupts stay on for USB, so the SPI interrupt is instead enabled for each frame */
+#else
 	PIE1bits.SSP1IE = 1;
+#endif
 	INTCONbits.PEIE = 1;
 
+	/* leds[0] is never sent to the WS281x, so its spare byte is the header of the readback report */
+	leds[0].b = REPORT_ID_READBACK;
+#ifdef USB_STATS
+	/* likewise, the stack leaves the first byte of its counters alone */
+	usb_stats.reserved = REPORT_ID_STATS;
+#endif
+
 	/* configure TMR2 for 100Hz (100.16Hz) */
 	T2CONbits.T2CKPS = 0b11;    /* Prescaler is 64 */
 	T2CONbits.T2OUTPS = 0b0111; /* Postscaler is 8 */
 	PR2 = 234;
 	T2CONbits.TMR2ON = 1;       /* enable TMR2 */
 
+#ifdef MULTI_CLASS_DEVICE
+	/* tell the HID and CDC class code which requests are theirs */
+	hid_set_interface_list(hid_interfaces, sizeof(hid_interfaces));
+	cdc_set_interface_list(cdc_interfaces, sizeof(cdc_interfaces));
+#endif
+
 	usb_init();
 
+#ifdef USB_USE_INTERRUPTS
+	/* from here on, the ISR services both the WS281x and the USB stack */
+	INTCONbits.GIE = 1;
+#endif
+
 	for (;;)
 	{
+#ifndef USB_USE_INTERRUPTS
 		/* let the USB driver stack handle the USB functionality */
 		usb_service();
+#elif defined(BLINK0_SIM)
+		/* the ISR handles the USB functionality; blink0-sim gets its look in here, once each time around */
+		sim_yield();
+#endif
+
+		/* whilst the host sleeps, so do we */
+		if (suspended)
+			low_power();
+
+		/* act upon the commands the PC has sent, in the order they arrived */
+		while (command_tail != command_head)
+		{
+			run_command(&commands[command_tail & (COMMAND_COUNT - 1)]);
+			command_tail++;
+		}
+
+#ifdef BLINK0_WINUSB
+		/* frames streamed over the vendor interface's bulk endpoint */
+		if (usb_get_configuration() && usb_out_endpoint_has_data(STREAM_EP))
+		{
+			stream_packet();
+
+			shared_begin();
+			usb_arm_out_endpoint(STREAM_EP);
+			shared_end();
+		}
+#endif
 
-		/* check if the timer has fired... */
-		if (TMR2IF)
+#ifdef BLINK0_CDC
+		/* bytes from the serial port go through the stream parser */
+		if (usb_get_configuration() && usb_out_endpoint_has_data(STREAM_EP))
 		{
-			/* ... and if so, acknowledge it */
-			TMR2IF = 0;
+			stream_serial();
+
+			shared_begin();
+			usb_arm_out_endpoint(STREAM_EP);
+			shared_end();
+		}
+#endif
+
+		/* check if it is time for the next tick */
+		if (tick_due())
+		{
+#ifdef BLINK0_CDC
+			/* a frame from the serial port goes out whole, on this frame boundary */
+			stream_tick();
+			if (stream_ready)
+				stream_latch();
+#endif
 
 			/*
 			this is the secret sauce to efficiently write to the WS281x
@@ -97,14 +272,46 @@ int main(void)
 			we just fire and forget using the interrupt service routine
 			*/
 			ptr = (uint8_t *)&leds[1];
+#ifdef USB_USE_INTERRUPTS
+			/* WS281x timing takes priority, so the USB stack is held off until the ISR has clocked out the whole frame */
+			PIE2bits.USBIE = 0;
+			PIE1bits.SSP1IE = 1;
+#else
 			INTCONbits.GIE = 1;
+#endif
 			SSP1BUF = 0x00;
 
+			/* the frame now starting is the first to carry the most recent command, which the last tick's fade loop put in leds[] */
+			if (lit_due)
+			{
+				lit_frames = frames_since(received_frame);
+				lit_due = false;
+			}
+
+			shared_begin();
+			ticks++;
+			shared_end();
+
+			/* apply any scheduled commands whose time has come; they are in time order, so only the head need be checked */
+			while (sched_count && ((int16_t)(ticks - sched[0].when) >= 0))
+			{
+				targets[0].leds = sched[0].leds;
+				targets[0].fade_delay = sched[0].fade_delay;
+				set_target(sched[0].ledn);
+
+				sched_count--;
+				memmove(&sched[0], &sched[1], sched_count * sizeof(struct sched_struct));
+
+				if (0 == sched_count)
+					status_events |= STATUS_EVENT_QUEUE_EMPTY;
+			}
+
 			/*
 			whilst the ISR takes care of talking to the WS281x, 
 			we can focus on the heavy task of fading the LEDs
 			*/
 			tpnt = &targets[1]; lpnt = &leds[1];
+			finishing = false;
 			for (count = 0; count < LED_COUNT; count++)
 			{
 				if (0 == tpnt->fade_delay)
@@ -117,6 +324,10 @@ int main(void)
 					/* the fade isn't finished, but we are one step (10ms) closer */
 					tpnt->fade_delay--;
 
+					/* if that was the last step, the final values get written next time around */
+					if (0 == tpnt->fade_delay)
+						finishing = true;
+
 					/* do that embedded voodoo that you do to make the fade happen */
 					adjust_led(&lpnt->g, &tpnt->bookkeep_g);
 					adjust_led(&lpnt->r, &tpnt->bookkeep_r);
@@ -125,78 +336,550 @@ int main(void)
 
 				tpnt++; lpnt++;
 			}
+
+			/* leds[] now carries the most recent command, so the next frame shows it */
+			if (awaiting_lit)
+			{
+				lit_due = true;
+				awaiting_lit = false;
+			}
+
+			/* a fade that took its last step on the previous tick has now reached its final values */
+			if (finished)
+				status_events |= STATUS_EVENT_FADE_DONE;
+			finished = finishing;
+
+			/*
+			tell the PC about anything it may be waiting on, and keep any periodic reports it asked for flowing;
+			idle_count stays at zero until push_status() gets a report out, so a periodic report that found EP1 busy goes on the next tick
+			*/
+			if ((idle_ticks && (!idle_count || (0 == --idle_count))) || status_events)
+			{
+				shared_begin();
+				push_status();
+				shared_end();
+			}
 		}
 	}
 }
 
 /* HID Callbacks for GET_REPORT and SET_REPORT via EP0 */
 
-static uint8_t get_report_buf[EP_0_LEN + 1]; /* data to be sent to the PC in response to a GET_REPORT */
-static uint8_t set_report_buf[EP_0_LEN + 1]; /* incoming data from PC sent via a SET_REPORT */
+/*
+a SET_REPORT lands straight in the next free slot of commands[], and a GET_REPORT echoes it back from that same slot;
+this pointer to the slot holding the most recent SET_REPORT stands in for separate send and receive buffers
+*/
+static uint8_t *echo_report = commands[0].report;
+static uint8_t status_report_buf[STATUS_LEN]; /* snapshot of the status sent to the PC */
+
+static void status_sent_callback(bool transfer_ok, void *context)
+{
+	/* only forget the flags once the PC has actually seen them */
+	if (transfer_ok)
+		status_flags &= ~status_report_buf[STATUS_FLAGS];
+}
 
 int16_t app_get_report_callback(uint8_t interface, uint8_t report_type,
                                 uint8_t report_id, const void **report,
                                 usb_ep0_data_stage_callback *callback,
                                 void **context)
 {
-	*report = get_report_buf;
-	*callback = NULL; /* indicate no callback needed */
 	*context = NULL;
-	return sizeof(get_report_buf);
+
+	if (REPORT_ID_STATUS == report_id)
+	{
+		fill_status(status_report_buf);
+
+		*report = status_report_buf;
+		*callback = &status_sent_callback;
+		return sizeof(status_report_buf);
+	}
+
+	*callback = NULL; /* indicate no callback needed */
+
+	if (REPORT_ID_READBACK == report_id)
+	{
+		/*
+		rather than copying the LED state into a buffer, the whole frame is sent straight out of leds[];
+		the report begins at the spare byte of leds[0], which holds the report ID, and is followed by every LED in WS281x order
+		*/
+		*report = &leds[0].b;
+		return 1 + LED_COUNT * sizeof(struct ws_led_struct);
+	}
+
+#ifdef USB_STATS
+	if (REPORT_ID_STATS == report_id)
+	{
+		*report = &usb_stats;
+		return sizeof(usb_stats);
+	}
+#endif
+
+	*report = echo_report;
+	return sizeof(commands[0].report);
 }
 
 static void set_report_callback(bool transfer_ok, void *context)
 {
-	uint8_t ledn;
+	uint8_t ledn, seq, expected;
+	struct ws_led_struct *lpnt;
+	struct command_struct *cmd = context;
+	uint8_t *report = cmd->report;
+
+	cmd->frame = usb_get_frame_number();
+
+	/* a SET_REPORT that didn't make it intact is discarded, but the PC is told about it */
+	if (!transfer_ok)
+	{
+		status_flags |= STATUS_FLAG_DROPPED;
+		return;
+	}
 
 	/* preemptively echo the contents of the SET_REPORT */
-	memcpy(get_report_buf, set_report_buf, EP_0_LEN);
+	echo_report = report;
 
 	/* only act upon messages sent with the right report id */
-	if (0x01 != set_report_buf[0])
+	if (REPORT_ID_BLINK1 != report[0])
 		return;
 
-	ledn = set_report_buf[7];
+	/* if the PC is sequencing its commands, check that none went missing on the way */
+	seq = report[REPORT_SEQ_INDEX];
+	if (seq)
+	{
+		if (received_seq)
+		{
+			expected = received_seq + 1;
+			if (0 == expected)
+				expected = 1;
+			if (seq != expected)
+				status_flags |= STATUS_FLAG_DROPPED;
+		}
+		received_seq = seq;
+	}
+
+	/*
+	commands that only read back state are answered here, so the reply is ready for the GET_REPORT that follows;
+	the reply overwrites the echo in place, leaving only the sequence number for the main loop to look at
+	*/
+	ledn = report[7];
+	if (ledn > LED_COUNT)
+		ledn = 0;
+
+	switch (report[1])
+	{
+	case 't':
+		/* read back the device tick and USB frame number, so the PC can work out when to schedule commands */
+		report[2] = ticks >> 8;
+		report[3] = ticks & 0xFF;
+		report[4] = cmd->frame >> 8;
+		report[5] = cmd->frame & 0xFF;
+		break;
+	case 'v':
+		report[3] = '2';
+		report[4] = '3';
+		break;
+	case 'r':
+		/* like Blink(1), asking for LED 0 reads back the first LED */
+		lpnt = &leds[ledn ? ledn : 1];
+		report[2] = lpnt->r;
+		report[3] = lpnt->g;
+		report[4] = lpnt->b;
+		report[5] = 0;
+		report[6] = 0;
+		report[7] = ledn;
+		break;
+	}
+
+	/*
+	working out a fade can take far longer than a USB callback should, so the main loop acts upon the command;
+	the data stage already landed in the slot at the head of the queue, so all that is left is to hand it over
+	*/
+	command_head++;
+}
+
+uint8_t app_get_idle_callback(uint8_t interface, uint8_t report_id)
+{
+	return idle_rate;
+}
+
+int8_t app_set_idle_callback(uint8_t interface, uint8_t report_id, uint8_t idle_rate_4ms)
+{
+	/* the status report is the only input report, so it doesn't matter which report ID the PC names */
+	idle_rate = idle_rate_4ms;
+
+	/* the idle rate is in 4ms units, but reports can only go out on a 10ms tick; round to the nearest tick, but never to zero */
+	idle_ticks = 0;
+	if (idle_rate)
+	{
+		idle_ticks = (uint8_t)(((uint16_t)idle_rate * 4 + 5) / 10);
+		if (0 == idle_ticks)
+			idle_ticks = 1;
+	}
+	idle_count = idle_ticks;
+
+	/* there is no data stage, so go straight to the status stage */
+	usb_send_data_stage(NULL, 0, NULL, NULL);
+	return 0;
+}
+
+int8_t app_set_report_callback(uint8_t interface, uint8_t report_type, uint8_t report_id)
+{
+	struct command_struct *cmd;
+
+	/*
+	if the main loop has fallen so far behind that every slot is still waiting on it, the PC is told twice over:
+	the SET_REPORT is stalled, and the status report flags the overflow
+	*/
+	if (COMMAND_COUNT == (uint8_t)(command_head - command_tail))
+	{
+		status_flags |= STATUS_FLAG_OVERFLOW;
+		return -1;
+	}
+
+	/* the data stage goes straight into the slot at the head of the queue; it only joins the queue once the transfer completes */
+	cmd = &commands[command_head & (COMMAND_COUNT - 1)];
+	usb_start_receive_ep0_data_stage(cmd->report, sizeof(cmd->report), &set_report_callback, cmd);
+
+	return 0;
+}
+
+/* USB Callbacks for suspend and resume; the main loop does the actual work */
+
+void app_usb_suspend_callback(void)
+{
+	suspended = true;
+}
+
+void app_usb_resume_callback(void)
+{
+	suspended = false;
+}
+
+static void run_command(struct command_struct *cmd)
+{
+	uint8_t ledn, seq;
+	uint8_t *report = cmd->report;
+	bool armed;
+#ifdef BLINK0_SOF_TICK
+	int16_t index;
+#endif
+
+	ledn = report[7];
 	if (ledn > LED_COUNT)
 		ledn = 0;
 
-	targets[0].leds.r = set_report_buf[2];
-	targets[0].leds.g = set_report_buf[3];
-	targets[0].leds.b = set_report_buf[4];
+	targets[0].leds.r = report[2];
+	targets[0].leds.g = report[3];
+	targets[0].leds.b = report[4];
 
-	targets[0].fade_delay = (uint16_t)set_report_buf[5] << 8;
-	targets[0].fade_delay += set_report_buf[6];
+	targets[0].fade_delay = (uint16_t)report[5] << 8;
+	targets[0].fade_delay += report[6];
 
-	switch (set_report_buf[1])
+	/* an '@' only ever applies to the command straight after it; whatever that turns out to be, the '@' is used up */
+	armed = sched_armed;
+	sched_armed = false;
+
+	switch (report[1])
 	{
 	case 'c':
 	case 'n': // 'n' is nothing but a pointless subset of 'c' and does not deserve its own code
+		if (armed)
+		{
+			schedule_target(ledn);
+			break;
+		}
+
 		set_target(ledn);
+
+		shared_begin();
+		stamped_seq = report[REPORT_SEQ_INDEX];
+		received_frame = cmd->frame;
+		applied_frames = frames_since(cmd->frame);
+		lit_frames = 0xFF;
+		awaiting_lit = true;
+		lit_due = false;
+		shared_end();
+		break;
+	case '@':
+		/*
+		schedule the next 'c' or 'n' command rather than applying it straight away;
+		the time is big-endian in bytes 2 and 3, and byte 4 says whether it is a device tick (0) or a USB frame number (1)
+		*/
+		sched_when = ((uint16_t)report[2] << 8) | report[3];
+		if (report[4])
+		{
+			/*
+			frame numbers wrap every 2048ms, so one more than 1024 frames ahead is taken to be behind:
+			a command that arrives too late for its frame goes out on the next tick, rather than 2 seconds later
+			*/
+			sched_when &= 0x7FF;
+#ifdef BLINK0_SOF_TICK
+			/* the ticks are locked to the frame numbers, so a frame number (within the next second) becomes exactly the first tick at or after it */
+			if (((sched_when - next_tick_frame) & 0x7FF) > 1024)
+				sched_when = ticks + 1;
+			else
+			{
+				index = sof_tick_index(sched_when) - sof_tick_index(next_tick_frame);
+				if (index < 0)
+					index += SOF_TICKS_PER_WRAP;
+				sched_when = ticks + 1 + index;
+			}
+#else
+			/* a USB frame number (within the next second) becomes the first tick certain to be at or after it */
+			if (((sched_when - cmd->frame) & 0x7FF) > 1024)
+				sched_when = ticks + 1;
+			else
+				sched_when = ticks + ((sched_when - cmd->frame) & 0x7FF) / 10 + 1;
+#endif
+		}
+		sched_armed = true;
 		break;
 	case '!':
 		/* enable watchdog; the code doesn't clear the watchdog, so the PIC will eventually reset (into the bootloader) */
 		WDTCONbits.SWDTEN = 1;
 		break;
-	case 'v':
-		get_report_buf[3] = '2';
-		get_report_buf[4] = '3';
-		break;
-	case 'r':
-		get_report_buf[2] = leds[ledn].r;
-		get_report_buf[3] = leds[ledn].g;
-		get_report_buf[4] = leds[ledn].b;
-		get_report_buf[5] = 0;
-		get_report_buf[6] = 0;
-		get_report_buf[7] = ledn;
-		break;
 	}
+
+	/* the command has been acted upon in full */
+	seq = report[REPORT_SEQ_INDEX];
+	if (seq)
+		last_seq = seq;
 }
 
-int8_t app_set_report_callback(uint8_t interface, uint8_t report_type, uint8_t report_id)
+#ifdef BLINK0_WINUSB
+static void stream_packet(void)
 {
-	usb_start_receive_ep0_data_stage(set_report_buf, sizeof(set_report_buf), &set_report_callback, NULL);
+	const unsigned char *buf;
+	uint8_t len, index;
+	struct target_struct *tpnt;
 
-	return 0;
+	/*
+	the first byte is the LED to start at (1 being the first), followed by red, green, and blue for each LED in turn;
+	a whole strip fits in one packet, but a longer strip can be split over several
+	*/
+	len = usb_get_out_buffer(STREAM_EP, &buf);
+	if (0 == len)
+		return;
+
+	index = *buf++; len--;
+	if (0 == index)
+		return;
+
+	/* there is no fading; the new values go out with the next frame */
+	tpnt = &targets[index];
+	while ((len >= 3) && (index <= LED_COUNT))
+	{
+		tpnt->leds.r = *buf++;
+		tpnt->leds.g = *buf++;
+		tpnt->leds.b = *buf++;
+		tpnt->fade_delay = 0;
+
+		tpnt++; index++; len -= 3;
+	}
+}
+#endif
+
+#ifdef BLINK0_CDC
+static void stream_serial(void)
+{
+	const unsigned char *buf;
+	uint8_t len;
+
+	len = usb_get_out_buffer(STREAM_EP, &buf);
+	stream_parse(buf, len);
+}
+
+void stream_led(uint8_t index, uint8_t r, uint8_t g, uint8_t b)
+{
+	struct ws_led_struct *lpnt;
+
+	/* the stream may well describe more LEDs than we have */
+	if (index > LED_COUNT)
+		return;
+
+	lpnt = &stream_leds[stream_fill][index - 1];
+	lpnt->r = r;
+	lpnt->g = g;
+	lpnt->b = b;
+	stream_count[stream_fill] = index;
+}
+
+void stream_frame(void)
+{
+	/* the finished frame waits for the tick, and the next one goes into the other half */
+	stream_fill ^= 1;
+	stream_count[stream_fill] = 0;
+	stream_ready = true;
+}
+
+static void stream_latch(void)
+{
+	uint8_t index, ready = stream_fill ^ 1;
+	struct ws_led_struct *spnt = stream_leds[ready];
+	struct ws_led_struct *lpnt = &leds[1];
+	struct target_struct *tpnt = &targets[1];
+
+	/*
+	the frame goes straight into leds[], just before the ISR starts clocking it out;
+	the targets are set to match with no fade, so that the fade loop leaves the LEDs be
+	*/
+	for (index = 0; index < stream_count[ready]; index++)
+	{
+		*lpnt = *spnt;
+		tpnt->leds = *spnt;
+		tpnt->fade_delay = 0;
+
+		spnt++; lpnt++; tpnt++;
+	}
+
+	stream_ready = false;
+}
+#endif
+
+static void fill_status(uint8_t *buf)
+{
+	buf[0] = REPORT_ID_STATUS;
+	buf[STATUS_SEQ] = last_seq;
+	buf[STATUS_FLAGS] = status_flags;
+	buf[STATUS_EVENTS] = status_events;
+	buf[STATUS_RECEIVED] = received_frame & 0xFF;
+	buf[STATUS_RECEIVED + 1] = received_frame >> 8;
+	buf[STATUS_APPLIED] = applied_frames;
+	buf[STATUS_LIT] = lit_frames;
+	buf[STATUS_STAMPED_SEQ] = stamped_seq;
+}
+
+static uint8_t frames_since(uint16_t frame)
+{
+	uint16_t elapsed;
+
+	/* USB frame numbers are 11 bits and tick every 1ms; anything beyond 254ms is reported as 255 */
+	elapsed = (usb_get_frame_number() - frame) & 0x7FF;
+	return (elapsed > 0xFF) ? 0xFF : elapsed;
+}
+
+static bool tick_due(void)
+{
+#ifdef BLINK0_SOF_TICK
+	uint16_t frame, ahead;
+
+	/*
+	not yet due if the next tick's frame is no more than a tick ahead; if it seems to be any further,
+	the frame number has jumped (such as after a suspend), and the tick is taken straight away to get back in step
+	*/
+	frame = usb_get_frame_number();
+	ahead = (next_tick_frame - frame) & 0x7FF;
+	if (ahead && (ahead <= 10))
+		return false;
+
+	/* without a host sending SOFs, the frame number stands still, and so do the ticks */
+	next_tick_frame = (frame / 10 + 1) * 10;
+	if (next_tick_frame > 0x7FF)
+		next_tick_frame = 0;
+	return true;
+#else
+	/* check if the timer has fired, and if so, acknowledge it */
+	if (!TMR2IF)
+		return false;
+
+	TMR2IF = 0;
+	return true;
+#endif
+}
+
+#ifdef BLINK0_SOF_TICK
+static uint8_t sof_tick_index(uint16_t frame)
+{
+	uint8_t index;
+
+	/* which of the ticks between frame number wraps is the first at or after this frame number */
+	index = (uint8_t)((frame + 9) / 10);
+	if (SOF_TICKS_PER_WRAP == index)
+		index = 0;
+	return index;
+}
+#endif
+
+static void low_power(void)
+{
+#ifndef BLINK0_SUSPEND_HOLD
+	uint16_t count;
+#endif
+
+	/* let the ISR finish clocking out any frame that is under way */
+#ifdef USB_USE_INTERRUPTS
+	while (PIE1bits.SSP1IE);
+	PIE2bits.USBIE = 0;
+#else
+	while (INTCONbits.GIE);
+#endif
+
+	/* the frame engine stops, so the fades stand still until the host wakes */
+	T2CONbits.TMR2ON = 0;
+
+#ifndef BLINK0_SUSPEND_HOLD
+	/*
+	the strip goes dark, as a suspended host only allows us a couple of milliamps;
+	leds[] and targets[] are left alone, and so everything comes back on resume
+	*/
+	for (count = LED_COUNT * sizeof(struct ws_led_struct) * 8; count; count--)
+	{
+		PIR1bits.SSP1IF = 0;
+		SSP1BUF = 0xF0;
+		while (!PIR1bits.SSP1IF);
+	}
+	PIR1bits.SSP1IF = 0;
+#endif
+
+	/* bus activity sets USBIF, which only wakes the core with USBIE set (but without GIE, it carries on after SLEEP()) */
+	PIE2bits.USBIE = 1;
+
+	while (suspended)
+	{
+		/*
+		the resume can't slip in between the check and SLEEP(); an interrupt pending at SLEEP() wakes it straight away
+		(with the USB stack in the ISR, GIE is what has to be held off, as USBIE must stay set to wake the core)
+		*/
+#ifdef USB_USE_INTERRUPTS
+		di();
+#endif
+		if (suspended)
+			SLEEP();
+#ifdef USB_USE_INTERRUPTS
+		ei();
+#endif
+
+#ifndef USB_USE_INTERRUPTS
+		usb_service();
+#endif
+	}
+
+#ifndef USB_USE_INTERRUPTS
+	PIE2bits.USBIE = 0;
+#endif
+
+	/*
+	rather than waiting out the rest of the tick, the main loop sends leds[] out again straight away
+	(when the ticks follow the USB frame number instead, the next is never more than 10ms away anyway)
+	*/
+	T2CONbits.TMR2ON = 1;
+	TMR2IF = 1;
+}
+
+static void push_status(void)
+{
+	/*
+	the status report doubles as the HID input report on EP1 IN;
+	if the PC hasn't collected the last one yet, any events stay pending until a later tick
+	*/
+	if (!usb_get_configuration() || usb_in_endpoint_halted(1) || usb_in_endpoint_busy(1))
+		return;
+
+	fill_status(usb_get_in_buffer(1));
+	usb_send_in_buffer(1, STATUS_LEN);
+
+	status_events = 0;
+	idle_count = idle_ticks;
 }
 
 void interrupt isr()
@@ -224,7 +907,14 @@ void interrupt isr()
 				the interrupt routine's work is done;
 				so, we disable the interrupt and bail
 				*/
+#ifdef USB_USE_INTERRUPTS
+				/* ... and let the USB stack back in, unless the main loop is holding it off */
+				PIE1bits.SSP1IE = 0;
+				if (!usb_held)
+					PIE2bits.USBIE = 1;
+#else
 				INTCONbits.GIE = 0;
+#endif
 				byte_count = 0;
 				return;
 			}
@@ -241,6 +931,19 @@ void interrupt isr()
 		current_byte <<= 1;
 		bit_position = (bit_position + 1) & 0x7;		
 	}
+#ifdef USB_USE_INTERRUPTS
+	/*
+	the WS281x always comes first; USBIE is held clear whilst a frame is being clocked out,
+	so the USB stack only gets a look in between frames
+	*/
+	else if (PIE2bits.USBIE && PIR2bits.USBIF)
+	{
+		/* USBIF is only raised as each flag is first set, so keep going until nothing is left pending */
+		do
+			usb_service();
+		while (UIR & UIE);
+	}
+#endif
 }
 
 static void calc_increment(volatile uint8_t *current, volatile uint8_t *target, struct bookkeep_struct *bookkeep)
@@ -266,6 +969,10 @@ static void calc_increment(volatile uint8_t *current, volatile uint8_t *target,
 	bookkeep->increment = 0;
 	bookkeep->fraction = 0;
 
+	/* with no fade time, the fade loop writes the final values on the next tick, and the loop below would never end */
+	if (0 == targets[0].fade_delay)
+		return;
+
 	/*
 	writing tight embedded code means squeezing extra efficiency whenever possible
 
@@ -284,12 +991,41 @@ static void calc_increment(volatile uint8_t *current, volatile uint8_t *target,
 	here is another embedded code trick:
 	by mangling the computed result slightly, we can store our computed flag for later use
 	blink0 has more than twice the fade calc precision of Blink(1), so we still come out ahead of the competition
+
+	an increment of zero is left alone whichever way it goes, as it doesn't move the LED either way;
+	going up, it would otherwise become 0xFFFF, which creeps the LED the wrong way and wraps it around
 	*/
 	lsb = bookkeep->increment & 1;
-	if ( ((0 != updir) && (0 == lsb)) || ((0 == updir) && (0 != lsb)) )
+	if ( ((0 != updir) && (0 == lsb) && (0 != bookkeep->increment)) || ((0 == updir) && (0 != lsb)) )
 		bookkeep->increment--;
 }
 
+static void schedule_target(uint8_t ledn)
+{
+	uint8_t index;
+
+	if (SCHED_COUNT == sched_count)
+	{
+		/* nowhere to put it; the PC has to be told the command was lost */
+		status_flags |= STATUS_FLAG_OVERFLOW;
+		return;
+	}
+
+	/* insertion sort: shuffle later commands up one; commands for the same tick stay in the order they arrived */
+	index = sched_count;
+	while (index && ((int16_t)(sched_when - sched[index - 1].when) < 0))
+	{
+		sched[index] = sched[index - 1];
+		index--;
+	}
+
+	sched[index].when = sched_when;
+	sched[index].leds = targets[0].leds;
+	sched[index].fade_delay = targets[0].fade_delay;
+	sched[index].ledn = ledn;
+	sched_count++;
+}
+
 static void set_target(uint8_t ledn)
 {
 	uint8_t index;
@@ -312,7 +1048,7 @@ static void set_target(uint8_t ledn)
 		}
 
 		/* advance to the next target and led */
-		*tpnt++; *lpnt++;
+		tpnt++; lpnt++;
 	}
 }
 
@@ -0,0 +1,216 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdbool.h>
+#include "stream.h"
+
+/*
+two framings are understood, and told apart by their first byte, so a PC can use either without any configuration
+
+Adalight, as spoken by Prismatik, Hyperion, and friends:
+'A' 'd' 'a' <count high> <count low> <count high ^ count low ^ 0x55> <red, green, blue for each LED>
+where count is the number of LEDs minus one; the checksum lets us reject a header that is really just LED data
+
+TPM2:
+0xC9 0xDA <size high> <size low> <red, green, blue for each LED> 0x36
+where size is the number of data bytes; other packet types (e.g. 0xC0 commands) are ignored
+
+neither framing has a checksum over the data, so the best we can do after corruption is to get back in step quickly:
+a failed header byte is looked at again as a possible start of frame, a TPM2 frame is only used if its end byte is right,
+and a frame that stops arriving part way is abandoned by stream_tick()
+*/
+
+#define ADA_MAGIC1      'A'
+#define ADA_MAGIC2      'd'
+#define ADA_MAGIC3      'a'
+#define ADA_CHECKSUM    0x55
+#define TPM2_START      0xC9
+#define TPM2_DATA_FRAME 0xDA
+#define TPM2_END        0x36
+
+enum stream_state
+{
+	STREAM_HUNT,
+	STREAM_ADA_MAGIC2,
+	STREAM_ADA_MAGIC3,
+	STREAM_ADA_COUNT_HI,
+	STREAM_ADA_COUNT_LO,
+	STREAM_ADA_CHECKSUM,
+	STREAM_TPM2_TYPE,
+	STREAM_TPM2_SIZE_HI,
+	STREAM_TPM2_SIZE_LO,
+	STREAM_DATA,
+	STREAM_TPM2_END,
+};
+
+struct stream_counters stream_counters;
+
+static uint8_t state;
+static bool tpm2;           /* which framing the current frame uses */
+static uint8_t size_hi, size_lo;
+static uint16_t remaining;  /* Adalight: LEDs to come after the current one; TPM2: data bytes to come */
+static uint8_t led;         /* index of the current LED */
+static uint8_t channel;     /* 0 = red, 1 = green, 2 = blue */
+static uint8_t rgb[3];
+static uint8_t idle_ticks;  /* ticks since a byte last arrived */
+
+/* where to go from a byte that might be the first of a frame */
+static uint8_t start_of_frame(uint8_t byte)
+{
+	if (ADA_MAGIC1 == byte)
+		return STREAM_ADA_MAGIC2;
+	if (TPM2_START == byte)
+		return STREAM_TPM2_TYPE;
+
+	stream_counters.skipped++;
+	return STREAM_HUNT;
+}
+
+static void start_data(bool is_tpm2, uint16_t count)
+{
+	tpm2 = is_tpm2;
+	remaining = count;
+	led = 1;
+	channel = 0;
+	state = STREAM_DATA;
+}
+
+void stream_parse(const uint8_t *buf, uint8_t len)
+{
+	uint8_t byte;
+
+	if (len)
+		idle_ticks = 0;
+
+	while (len--)
+	{
+		byte = *buf++;
+
+		switch (state)
+		{
+		case STREAM_HUNT:
+			state = start_of_frame(byte);
+			break;
+		case STREAM_ADA_MAGIC2:
+			state = (ADA_MAGIC2 == byte) ? STREAM_ADA_MAGIC3 : start_of_frame(byte);
+			break;
+		case STREAM_ADA_MAGIC3:
+			state = (ADA_MAGIC3 == byte) ? STREAM_ADA_COUNT_HI : start_of_frame(byte);
+			break;
+		case STREAM_ADA_COUNT_HI:
+		case STREAM_TPM2_SIZE_HI:
+			size_hi = byte;
+			state++;
+			break;
+		case STREAM_ADA_COUNT_LO:
+		case STREAM_TPM2_SIZE_LO:
+			size_lo = byte;
+			if (STREAM_ADA_COUNT_LO == state)
+				state = STREAM_ADA_CHECKSUM;
+			else if (size_hi | size_lo)
+				start_data(true, ((uint16_t)size_hi << 8) | size_lo);
+			else
+				state = STREAM_TPM2_END;
+			break;
+		case STREAM_ADA_CHECKSUM:
+			if (byte == (size_hi ^ size_lo ^ ADA_CHECKSUM))
+			{
+				start_data(false, ((uint16_t)size_hi << 8) | size_lo);
+			}
+			else
+			{
+				stream_counters.errors++;
+				state = start_of_frame(byte);
+			}
+			break;
+		case STREAM_TPM2_TYPE:
+			state = (TPM2_DATA_FRAME == byte) ? STREAM_TPM2_SIZE_HI : start_of_frame(byte);
+			break;
+		case STREAM_DATA:
+			rgb[channel++] = byte;
+			if (3 == channel)
+			{
+				channel = 0;
+				stream_led(led, rgb[0], rgb[1], rgb[2]);
+				if (0xFF != led)
+					led++;
+			}
+
+			if (tpm2)
+			{
+				/* a size that isn't a multiple of 3 leaves a partial LED, which is ignored */
+				if (0 == --remaining)
+					state = STREAM_TPM2_END;
+			}
+			else if (0 == channel)
+			{
+				/* Adalight has no end byte, so the frame is over as soon as the last LED is in */
+				if (0 == remaining)
+				{
+					stream_counters.frames++;
+					stream_frame();
+					state = STREAM_HUNT;
+				}
+				else
+				{
+					remaining--;
+				}
+			}
+			break;
+		case STREAM_TPM2_END:
+			if (TPM2_END == byte)
+			{
+				stream_counters.frames++;
+				stream_frame();
+				state = STREAM_HUNT;
+			}
+			else
+			{
+				stream_counters.errors++;
+				state = start_of_frame(byte);
+			}
+			break;
+		}
+	}
+}
+
+void stream_tick(void)
+{
+	if (STREAM_HUNT == state)
+		return;
+
+	/* a PC writes a frame in one go, so a frame that has stopped arriving part way is never going to be finished */
+	if (++idle_ticks >= 2)
+	{
+		stream_counters.errors++;
+		state = STREAM_HUNT;
+	}
+}
@@ -0,0 +1,67 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef STREAM_H__
+#define STREAM_H__
+
+#include <stdint.h>
+
+/*
+parser for LED protocols arriving as a plain byte stream (e.g. over the CDC-ACM serial port);
+it is deliberately free of anything PIC or USB specific, so that it can be built and exercised on a PC too
+*/
+
+/* running totals, for seeing how well a stream is getting through */
+struct stream_counters
+{
+	uint16_t frames;  /* frames that arrived intact */
+	uint16_t errors;  /* frames abandoned: bad header checksum, bad end byte, or the stream stalled part way */
+	uint16_t skipped; /* bytes thrown away whilst looking for the start of a frame */
+};
+
+extern struct stream_counters stream_counters;
+
+/* feed the next chunk of the stream to the parser; chunks can split a frame anywhere */
+void stream_parse(const uint8_t *buf, uint8_t len);
+
+/* call every 10ms tick; a frame that stalls part way for two ticks is abandoned */
+void stream_tick(void);
+
+/*
+supplied by the application: called with each LED's colour as it is decoded;
+LEDs are numbered from 1, and the index saturates at 255 for streams longer than that
+*/
+void stream_led(uint8_t index, uint8_t r, uint8_t g, uint8_t b);
+
+/* supplied by the application: called once the LEDs since the last call make up a frame that arrived intact */
+void stream_frame(void);
+
+#endif /* STREAM_H__ */
@@ -98,6 +98,15 @@
 	#error "Must select a valid PPB_MODE"
 #endif
 
+/* Go through the endpoints besides EP 0. With only the one (see
+   BLINK0_MINIMAL in usb_config.h) there is nothing to count; the body is
+   simply run for EP 1. */
+#if NUM_ENDPOINT_NUMBERS == 1
+	#define for_each_endpoint(i) i = 1;
+#else
+	#define for_each_endpoint(i) for (i = 1; i <= NUM_ENDPOINT_NUMBERS; i++)
+#endif
+
 STATIC_SIZE_CHECK_EQUAL(sizeof(struct endpoint_descriptor), 7);
 STATIC_SIZE_CHECK_EQUAL(sizeof(struct interface_descriptor), 9);
 STATIC_SIZE_CHECK_EQUAL(sizeof(struct configuration_descriptor), 9);
@@ -192,6 +201,12 @@ STATIC_SIZE_CHECK_EQUAL(sizeof(struct buffer_descriptor), 4);
 
 static struct buffer_descriptor bds[NUM_BD] BD_ATTR_TAG;
 
+#ifdef _PIC14E
+/* The buffer descriptors grow with ping-pong buffering, and must not
+   run into the endpoint buffers placed after them. */
+STATIC_SIZE_CHECK_EQUAL((NUM_BD * sizeof(struct buffer_descriptor) <= BUFFER_ADDR - BD_ADDR), 1);
+#endif
+
 #ifdef __C18
 /* The actual buffers to and from which the data is transferred from the SIE
    (from the USB bus). These buffers must fully be located between addresses
@@ -434,6 +449,13 @@ static size_t  ep0_data_stage_buf_remaining;
 static void   *ep0_data_stage_context;
 static uint8_t ep0_data_stage_direc; /*1=IN, 0=OUT, Same as USB spec.*/
 
+#ifdef USB_STATS
+struct usb_stats usb_stats;
+#define STAT_INC(x) usb_stats.x++
+#else
+#define STAT_INC(x)
+#endif
+
 #ifdef _PIC14E
 /* Convert a pointer, which can be a normal banked pointer or a linear
  * pointer, to a linear pointer.
@@ -532,6 +554,9 @@ void usb_init(void)
 #ifdef START_OF_FRAME_CALLBACK
 	SFR_SOF_IE = 1;      /* USB Start-Of-Frame Interrupt Enable */
 #endif
+#ifdef USB_SUSPEND_CALLBACK
+	SFR_IDLE_IE = 1;     /* USB Idle Detect Interrupt Enable */
+#endif
 #endif
 
 #ifdef USB_NEEDS_SET_BD_ADDR_REG
@@ -582,7 +607,7 @@ void usb_init(void)
 	SFR_EP_MGMT(0)->SFR_EP_MGMT_IN_EN = 1; /* Endpoint In Transaction Enable */
 	SFR_EP_MGMT(0)->SFR_EP_MGMT_STALL = 0; /* Stall */
 
-	for (i = 1; i <= NUM_ENDPOINT_NUMBERS; i++) {
+	for_each_endpoint(i) {
 		volatile SFR_EP_MGMT_TYPE *ep = SFR_EP_MGMT(i);
 		ep->SFR_EP_MGMT_HANDSHAKE = 1; /* Endpoint handshaking enable */
 		ep->SFR_EP_MGMT_CON_DIS = 1; /* 1=Disable control operations */
@@ -625,7 +650,7 @@ void usb_init(void)
 	SET_BDN(BDS0IN(1), 0, EP_0_LEN);
 #endif
 
-	for (i = 1; i <= NUM_ENDPOINT_NUMBERS; i++) {
+	for_each_endpoint(i) {
 		/* Setup endpoint 1 Output buffer descriptor.
 		   Input and output are from the HOST perspective. */
 		BDSnOUT(i,0).BDnADR = (BDNADR_TYPE) PHYS_ADDR(ep_buf[i].out);
@@ -822,20 +847,10 @@ static void start_control_return(const void *ptr, size_t len, size_t bytes_asked
 	usb_send_in_buffer_0(bytes_to_send);
 }
 
-static inline int8_t handle_standard_control_request()
+static inline int8_t handle_standard_control_request(FAR struct setup_packet *setup)
 {
-	FAR struct setup_packet *setup;
 	int8_t res = 0;
 
-#ifdef PPB_EP0_OUT
-	if (SFR_USB_STATUS_PPBI)
-		setup = (struct setup_packet*) ep0_buf.out1;
-	else
-		setup = (struct setup_packet*) ep0_buf.out;
-#else
-	setup = (struct setup_packet*) ep0_buf.out;
-#endif
-
 	if (setup->bRequest == GET_DESCRIPTOR &&
 	    setup->REQUEST.bmRequestType == 0x80 /* Section 9.4, Table 9-3 */) {
 		char descriptor = ((setup->wValue >> 8) & 0x00ff);
@@ -852,7 +867,12 @@ static inline int8_t handle_standard_control_request()
 			if (descriptor_index >= NUMBER_OF_CONFIGURATIONS)
 				stall_ep0();
 			else {
+#if NUMBER_OF_CONFIGURATIONS == 1
+				/* The only one there is; no table to index. */
+				desc = USB_CONFIG_DESCRIPTOR_MAP[0];
+#else
 				desc = USB_CONFIG_DESCRIPTOR_MAP[descriptor_index];
+#endif
 				start_control_return(desc, desc->wTotalLength, setup->wLength);
 			}
 		}
@@ -1126,6 +1146,20 @@ static inline void handle_ep0_setup()
 	setup = (struct setup_packet*) ep0_buf.out;
 #endif
 
+#ifdef USB_STATS
+	{
+		/* Record the SETUP packet in the trace ring, stamped with the
+		 * frame number. */
+		struct usb_setup_record *rec =
+			&usb_stats.setup_trace[usb_stats.setup_next];
+		rec->frame = usb_get_frame_number();
+		memcpy(rec->setup, setup, sizeof(rec->setup));
+		if (++usb_stats.setup_next >= USB_STATS_SETUP_COUNT)
+			usb_stats.setup_next = 0;
+		usb_stats.setups++;
+	}
+#endif
+
 	ep0_data_stage_direc = setup->REQUEST.direction;
 	int8_t res;
 
@@ -1147,7 +1181,7 @@ static inline void handle_ep0_setup()
 	}
 
 	if (setup->REQUEST.type == REQUEST_TYPE_STANDARD) {
-		res = handle_standard_control_request();
+		res = handle_standard_control_request(setup);
 		if (res < 0)
 			goto handle_unknown;
 	}
@@ -1184,8 +1218,10 @@ handle_unknown:
 
 #ifdef UNKNOWN_SETUP_REQUEST_CALLBACK
 	res = UNKNOWN_SETUP_REQUEST_CALLBACK(setup);
-	if (res < 0)
+	if (res < 0) {
+		STAT_INC(unknown_requests);
 		stall_ep0();
+	}
 	else {
 		/* If the application has handled this request, it
 		 * will have already set up whatever needs to be set
@@ -1193,6 +1229,7 @@ handle_unknown:
 	}
 #else
 	/* Unsupported Request. Stall the Endpoint. */
+	STAT_INC(unknown_requests);
 	stall_ep0();
 #endif
 
@@ -1313,6 +1350,21 @@ static inline void handle_ep0_in()
    and service USB requests */
 void usb_service(void)
 {
+#ifdef USB_SUSPEND_CALLBACK
+	if (SFR_ACTIVITY_IE && SFR_USB_ACTIVITY_IF) {
+		/* Activity on the bus while suspended: a resume, or a
+		 * reset. Wake the SIE before anything else is looked at.
+		 * ACTVIF won't clear until the SIE's clock is running
+		 * again, so keep at it until it does. */
+		SFR_USB_SUSPEND = 0;
+		SFR_ACTIVITY_IE = 0;
+		while (SFR_USB_ACTIVITY_IF)
+			CLEAR_USB_ACTIVITY_IF();
+		USB_RESUME_CALLBACK();
+		SERIAL("USB Resume");
+	}
+#endif
+
 	if (SFR_USB_RESET_IF) {
 		/* A Reset was detected on the wire. Re-init the SIE. */
 #ifdef USB_RESET_CALLBACK
@@ -1320,6 +1372,7 @@ void usb_service(void)
 #endif
 		usb_init();
 		CLEAR_USB_RESET_IF();
+		STAT_INC(resets);
 		SERIAL("USB Reset");
 	}
 	
@@ -1330,20 +1383,49 @@ void usb_service(void)
 		 * determine which endpoint generated this interrupt, so all
 		 * the endpoints' EPSTALL bits must be checked and cleared. */
 		int i;
-		for (i = 1; i <= NUM_ENDPOINT_NUMBERS; i++) {
+		for_each_endpoint(i) {
 			volatile SFR_EP_MGMT_TYPE *ep = SFR_EP_MGMT(i);
 			ep->SFR_EP_MGMT_STALL = 0;
 		}
 
 		CLEAR_USB_STALL_IF();
+		STAT_INC(stalls);
 	}
 
+#ifdef USB_SUSPEND_CALLBACK
+	if (SFR_USB_IDLE_IF) {
+		/* The bus has been idle for 3ms, which means the host has
+		 * suspended it. Put the SIE into its low power state, and
+		 * have the activity interrupt flag the resume. Setting
+		 * ACTVIE also lets the activity wake the MCU from sleep. */
+		CLEAR_USB_IDLE_IF();
+		if (!SFR_ACTIVITY_IE) {
+			SFR_ACTIVITY_IE = 1;
+			SFR_USB_SUSPEND = 1;
+			USB_SUSPEND_CALLBACK();
+			SERIAL("USB Suspend");
+		}
+	}
+#endif
+
 
 	if (SFR_USB_TOKEN_IF) {
 
-		//struct ustat_bits ustat = *((struct ustat_bits*)&USTAT);
+		/* USTAT holds still until TRNIF is cleared, so read it the
+		 * once rather than going back to the SFR for every test. */
+		uint8_t ep = SFR_USB_STATUS_EP;
+		uint8_t dir = SFR_USB_STATUS_DIR;
 
-		if (SFR_USB_STATUS_EP == 0 && SFR_USB_STATUS_DIR == 0/*OUT*/) {
+#ifdef USB_STATS
+		if (ep <= NUM_ENDPOINT_NUMBERS) {
+			if (dir == 1 /*1=IN*/)
+				usb_stats.in[ep]++;
+			else
+				usb_stats.out[ep]++;
+		}
+#endif
+
+		if (ep == 0 && dir == 0/*OUT*/) {
 			/* An OUT or SETUP transaction has completed on
 			 * Endpoint 0.  Handle the data that was received.
 			 */
@@ -1370,33 +1452,33 @@ void usb_service(void)
 
 			reset_bd0_out();
 		}
-		else if (SFR_USB_STATUS_EP == 0 && SFR_USB_STATUS_DIR == 1/*1=IN*/) {
+		else if (ep == 0 && dir == 1/*1=IN*/) {
 			/* An IN transaction has completed. The endpoint
 			 * needs to be re-loaded with the next transaction's
 			 * data if there is any.
 			 */
 			handle_ep0_in();
 		}
-		else if (SFR_USB_STATUS_EP > 0 && SFR_USB_STATUS_EP <= NUM_ENDPOINT_NUMBERS) {
-			if (SFR_USB_STATUS_DIR == 1 /*1=IN*/) {
+		else if (ep > 0 && ep <= NUM_ENDPOINT_NUMBERS) {
+			if (dir == 1 /*1=IN*/) {
 				/* An IN transaction has completed. */
 				SERIAL("IN transaction completed on non-EP0.");
-				if (ep_buf[SFR_USB_STATUS_EP].flags & EP_IN_HALT_FLAG)
-					stall_ep_in(SFR_USB_STATUS_EP);
+				if (ep_buf[ep].flags & EP_IN_HALT_FLAG)
+					stall_ep_in(ep);
 				else {
 #ifdef IN_TRANSACTION_COMPLETE_CALLBACK
-					IN_TRANSACTION_COMPLETE_CALLBACK(SFR_USB_STATUS_EP);
+					IN_TRANSACTION_COMPLETE_CALLBACK(ep);
 #endif
 				}
 			}
 			else {
 				/* An OUT transaction has completed. */
 				SERIAL("OUT transaction received on non-EP0");
-				if (ep_buf[SFR_USB_STATUS_EP].flags & EP_OUT_HALT_FLAG)
-					stall_ep_out(SFR_USB_STATUS_EP);
+				if (ep_buf[ep].flags & EP_OUT_HALT_FLAG)
+					stall_ep_out(ep);
 				else {
 #ifdef OUT_TRANSACTION_CALLBACK
-					OUT_TRANSACTION_CALLBACK(SFR_USB_STATUS_EP);
+					OUT_TRANSACTION_CALLBACK(ep);
 #endif
 				}
 			}
@@ -1429,6 +1511,18 @@ uint8_t usb_get_configuration(void)
 	return g_configuration;
 }
 
+uint16_t usb_get_frame_number(void)
+{
+	uint8_t high, low;
+
+	do {
+		high = SFR_USB_FRAME_H;
+		low = SFR_USB_FRAME_L;
+	} while (high != SFR_USB_FRAME_H);
+
+	return ((uint16_t) high << 8) | low;
+}
+
 unsigned char *usb_get_in_buffer(uint8_t endpoint)
 {
 #ifdef PPB_EPn
@@ -0,0 +1,179 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include <usb_config.h>
+
+#include <usb_ch9.h>
+#include <usb.h>
+#include <usb_cdc.h>
+
+#ifdef BLINK0_CDC
+
+#define MIN(x,y) (((x)<(y))?(x):(y))
+
+STATIC_SIZE_CHECK_EQUAL(sizeof(struct cdc_functional_descriptor_header), 5);
+STATIC_SIZE_CHECK_EQUAL(sizeof(struct cdc_acm_functional_descriptor), 4);
+STATIC_SIZE_CHECK_EQUAL(sizeof(struct cdc_union_functional_descriptor), 5);
+STATIC_SIZE_CHECK_EQUAL(sizeof(struct cdc_line_coding), 7);
+
+#ifdef MULTI_CLASS_DEVICE
+static uint8_t *cdc_interfaces;
+static uint8_t num_cdc_interfaces;
+
+void cdc_set_interface_list(uint8_t *interfaces, uint8_t num_interfaces)
+{
+	cdc_interfaces = interfaces;
+	num_cdc_interfaces = num_interfaces;
+}
+#endif
+
+/* Both directions of the line coding go through this one buffer, as only
+ * one control transfer can be in progress at a time. */
+static struct cdc_line_coding line_coding;
+static uint8_t line_coding_interface;
+
+#ifdef CDC_SET_LINE_CODING_CALLBACK
+static void set_line_coding_callback(bool transfer_ok, void *context)
+{
+	if (transfer_ok)
+		CDC_SET_LINE_CODING_CALLBACK(line_coding_interface, &line_coding);
+}
+#endif
+
+uint8_t process_cdc_setup_request(const struct setup_packet *setup)
+{
+	/* The following comes from the CDC spec 1.1, section 6.2 */
+
+	uint8_t interface = setup->wIndex;
+
+#ifdef MULTI_CLASS_DEVICE
+	/* Check the interface first to make sure the destination is a
+	 * CDC interface. Composite devices will need to call
+	 * cdc_set_interface_list() first.
+	 */
+	uint8_t i;
+	for (i = 0; i < num_cdc_interfaces; i++) {
+		if (interface == cdc_interfaces[i])
+			break;
+	}
+
+	/* Return if interface is not in the list of CDC interfaces. */
+	if (i == num_cdc_interfaces)
+		return -1;
+#endif
+
+	if (setup->bRequest == CDC_SEND_ENCAPSULATED_COMMAND &&
+	    setup->REQUEST.bmRequestType == 0x21) {
+		return CDC_SEND_ENCAPSULATED_COMMAND_CALLBACK(interface,
+		                                              setup->wLength);
+	}
+
+#ifdef CDC_GET_ENCAPSULATED_RESPONSE_CALLBACK
+	if (setup->bRequest == CDC_GET_ENCAPSULATED_RESPONSE &&
+	    setup->REQUEST.bmRequestType == 0xa1) {
+		const void *response;
+		int16_t len;
+		usb_ep0_data_stage_callback callback;
+		void *context;
+
+		len = CDC_GET_ENCAPSULATED_RESPONSE_CALLBACK(interface,
+		                                             setup->wLength,
+		                                             &response,
+		                                             &callback,
+		                                             &context);
+		if (len < 0)
+			return -1;
+
+		usb_send_data_stage((void*)response, MIN(len, setup->wLength),
+		                    callback, context);
+		return 0;
+	}
+#endif
+
+#ifdef CDC_SET_LINE_CODING_CALLBACK
+	if (setup->bRequest == CDC_SET_LINE_CODING &&
+	    setup->REQUEST.bmRequestType == 0x21) {
+		line_coding_interface = interface;
+		usb_start_receive_ep0_data_stage((char*)&line_coding,
+		                                 sizeof(line_coding),
+		                                 &set_line_coding_callback,
+		                                 NULL);
+		return 0;
+	}
+#endif
+
+#ifdef CDC_GET_LINE_CODING_CALLBACK
+	if (setup->bRequest == CDC_GET_LINE_CODING &&
+	    setup->REQUEST.bmRequestType == 0xa1) {
+		int8_t res = CDC_GET_LINE_CODING_CALLBACK(interface,
+		                                          &line_coding);
+		if (res < 0)
+			return -1;
+
+		usb_send_data_stage((char*)&line_coding,
+		                    MIN(sizeof(line_coding), setup->wLength),
+		                    NULL, NULL);
+		return 0;
+	}
+#endif
+
+#ifdef CDC_SET_CONTROL_LINE_STATE_CALLBACK
+	if (setup->bRequest == CDC_SET_CONTROL_LINE_STATE &&
+	    setup->REQUEST.bmRequestType == 0x21) {
+		int8_t res = CDC_SET_CONTROL_LINE_STATE_CALLBACK(interface,
+		                                  (setup->wValue & 0x1) != 0,
+		                                  (setup->wValue & 0x2) != 0);
+		if (res < 0)
+			return -1;
+
+		/* There is no data stage; go straight to the status stage. */
+		usb_send_data_stage(NULL, 0, NULL, NULL);
+		return 0;
+	}
+#endif
+
+#ifdef CDC_SEND_BREAK_CALLBACK
+	if (setup->bRequest == CDC_SEND_BREAK &&
+	    setup->REQUEST.bmRequestType == 0x21) {
+		int8_t res = CDC_SEND_BREAK_CALLBACK(interface,
+		                                     setup->wValue);
+		if (res < 0)
+			return -1;
+
+		usb_send_data_stage(NULL, 0, NULL, NULL);
+		return 0;
+	}
+#endif
+
+	return -1;
+}
+
+#endif /* BLINK0_CDC */
@@ -32,24 +32,118 @@
 #ifndef USB_CONFIG_H__
 #define USB_CONFIG_H__
 
+/* Add a vendor-specific interface (interface 1) alongside the HID one, with
+   a 64-byte bulk OUT endpoint (EP 2) for streaming whole frames at rates
+   far beyond what feature reports manage. Windows binds WinUSB to it
+   without an INF, courtesy of the Microsoft OS descriptors served by
+   usb_winusb.c. */
+//#define BLINK0_WINUSB
+
+/* Add a CDC-ACM serial port (interfaces 1 and 2) alongside the HID one,
+   so that ambient lighting software can stream Adalight frames (see
+   stream.c) using nothing but standard serial tooling. Data arrives on
+   bulk OUT EP 2; EP 3 IN carries the (never sent) notifications. */
+//#define BLINK0_CDC
+
+/* The smallest build of the stack: the plain HID device, with no
+   ping-pong buffering, so that usb.c keeps one buffer descriptor and one
+   buffer per direction and leaves out every ping-pong variant of its
+   buffer handling. With EP 1 the only endpoint besides EP 0 and the one
+   configuration, usb.c also writes out its loops over the endpoints and
+   skips the table of configuration descriptors (that much holds for any
+   build with neither BLINK0_WINUSB nor BLINK0_CDC). */
+//#define BLINK0_MINIMAL
+
+#if defined(BLINK0_WINUSB) && defined(BLINK0_CDC)
+#error "There is only RAM enough for one of BLINK0_WINUSB and BLINK0_CDC"
+#endif
+
+#if defined(BLINK0_MINIMAL) && (defined(BLINK0_WINUSB) || defined(BLINK0_CDC))
+#error "BLINK0_MINIMAL is the plain HID device; it leaves no room for BLINK0_WINUSB or BLINK0_CDC"
+#endif
+
 /* Number of endpoint numbers besides endpoint zero. It's worth noting that
    and endpoint NUMBER does not completely describe an endpoint, but the
    along with the DIRECTION does (eg: EP 1 IN).  The #define below turns on
    BOTH IN and OUT endpoints for endpoint numbers (besides zero) up to the
    value specified.  For example, setting NUM_ENDPOINT_NUMBERS to 2 will
    activate endpoints EP 1 IN, EP 1 OUT, EP 2 IN, EP 2 OUT.  */
+#if defined(BLINK0_CDC)
+#define NUM_ENDPOINT_NUMBERS 3
+#elif defined(BLINK0_WINUSB)
+#define NUM_ENDPOINT_NUMBERS 2
+#else
 #define NUM_ENDPOINT_NUMBERS 1
+#endif
 
 /* Only 8, 16, 32 and 64 are supported for endpoint zero length. */
 #define EP_0_LEN 8
 
-/* values defined only to appease usb.c */
+/* value defined only to appease usb.c */
 #define EP_1_OUT_LEN 8
-#define EP_1_IN_LEN  8
+
+/* the status report goes out on EP 1 IN, and has to fit in one packet */
+#define EP_1_IN_LEN  9
+
+#if NUM_ENDPOINT_NUMBERS >= 2
+#define EP_2_OUT_LEN 64
+#define EP_2_IN_LEN  8 /* never sends anything, but usb.c (and CDC) wants it regardless */
+#endif
+
+#ifdef BLINK0_WINUSB
+#define AUTOMATIC_WINUSB_SUPPORT
+#define MICROSOFT_OS_DESC_VENDOR_CODE 0x50
+#endif
+
+#ifdef BLINK0_CDC
+#define EP_3_OUT_LEN 8 /* value defined only to appease usb.c */
+#define EP_3_IN_LEN  8
+
+/* HID and CDC requests have to be told apart by interface */
+#define MULTI_CLASS_DEVICE
+#endif
 
 #define NUMBER_OF_CONFIGURATIONS 1
 
-#define PPB_MODE PPB_NONE /* Do not ping-pong any endpoints */
+/* Ping-pong every endpoint, so the SIE always has a second buffer ready
+   and the host isn't NAKed whilst a transaction is being dealt with.
+   On the PIC16F1454 this takes 8 buffer descriptors (32 bytes from
+   BD_ADDR, 0x2000) and 8 endpoint buffers (66 bytes from BUFFER_ADDR,
+   0x2080), all within the dual-port USB RAM. BLINK0_WINUSB adds another
+   4 descriptors (16 bytes) and 144 bytes of EP 2 buffers; BLINK0_CDC
+   adds 8 descriptors (32 bytes) and 176 bytes of EP 2 and EP 3 buffers.
+   The stream endpoint gains the most (see blink0-sim -b); the stack
+   only ever loads one EP 0 IN packet at a time, so control transfers
+   are NAKed about as often either way. BLINK0_MINIMAL does without:
+   4 buffer descriptors (16 bytes) and 33 bytes of endpoint buffers. */
+#ifndef PPB_MODE
+#ifdef BLINK0_MINIMAL
+#define PPB_MODE PPB_NONE
+#else
+#define PPB_MODE PPB_ALL
+#endif
+#endif
+
+/* Service the USB stack from isr() in main.c rather than polling it from
+   the main loop. The WS281x keeps priority: USB is only serviced between
+   frames. */
+//#define USB_USE_INTERRUPTS
+
+/* Leave the LEDs showing while the host has the bus suspended, rather than
+   blanking them. Only for strips that have a power supply of their own;
+   on bus power, a suspended device may draw no more than 2.5mA. */
+//#define BLINK0_SUSPEND_HOLD
+
+/* Take the 10ms tick from the USB frame number rather than from TMR2, so
+   that every blink0 on the same host steps its fades in the same
+   millisecond. With no host, the tick stands still. */
+//#define BLINK0_SOF_TICK
+
+/* Have usb.c count resets, stalls, SETUP packets, unknown requests and
+   transactions on each endpoint, and keep the last few SETUP packets
+   (see struct usb_stats in usb.h). main.c serves them up as feature
+   report 4. */
+//#define USB_STATS
 
 /* Objects from usb_descriptors.c */
 #define USB_DEVICE_DESCRIPTOR this_device_descriptor
@@ -57,31 +151,48 @@
 #define USB_STRING_DESCRIPTOR_FUNC usb_application_get_string
 
 /* Optional callbacks from usb.c. Leave them commented if you don't want to
-   use them. For the prototypes and documentation for each one, see usb.h. */
+   use them. For the prototypes and documentation for each one, see usb.h.
+   Where usb.c already does what blink0 wants without one (a bus-powered
+   device status, a single alternate setting per interface, and a STALL
+   for any other descriptor), the callback is left out, so that the code
+   behind it is compiled out. */
 
 //#define SET_CONFIGURATION_CALLBACK app_set_configuration_callback
-#define GET_DEVICE_STATUS_CALLBACK app_get_device_status_callback
+//#define GET_DEVICE_STATUS_CALLBACK app_get_device_status_callback
 //#define ENDPOINT_HALT_CALLBACK     app_endpoint_halt_callback
-#define SET_INTERFACE_CALLBACK     app_set_interface_callback
-#define GET_INTERFACE_CALLBACK     app_get_interface_callback
+//#define SET_INTERFACE_CALLBACK     app_set_interface_callback
+//#define GET_INTERFACE_CALLBACK     app_get_interface_callback
 //#define OUT_TRANSACTION_CALLBACK   app_out_transaction_callback
 //#define IN_TRANSACTION_COMPLETE_CALLBACK   app_in_transaction_complete_callback
 #define UNKNOWN_SETUP_REQUEST_CALLBACK app_unknown_setup_request_callback
-#define UNKNOWN_GET_DESCRIPTOR_CALLBACK app_unknown_get_descriptor_callback
+//#define UNKNOWN_GET_DESCRIPTOR_CALLBACK app_unknown_get_descriptor_callback
 //#define START_OF_FRAME_CALLBACK    app_start_of_frame_callback
 //#define USB_RESET_CALLBACK         app_usb_reset_callback
+#define USB_SUSPEND_CALLBACK       app_usb_suspend_callback
+#define USB_RESUME_CALLBACK        app_usb_resume_callback
 
 /* HID Configuration functions. See usb_hid.h for documentation. */
 #define USB_HID_DESCRIPTOR_FUNC usb_application_get_hid_descriptor
 #define USB_HID_REPORT_DESCRIPTOR_FUNC usb_application_get_hid_report_descriptor
 //#define USB_HID_PHYSICAL_DESCRIPTOR_FUNC usb_application_get_hid_physical_descriptor
 
-/* HID Callbacks. See usb_hid.h for documentation. */
+/* HID Callbacks. See usb_hid.h for documentation. GET_PROTOCOL and
+   SET_PROTOCOL only matter to boot devices, which blink0 is not; without
+   the callbacks, they are stalled. */
 #define HID_GET_REPORT_CALLBACK app_get_report_callback
 #define HID_SET_REPORT_CALLBACK app_set_report_callback
 #define HID_GET_IDLE_CALLBACK app_get_idle_callback
 #define HID_SET_IDLE_CALLBACK app_set_idle_callback
-#define HID_GET_PROTOCOL_CALLBACK app_get_protocol_callback
-#define HID_SET_PROTOCOL_CALLBACK app_set_protocol_callback
+//#define HID_GET_PROTOCOL_CALLBACK app_get_protocol_callback
+//#define HID_SET_PROTOCOL_CALLBACK app_set_protocol_callback
+
+#ifdef BLINK0_CDC
+/* CDC Callbacks. See usb_cdc.h for documentation. */
+#define CDC_SEND_ENCAPSULATED_COMMAND_CALLBACK app_send_encapsulated_command
+#define CDC_GET_ENCAPSULATED_RESPONSE_CALLBACK app_get_encapsulated_response
+#define CDC_SET_LINE_CODING_CALLBACK app_set_line_coding_callback
+#define CDC_GET_LINE_CODING_CALLBACK app_get_line_coding_callback
+#define CDC_SET_CONTROL_LINE_STATE_CALLBACK app_set_control_line_state_callback
+#endif
 
 #endif /* USB_CONFIG_H__ */
@@ -33,6 +33,8 @@
 #include "usb.h"
 #include "usb_ch9.h"
 #include "usb_hid.h"
+#include "usb_cdc.h"
+#include "blink0.h"
 
 #ifdef __C18
 #define ROMPTR rom
@@ -46,6 +48,21 @@ struct configuration_1_packet
 	struct interface_descriptor      interface;
 	struct hid_descriptor            hid;
 	struct endpoint_descriptor       ep1_in;
+#ifdef BLINK0_WINUSB
+	struct interface_descriptor      stream_interface;
+	struct endpoint_descriptor       ep2_out;
+#endif
+#ifdef BLINK0_CDC
+	struct interface_association_descriptor cdc_iad;
+	struct interface_descriptor      cdc_comm_interface;
+	struct cdc_functional_descriptor_header cdc_header;
+	struct cdc_acm_functional_descriptor cdc_acm;
+	struct cdc_union_functional_descriptor cdc_union;
+	struct endpoint_descriptor       ep3_in;
+	struct interface_descriptor      cdc_data_interface;
+	struct endpoint_descriptor       ep2_out;
+	struct endpoint_descriptor       ep2_in;
+#endif
 };
 
 
@@ -55,9 +72,15 @@ const ROMPTR struct device_descriptor this_device_descriptor =
 	sizeof(struct device_descriptor), // bLength
 	DESC_DEVICE, // bDescriptorType
 	0x0200, // 0x0200 = USB 2.0, 0x0110 = USB 1.1
+#ifdef BLINK0_CDC
+	0xEF, // Device class (Miscellaneous, as the CDC interfaces are grouped by an IAD)
+	0x02, // Device Subclass (Common Class)
+	0x01, // Protocol (Interface Association Descriptor)
+#else
 	0x00, // Device class
 	0x00, // Device Subclass
 	0x00, // Protocol.
+#endif
 	EP_0_LEN, // bMaxPacketSize0
 	0x27B8, // Vendor
 	0x01ED, // Product
@@ -81,6 +104,23 @@ static const ROMPTR uint8_t hid_report_descriptor[] =
     0x95, 8,                       //   REPORT_COUNT (8)
     0x09, 0x00,                    //   USAGE (Undefined)
     0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+    /* blink0 additions beyond the Blink(1) */
+    0x85, REPORT_ID_STATUS,        //   REPORT_ID (2)
+    0x95, STATUS_LEN - 1,          //   REPORT_COUNT (8)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+    0x85, REPORT_ID_READBACK,      //   REPORT_ID (3)
+    0x95, LED_COUNT * 3,           //   REPORT_COUNT (54)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+#ifdef USB_STATS
+    0x85, REPORT_ID_STATS,         //   REPORT_ID (4)
+    0x95, sizeof(usb_stats) - 1,   //   REPORT_COUNT (depends on NUM_ENDPOINT_NUMBERS)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+#endif
     0xc0                           // END_COLLECTION
 };
 
@@ -92,11 +132,17 @@ static const ROMPTR struct configuration_1_packet configuration_1 =
 	sizeof(struct configuration_descriptor),
 	DESC_CONFIGURATION,
 	sizeof(configuration_1), // wTotalLength (length of the whole packet)
+#if defined(BLINK0_CDC)
+	3, // bNumInterfaces
+#elif defined(BLINK0_WINUSB)
+	2, // bNumInterfaces
+#else
 	1, // bNumInterfaces
+#endif
 	1, // bConfigurationValue
 	0, // iConfiguration (index of string descriptor)
 	0b10000000,
-	120/2,   // 120mA
+	500/2,   // 500mA (the most USB allows; a full-white strip can still want more)
 	},
 
 	{
@@ -132,6 +178,115 @@ static const ROMPTR struct configuration_1_packet configuration_1 =
 	EP_1_IN_LEN, // wMaxPacketSize
 	1, // bInterval in ms.
 	},
+#ifdef BLINK0_WINUSB
+	{
+	// Members from struct interface_descriptor
+	sizeof(struct interface_descriptor), // bLength;
+	DESC_INTERFACE,
+	STREAM_INTERFACE, // InterfaceNumber
+	0x0, // AlternateSetting
+	0x1, // bNumEndpoints (num besides endpoint 0)
+	0xFF, // bInterfaceClass 0xFF=vendor specific
+	0x00, // bInterfaceSubclass
+	0x00, // bInterfaceProtocol
+	0x00, // iInterface (index of string describing interface)
+	},
+	{
+	// Members of the Endpoint Descriptor (EP2 OUT)
+	sizeof(struct endpoint_descriptor),
+	DESC_ENDPOINT,
+	STREAM_EP, // endpoint #2 0x00=OUT
+	EP_BULK, // bmAttributes
+	EP_2_OUT_LEN, // wMaxPacketSize
+	0, // bInterval (ignored for bulk)
+	},
+#endif
+#ifdef BLINK0_CDC
+	{
+	// Members from struct interface_association_descriptor
+	sizeof(struct interface_association_descriptor),
+	DESC_INTERFACE_ASSOCIATION,
+	CDC_COMM_INTERFACE, // bFirstInterface
+	2, // bInterfaceCount
+	CDC_COMMUNICATION_INTERFACE_CLASS, // bFunctionClass
+	CDC_COMMUNICATION_INTERFACE_CLASS_ACM_SUBCLASS, // bFunctionSubClass
+	0x00, // bFunctionProtocol
+	0x00, // iFunction (index of string describing function)
+	},
+	{
+	// Members from struct interface_descriptor
+	sizeof(struct interface_descriptor), // bLength;
+	DESC_INTERFACE,
+	CDC_COMM_INTERFACE, // InterfaceNumber
+	0x0, // AlternateSetting
+	0x1, // bNumEndpoints (num besides endpoint 0)
+	CDC_COMMUNICATION_INTERFACE_CLASS, // bInterfaceClass
+	CDC_COMMUNICATION_INTERFACE_CLASS_ACM_SUBCLASS, // bInterfaceSubclass
+	0x00, // bInterfaceProtocol
+	0x00, // iInterface (index of string describing interface)
+	},
+	{
+	// Members from struct cdc_functional_descriptor_header
+	sizeof(struct cdc_functional_descriptor_header),
+	DESC_CS_INTERFACE,
+	CDC_FUNCTIONAL_DESCRIPTOR_SUBTYPE_HEADER,
+	0x0110, // bcdCDC (version 1.1)
+	},
+	{
+	// Members from struct cdc_acm_functional_descriptor
+	sizeof(struct cdc_acm_functional_descriptor),
+	DESC_CS_INTERFACE,
+	CDC_FUNCTIONAL_DESCRIPTOR_SUBTYPE_ACM,
+	CDC_ACM_CAPABILITY_LINE_CODINGS, // bmCapabilities
+	},
+	{
+	// Members from struct cdc_union_functional_descriptor
+	sizeof(struct cdc_union_functional_descriptor),
+	DESC_CS_INTERFACE,
+	CDC_FUNCTIONAL_DESCRIPTOR_SUBTYPE_UNION,
+	CDC_COMM_INTERFACE, // bMasterInterface
+	CDC_DATA_INTERFACE, // bSlaveInterface0
+	},
+	{
+	// Members of the Endpoint Descriptor (EP3 IN)
+	sizeof(struct endpoint_descriptor),
+	DESC_ENDPOINT,
+	CDC_NOTIFICATION_EP | 0x80, // endpoint #3 0x80=IN
+	EP_INTERRUPT, // bmAttributes
+	EP_3_IN_LEN, // wMaxPacketSize
+	255, // bInterval in ms.
+	},
+	{
+	// Members from struct interface_descriptor
+	sizeof(struct interface_descriptor), // bLength;
+	DESC_INTERFACE,
+	CDC_DATA_INTERFACE, // InterfaceNumber
+	0x0, // AlternateSetting
+	0x2, // bNumEndpoints (num besides endpoint 0)
+	CDC_DATA_INTERFACE_CLASS, // bInterfaceClass
+	0x00, // bInterfaceSubclass
+	CDC_DATA_INTERFACE_CLASS_PROTOCOL_NONE, // bInterfaceProtocol
+	0x00, // iInterface (index of string describing interface)
+	},
+	{
+	// Members of the Endpoint Descriptor (EP2 OUT)
+	sizeof(struct endpoint_descriptor),
+	DESC_ENDPOINT,
+	STREAM_EP, // endpoint #2 0x00=OUT
+	EP_BULK, // bmAttributes
+	EP_2_OUT_LEN, // wMaxPacketSize
+	0, // bInterval (ignored for bulk)
+	},
+	{
+	// Members of the Endpoint Descriptor (EP2 IN)
+	sizeof(struct endpoint_descriptor),
+	DESC_ENDPOINT,
+	STREAM_EP | 0x80, // endpoint #2 0x80=IN
+	EP_BULK, // bmAttributes
+	EP_2_IN_LEN, // wMaxPacketSize
+	0, // bInterval (ignored for bulk)
+	},
+#endif
 };
 
 /* String Descriptors */
@@ -27,7 +27,10 @@
 #ifndef USB_HAL_H__
 #define UAB_HAL_H__
 
-#ifdef _PIC14E
+#ifdef BLINK0_SIM
+/* the simulated PIC16F1454 that the host tools build the firmware against */
+#include "sim_hal.h"
+#elif _PIC14E
 #define NEEDS_PULL /* Whether to pull up D+/D- with SFR_PULL_EN. */
 #define HAS_LOW_SPEED
 #define NEEDS_CLEAR_STALL
@@ -44,6 +47,8 @@
 #define SFR_USB_STALL_IF         UIRbits.STALLIF
 #define SFR_USB_TOKEN_IF         UIRbits.TRNIF
 #define SFR_USB_SOF_IF           UIRbits.SOFIF
+#define SFR_USB_IDLE_IF          UIRbits.IDLEIF
+#define SFR_USB_ACTIVITY_IF      UIRbits.ACTVIF
 #define SFR_USB_IF               PIR2bits.USBIF
 
 #define SFR_USB_INTERRUPT_EN     UIE
@@ -51,6 +56,8 @@
 #define SFR_STALL_IE             UIEbits.STALLIE
 #define SFR_RESET_IE             UIEbits.URSTIE
 #define SFR_SOF_IE               UIEbits.SOFIE
+#define SFR_IDLE_IE              UIEbits.IDLEIE
+#define SFR_ACTIVITY_IE          UIEbits.ACTVIE
 #define SFR_USB_IE               PIE2bits.USBIE
 
 #define SFR_USB_EXTENDED_INTERRUPT_EN UEIE
@@ -68,17 +75,23 @@
 #define SFR_USB_EN               UCONbits.USBEN
 #define SFR_USB_PKT_DIS          UCONbits.PKTDIS
 #define SFR_USB_PING_PONG_RESET  UCONbits.PPBRST
+#define SFR_USB_SUSPEND          UCONbits.SUSPND
 
 #define SFR_USB_STATUS           USTAT
 #define SFR_USB_STATUS_EP        USTATbits.ENDP
 #define SFR_USB_STATUS_DIR       USTATbits.DIR
 #define SFR_USB_STATUS_PPBI      USTATbits.PPBI
 
+#define SFR_USB_FRAME_L          UFRML
+#define SFR_USB_FRAME_H          UFRMH
+
 #define CLEAR_ALL_USB_IF()       SFR_USB_INTERRUPT_FLAGS = 0 /*TODO TEST!*/
 #define CLEAR_USB_RESET_IF()     SFR_USB_RESET_IF = 0
 #define CLEAR_USB_STALL_IF()     SFR_USB_STALL_IF = 0
 #define CLEAR_USB_TOKEN_IF()     SFR_USB_TOKEN_IF = 0
 #define CLEAR_USB_SOF_IF()       SFR_USB_SOF_IF = 0
+#define CLEAR_USB_IDLE_IF()      SFR_USB_IDLE_IF = 0
+#define CLEAR_USB_ACTIVITY_IF()  SFR_USB_ACTIVITY_IF = 0
 
 /* Buffer Descriptor BDnSTAT flags. On Some MCUs, apparently, when handing
  * a buffer descriptor to the SIE, there's a race condition that can happen
@@ -186,6 +199,8 @@ struct buffer_descriptor {
 #define SFR_USB_STALL_IF         UIRbits.STALLIF
 #define SFR_USB_TOKEN_IF         UIRbits.TRNIF
 #define SFR_USB_SOF_IF           UIRbits.SOFIF
+#define SFR_USB_IDLE_IF          UIRbits.IDLEIF
+#define SFR_USB_ACTIVITY_IF      UIRbits.ACTVIF
 #define SFR_USB_IF               PIR2bits.USBIF
 
 #define SFR_USB_INTERRUPT_EN     UIE
@@ -193,6 +208,8 @@ struct buffer_descriptor {
 #define SFR_STALL_IE             UIEbits.STALLIE
 #define SFR_RESET_IE             UIEbits.URSTIE
 #define SFR_SOF_IE               UIEbits.SOFIE
+#define SFR_IDLE_IE              UIEbits.IDLEIE
+#define SFR_ACTIVITY_IE          UIEbits.ACTVIE
 #define SFR_USB_IE               PIE2bits.USBIE
 
 #define SFR_USB_EXTENDED_INTERRUPT_EN UEIE
@@ -210,17 +227,23 @@ struct buffer_descriptor {
 #define SFR_USB_EN               UCONbits.USBEN
 #define SFR_USB_PKT_DIS          UCONbits.PKTDIS
 #define SFR_USB_PING_PONG_RESET  UCONbits.PPBRST
+#define SFR_USB_SUSPEND          UCONbits.SUSPND
 
 #define SFR_USB_STATUS           USTAT
 #define SFR_USB_STATUS_EP        USTATbits.ENDP
 #define SFR_USB_STATUS_DIR       USTATbits.DIR
 #define SFR_USB_STATUS_PPBI      USTATbits.PPBI
 
+#define SFR_USB_FRAME_L          UFRML
+#define SFR_USB_FRAME_H          UFRMH
+
 #define CLEAR_ALL_USB_IF()       SFR_USB_INTERRUPT_FLAGS = 0 /*TODO TEST!*/
 #define CLEAR_USB_RESET_IF()     SFR_USB_RESET_IF = 0
 #define CLEAR_USB_STALL_IF()     SFR_USB_STALL_IF = 0
 #define CLEAR_USB_TOKEN_IF()     SFR_USB_TOKEN_IF = 0
 #define CLEAR_USB_SOF_IF()       SFR_USB_SOF_IF = 0
+#define CLEAR_USB_IDLE_IF()      SFR_USB_IDLE_IF = 0
+#define CLEAR_USB_ACTIVITY_IF()  SFR_USB_ACTIVITY_IF = 0
 
 /* Buffer Descriptor BDnSTAT flags. On Some MCUs, apparently, when handing
  * a buffer descriptor to the SIE, there's a race condition that can happen
@@ -332,6 +355,8 @@ struct buffer_descriptor {
 #define SFR_USB_STALL_IF         U1IRbits.STALLIF
 #define SFR_USB_TOKEN_IF         U1IRbits.TRNIF
 #define SFR_USB_SOF_IF           U1IRbits.SOFIF
+#define SFR_USB_IDLE_IF          U1IRbits.IDLEIF
+#define SFR_USB_ACTIVITY_IF      U1OTGIRbits.ACTVIF
 #define SFR_USB_IF               IFS5bits.USB1IF
 
 #define SFR_USB_INTERRUPT_EN     U1IE
@@ -339,6 +364,8 @@ struct buffer_descriptor {
 #define SFR_STALL_IE             U1IEbits.STALLIE
 #define SFR_RESET_IE             U1IEbits.URSTIE
 #define SFR_SOF_IE               U1IEbits.SOFIE
+#define SFR_IDLE_IE              U1IEbits.IDLEIE
+#define SFR_ACTIVITY_IE          U1OTGIEbits.ACTVIE
 #define SFR_USB_IE               IEC5bits.USB1IE
 
 #define SFR_USB_EXTENDED_INTERRUPT_EN U1EIE
@@ -363,7 +390,11 @@ struct buffer_descriptor {
 #define SFR_USB_STATUS_DIR       U1STATbits.DIR
 #define SFR_USB_STATUS_PPBI      U1STATbits.PPBI
 
+#define SFR_USB_FRAME_L          U1FRML
+#define SFR_USB_FRAME_H          U1FRMH
+
 #define SFR_USB_POWER            U1PWRCbits.USBPWR
+#define SFR_USB_SUSPEND          U1PWRCbits.USUSPND
 #define SFR_BD_ADDR_REG          U1BDTP1
 
 #define BDnCNT                   STAT.BDnCNT_byte /* buffer descriptor */
@@ -376,6 +407,8 @@ struct buffer_descriptor {
 #define CLEAR_USB_STALL_IF()     SFR_USB_INTERRUPT_FLAGS = 0x80
 #define CLEAR_USB_TOKEN_IF()     SFR_USB_INTERRUPT_FLAGS = 0x08
 #define CLEAR_USB_SOF_IF()       SFR_USB_INTERRUPT_FLAGS = 0x4
+#define CLEAR_USB_IDLE_IF()      SFR_USB_INTERRUPT_FLAGS = 0x10
+#define CLEAR_USB_ACTIVITY_IF()  U1OTGIR = 0x10
 
 #define BDNSTAT_UOWN   0x8000
 #define BDNSTAT_DTS    0x4000
@@ -455,6 +488,8 @@ struct buffer_descriptor {
 #define SFR_USB_STALL_IF         U1IRbits.STALLIF
 #define SFR_USB_TOKEN_IF         U1IRbits.TRNIF
 #define SFR_USB_SOF_IF           U1IRbits.SOFIF
+#define SFR_USB_IDLE_IF          U1IRbits.IDLEIF
+#define SFR_USB_ACTIVITY_IF      U1OTGIRbits.ACTVIF
 #define SFR_USB_IF               IFS1bits.USBIF
 
 #define SFR_USB_INTERRUPT_EN     U1IE
@@ -462,6 +497,8 @@ struct buffer_descriptor {
 #define SFR_STALL_IE             U1IEbits.STALLIE
 #define SFR_RESET_IE             U1IEbits.URSTIE
 #define SFR_SOF_IE               U1IEbits.SOFIE
+#define SFR_IDLE_IE              U1IEbits.IDLEIE
+#define SFR_ACTIVITY_IE          U1OTGIEbits.ACTVIE
 #define SFR_USB_IE               IEC1bits.USBIE
 
 #define SFR_USB_EXTENDED_INTERRUPT_EN U1EIE
@@ -486,7 +523,11 @@ struct buffer_descriptor {
 #define SFR_USB_STATUS_DIR       U1STATbits.DIR
 #define SFR_USB_STATUS_PPBI      U1STATbits.PPBI
 
+#define SFR_USB_FRAME_L          U1FRML
+#define SFR_USB_FRAME_H          U1FRMH
+
 #define SFR_USB_POWER            U1PWRCbits.USBPWR
+#define SFR_USB_SUSPEND          U1PWRCbits.USUSPEND
 #define SFR_BD_ADDR_REG1         U1BDTP1
 #define SFR_BD_ADDR_REG2         U1BDTP2
 #define SFR_BD_ADDR_REG3         U1BDTP3
@@ -499,6 +540,8 @@ struct buffer_descriptor {
 #define CLEAR_USB_STALL_IF()     SFR_USB_INTERRUPT_FLAGS = 0x80
 #define CLEAR_USB_TOKEN_IF()     SFR_USB_INTERRUPT_FLAGS = 0x08
 #define CLEAR_USB_SOF_IF()       SFR_USB_INTERRUPT_FLAGS = 0x4
+#define CLEAR_USB_IDLE_IF()      SFR_USB_INTERRUPT_FLAGS = 0x10
+#define CLEAR_USB_ACTIVITY_IF()  U1OTGIR = 0x10
 
 #define BDNSTAT_UOWN   0x0080
 #define BDNSTAT_DTS    0x0040
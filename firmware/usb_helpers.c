@@ -2,55 +2,64 @@
 
 /* Callbacks. These function names are set in usb_config.h. */
 
-uint16_t app_get_device_status_callback()
+int8_t app_unknown_setup_request_callback(const struct setup_packet *setup)
 {
-	return 0x0000;
-}
+	/* To use the HID device class, have a handler for unknown setup
+	 * requests and call process_hid_setup_request() (as shown here),
+	 * which will check if the setup request is HID-related, and will
+	 * call the HID application callbacks defined in usb_hid.h. For
+	 * composite devices containing other device classes, make sure
+	 * MULTI_CLASS_DEVICE is defined in usb_config.h and call all
+	 * appropriate device class setup request functions here.
+	 */
+#ifdef MULTI_CLASS_DEVICE
+	if (0 == process_hid_setup_request(setup))
+		return 0;
 
-int8_t app_set_interface_callback(uint8_t interface, uint8_t alt_setting)
-{
-	return 0;
+	return process_cdc_setup_request(setup);
+#else
+	return process_hid_setup_request(setup);
+#endif
 }
 
-int8_t app_get_interface_callback(uint8_t interface)
-{
-	return 0;
-}
+#ifdef BLINK0_CDC
 
-int16_t app_unknown_get_descriptor_callback(const struct setup_packet *pkt, const void **descriptor)
+/* the line coding means nothing to a USB serial port that only feeds LEDs, but the PC expects to read back what it set */
+static struct cdc_line_coding line_coding =
 {
-	return -1;
-}
+	115200, // dwDTERate
+	CDC_CHAR_FORMAT_1_STOP_BIT,
+	CDC_PARITY_NONE,
+	8, // bDataBits
+};
 
-uint8_t app_get_idle_callback(uint8_t interface, uint8_t report_id)
+int8_t app_send_encapsulated_command(uint8_t interface, uint16_t length)
 {
-	return 0;
+	return -1;
 }
 
-int8_t app_set_idle_callback(uint8_t interface, uint8_t report_id, uint8_t idle_rate)
+int16_t app_get_encapsulated_response(uint8_t interface,
+                                      uint16_t length, const void **report,
+                                      usb_ep0_data_stage_callback *callback,
+                                      void **context)
 {
 	return -1;
 }
 
-int8_t app_get_protocol_callback(uint8_t interface)
+void app_set_line_coding_callback(uint8_t interface, const struct cdc_line_coding *coding)
 {
-	return 1;
+	line_coding = *coding;
 }
 
-int8_t app_set_protocol_callback(uint8_t interface, uint8_t report_id)
+int8_t app_get_line_coding_callback(uint8_t interface, struct cdc_line_coding *coding)
 {
-	return -1;
+	*coding = line_coding;
+	return 0;
 }
 
-int8_t app_unknown_setup_request_callback(const struct setup_packet *setup)
+int8_t app_set_control_line_state_callback(uint8_t interface, bool dtr, bool dts)
 {
-	/* To use the HID device class, have a handler for unknown setup
-	 * requests and call process_hid_setup_request() (as shown here),
-	 * which will check if the setup request is HID-related, and will
-	 * call the HID application callbacks defined in usb_hid.h. For
-	 * composite devices containing other device classes, make sure
-	 * MULTI_CLASS_DEVICE is defined in usb_config.h and call all
-	 * appropriate device class setup request functions here.
-	 */
-	return process_hid_setup_request(setup);
+	return 0;
 }
+
+#endif
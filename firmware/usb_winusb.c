@@ -0,0 +1,120 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include "usb_config.h"
+#include "usb.h"
+#include "usb_microsoft.h"
+#include "usb_winusb.h"
+#include "blink0.h"
+
+#ifdef AUTOMATIC_WINUSB_SUPPORT
+
+/*
+Windows asks for these through the MICROSOFT_OS_DESC_VENDOR_CODE request that usb.c advertises in string descriptor 0xEE;
+the HID interface is left to the HID driver, whilst the vendor interface gets WinUSB and a GUID for applications to find it by
+*/
+
+struct extended_compat_packet
+{
+	struct microsoft_extended_compat_header header;
+	struct microsoft_extended_compat_function function;
+};
+
+static const struct extended_compat_packet extended_compat =
+{
+	{
+	sizeof(struct extended_compat_packet), // dwLength
+	0x0100, // bcdVersion
+	0x0004, // wIndex (Extended Compat ID)
+	1, // bCount
+	{0}, // reserved
+	},
+	{
+	STREAM_INTERFACE, // bFirstInterfaceNumber
+	0x01, // reserved (must be 1)
+	{'W','I','N','U','S','B',0,0}, // compatibleID
+	{0}, // subCompatibleID
+	{0}, // reserved2
+	},
+};
+
+struct extended_properties_packet
+{
+	struct microsoft_extended_properties_header header;
+	struct microsoft_extended_property_section_header section;
+	uint16_t wPropertyNameLength;
+	uint16_t bPropertyName[20];
+	uint32_t dwPropertyDataLength;
+	uint16_t bPropertyData[39];
+};
+
+static const struct extended_properties_packet extended_properties =
+{
+	{
+	sizeof(struct extended_properties_packet), // dwLength
+	0x0100, // bcdVersion
+	0x0005, // wIndex (Extended Properties)
+	1, // bCount
+	},
+	{
+	sizeof(struct extended_properties_packet) - sizeof(struct microsoft_extended_properties_header), // dwSize
+	1, // dwPropertyDataType (REG_SZ)
+	},
+	sizeof(extended_properties.bPropertyName), // wPropertyNameLength
+	{'D','e','v','i','c','e','I','n','t','e','r','f','a','c','e','G','U','I','D',0},
+	sizeof(extended_properties.bPropertyData), // dwPropertyDataLength
+	{'{','f','d','f','1','8','6','2','d','-','c','8','b','6','-','4','8','f','9','-','8','2','f','a','-','f','a','9','c','6','0','9','0','b','0','4','d','}',0},
+};
+
+uint16_t m_stack_winusb_get_microsoft_compat(uint8_t interface, const void **descriptor)
+{
+	/* the Extended Compat ID covers the whole device, so Windows only ever asks for it once */
+	if (0 != interface)
+		return -1;
+
+	*descriptor = &extended_compat;
+	return sizeof(extended_compat);
+}
+
+uint16_t m_stack_winusb_get_microsoft_property(uint8_t interface, const void **descriptor)
+{
+	/*
+	usb.c passes on the low byte of wValue, which is the page number rather than the interface;
+	only the vendor interface is bound to WinUSB, so only it ever goes looking for the GUID
+	*/
+	if (0 != interface)
+		return -1;
+
+	*descriptor = &extended_properties;
+	return sizeof(extended_properties);
+}
+
+#endif /* AUTOMATIC_WINUSB_SUPPORT */
@@ -0,0 +1,404 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+blink0-bench: drives a blink0 (a real one through hidraw, or blink0-emu) as hard as it will go with a set of standard
+workloads, and measures the HID command path
+
+  single      'c' commands one after another, each fading one LED (in turn) over 100ms
+  broadcast   'c' commands fading every LED at once (LED 0) over 100ms
+  repaint     every LED set straight away, one command each, and (with the status report) the frame confirmed as
+              applied before the next starts
+  readback    the readback report (ID 3), or where there is none, 'r' commands and their echo
+  mixed       all of these in a fixed pseudo-random order: half single, and a sixth each of the rest
+
+for each, the time of every SET_REPORT and GET_REPORT (from the call to its return, in microseconds) is given as
+percentiles, along with the rate (commands, frames or reads per second) and the SET_REPORTs the device stalled because
+its command queue was full (each is retried, once the status report says there is room, or a millisecond later)
+
+the results are printed as a JSON object; given a previous run with -c, anything that got worse by more than the
+tolerance (-t, in percent) is reported and the exit status is 1, so firmware versions can be compared
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "libblink0/libblink0.h"
+#include "libblink0/reports.h"
+#include "metrics.h"
+
+/* how long to go on retrying a stalled SET_REPORT, or waiting for a frame to be confirmed */
+#define GIVE_UP_US 1000000.0
+
+/* what one workload measured */
+struct result_struct
+{
+	struct samples_struct set_us, get_us, frame_us;
+	unsigned stalls, failures;
+};
+
+static struct blink0_device *device;
+static bool has_status, has_readback;
+
+/* the last sequence number sent, which starts from the device's own so the first one doesn't look like a drop */
+static uint8_t seq;
+static uint32_t random_state;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* xorshift32, so that the mixed workload is the same every run */
+static uint32_t next_random(void)
+{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+static int get(struct result_struct *result, uint8_t *report, size_t length)
+{
+	double start = now_us();
+	int error;
+
+	error = blink0_get_report(device, report, length);
+	if (error)
+		result->failures++;
+	else
+		samples_add(&result->get_us, now_us() - start);
+	return error;
+}
+
+/* a SET_REPORT, retried for as long as the device stalls it */
+static int set(struct result_struct *result, uint8_t *report, size_t length)
+{
+	uint8_t status[STATUS_LEN];
+	double start, give_up = now_us() + GIVE_UP_US;
+	int error;
+
+	for (;;)
+	{
+		start = now_us();
+		error = blink0_set_report(device, report, length);
+		if (!error)
+		{
+			samples_add(&result->set_us, now_us() - start);
+			return 0;
+		}
+		if ((-EPIPE != error) || (now_us() > give_up))
+		{
+			result->failures++;
+			return error;
+		}
+
+		/* the command queue was full; the status report both waits for the device and clears its overflow flag */
+		result->stalls++;
+		if (has_status)
+		{
+			status[0] = REPORT_ID_STATUS;
+			get(result, status, sizeof(status));
+		}
+		else
+			usleep(1000);
+	}
+}
+
+static int command(struct result_struct *result, uint8_t ledn, uint32_t rgb, uint16_t fade_delay, uint8_t command_seq)
+{
+	uint8_t report[REPORT_LEN] = { REPORT_ID_BLINK1, 'c', rgb >> 16, rgb >> 8, rgb, fade_delay >> 8, fade_delay & 0xFF, ledn, command_seq };
+
+	return set(result, report, sizeof(report));
+}
+
+static void single(struct result_struct *result, unsigned index)
+{
+	command(result, 1 + index % BLINK0_LED_COUNT, next_random() & 0xFFFFFF, 10, 0);
+}
+
+static void broadcast(struct result_struct *result, unsigned index)
+{
+	(void)index;
+	command(result, 0, next_random() & 0xFFFFFF, 10, 0);
+}
+
+static void repaint(struct result_struct *result, unsigned index)
+{
+	uint8_t status[STATUS_LEN];
+	double start = now_us(), give_up = start + GIVE_UP_US;
+	uint8_t next;
+	unsigned led;
+
+	(void)index;
+
+	/* sequence numbers count 1 to 255, and then wrap back to 1 */
+	next = (255 == seq) ? 1 : seq + 1;
+
+	for (led = 1; led <= BLINK0_LED_COUNT; led++)
+		if (command(result, led, next_random() & 0xFFFFFF, 0, ((BLINK0_LED_COUNT == led) && has_status) ? next : 0))
+			return;
+	if (has_status)
+		seq = next;
+
+	/* the last command carries a sequence number; the frame is done once the device says it has applied it */
+	while (has_status)
+	{
+		status[0] = REPORT_ID_STATUS;
+		if (get(result, status, sizeof(status)))
+			return;
+		if (status[STATUS_SEQ] == seq)
+			break;
+		if (now_us() > give_up)
+		{
+			result->failures++;
+			return;
+		}
+	}
+
+	samples_add(&result->frame_us, now_us() - start);
+}
+
+static void readback(struct result_struct *result, unsigned index)
+{
+	uint8_t report[1 + 3 * BLINK0_LED_COUNT] = { REPORT_ID_READBACK };
+	uint8_t echo[REPORT_LEN] = { REPORT_ID_BLINK1, 'r', 0, 0, 0, 0, 0, 1 + index % BLINK0_LED_COUNT, 0 };
+
+	if (has_readback)
+	{
+		get(result, report, sizeof(report));
+		return;
+	}
+
+	if (!set(result, echo, sizeof(echo)))
+		get(result, echo, sizeof(echo));
+}
+
+static void mixed(struct result_struct *result, unsigned index)
+{
+	switch (next_random() % 6)
+	{
+	case 0:
+		broadcast(result, index);
+		break;
+	case 1:
+		repaint(result, index);
+		break;
+	case 2:
+		readback(result, index);
+		break;
+	default:
+		single(result, index);
+		break;
+	}
+}
+
+struct workload_struct
+{
+	const char *name;
+	void (*step)(struct result_struct *result, unsigned index);
+	unsigned count_divisor; /* repaint does a whole frame of commands a step */
+};
+
+static const struct workload_struct workloads[] =
+{
+	{ "single", single, 1 },
+	{ "broadcast", broadcast, 1 },
+	{ "repaint", repaint, BLINK0_LED_COUNT },
+	{ "readback", readback, 1 },
+	{ "mixed", mixed, 1 },
+};
+
+static void run(const struct workload_struct *workload, unsigned count)
+{
+	struct result_struct result;
+	char name[48];
+	double start, seconds;
+	unsigned index, steps;
+
+	memset(&result, 0, sizeof(result));
+	random_state = 0x2545F491;
+
+	steps = count / workload->count_divisor;
+	if (!steps)
+		steps = 1;
+
+	start = now_us();
+	for (index = 0; index < steps; index++)
+		workload->step(&result, index);
+	seconds = (now_us() - start) / 1e6;
+
+	snprintf(name, sizeof(name), "%s.set_us", workload->name);
+	if (result.set_us.count)
+		samples_metrics(name, &result.set_us);
+	snprintf(name, sizeof(name), "%s.get_us", workload->name);
+	if (result.get_us.count)
+		samples_metrics(name, &result.get_us);
+	snprintf(name, sizeof(name), "%s.frame_us", workload->name);
+	if (result.frame_us.count)
+		samples_metrics(name, &result.frame_us);
+
+	if (result.set_us.count)
+	{
+		snprintf(name, sizeof(name), "%s.commands_per_s", workload->name);
+		metric(name, result.set_us.count / seconds);
+	}
+	if (result.frame_us.count)
+	{
+		snprintf(name, sizeof(name), "%s.frames_per_s", workload->name);
+		metric(name, result.frame_us.count / seconds);
+	}
+	if (result.get_us.count)
+	{
+		snprintf(name, sizeof(name), "%s.reads_per_s", workload->name);
+		metric(name, result.get_us.count / seconds);
+	}
+	snprintf(name, sizeof(name), "%s.stalls", workload->name);
+	metric(name, result.stalls);
+	snprintf(name, sizeof(name), "%s.failures", workload->name);
+	metric(name, result.failures);
+
+	samples_clear(&result.set_us);
+	samples_clear(&result.get_us);
+	samples_clear(&result.frame_us);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-d device] [-w workload,...] [-n count] [-c baseline [-t tolerance]]\n", name);
+	fprintf(stderr, "  -d  the device: a hidraw node, or unix:<socket> for blink0-emu (default the first blink0 found)\n");
+	fprintf(stderr, "  -w  the workloads to run (default single,broadcast,repaint,readback,mixed)\n");
+	fprintf(stderr, "  -n  how many commands (or reads) each workload does (default 1000)\n");
+	fprintf(stderr, "  -c  compare against the output of an earlier run, and fail if anything got worse\n");
+	fprintf(stderr, "  -t  how far, in percent, a metric may get worse before it counts (default 0)\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path = NULL, *baseline = NULL;
+	char *selected = NULL, *name;
+	struct blink0_context *context;
+	uint8_t status[STATUS_LEN];
+	double tolerance = 0.0;
+	unsigned count = 1000, index;
+	int opt, regressions = 0;
+
+	while ((opt = getopt(argc, argv, "d:w:n:c:t:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'd':
+			path = optarg;
+			break;
+		case 'w':
+			selected = optarg;
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			if (!count)
+				usage(argv[0]);
+			break;
+		case 'c':
+			baseline = optarg;
+			break;
+		case 't':
+			tolerance = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+
+	context = blink0_init(NULL, NULL);
+	if (!context)
+		return 2;
+
+	if (path)
+		device = blink0_open(context, path);
+	else if (blink0_open_all(context) > 0)
+		device = blink0_next(context, NULL);
+	if (!device)
+	{
+		fprintf(stderr, "%s: no blink0 to be had\n", path ? path : argv[0]);
+		return 2;
+	}
+
+	has_status = blink0_features(device) & BLINK0_HAS_STATUS;
+	has_readback = blink0_features(device) & BLINK0_HAS_READBACK;
+	if (has_status)
+	{
+		status[0] = REPORT_ID_STATUS;
+		if (!blink0_get_report(device, status, sizeof(status)))
+			seq = status[STATUS_SEQ];
+	}
+	fprintf(stderr, "%s (serial %s)%s%s\n", blink0_path(device), blink0_serial(device),
+		has_status ? ", status report" : "", has_readback ? ", readback report" : "");
+
+	for (index = 0; index < sizeof(workloads) / sizeof(workloads[0]); index++)
+	{
+		/* a workload runs if it is named in -w, or if there is no -w */
+		if (selected)
+		{
+			for (name = selected; name; name = strchr(name, ','), name = name ? name + 1 : NULL)
+				if (!strncmp(name, workloads[index].name, strlen(workloads[index].name))
+					&& strchr(",", name[strlen(workloads[index].name)]))
+					break;
+			if (!name)
+				continue;
+		}
+
+		run(&workloads[index], count);
+	}
+
+	print_metrics(stdout);
+	blink0_exit(context);
+
+	if (baseline)
+	{
+		regressions = compare_metrics(baseline, tolerance);
+		if (regressions < 0)
+			return 2;
+	}
+
+	return regressions ? 1 : 0;
+}
@@ -0,0 +1,661 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+blink0-cycles: counts the instruction cycles the real firmware (blink0.hex, as XC8 built it) spends in its hot paths
+
+the firmware runs on the instruction-level simulator in pic16/, and this tool plays the host: it enumerates the device,
+sends it commands, and watches the program counter, the stack and every byte written to SSP1BUF; it measures
+
+  isr.*              each pass through isr() while a WS281x frame goes out, and the gap it leaves between bytes on the line
+  ws.*               the bit period and the length of a whole frame
+  tick.leds_N.*      the main loop's work for one 10ms tick, excluding the ISR, with N LEDs fading at once
+  calc_increment.*   each call of calc_increment(), excluding the ISR, over a sweep of fade times and distances
+  setup.*            from a SETUP packet until the status stage of that control transfer completes
+  stack.max_depth    the deepest the hardware stack got
+
+the results are printed as a JSON object; given a previous run with -c, anything that went up by more than the tolerance
+(-t, in percent) is reported and the exit status is 1
+
+the tick and calc_increment measurements need the addresses of usb_service() and calc_increment(), which come from the
+.sym file XC8 writes next to the .hex (or -s name=address)
+
+with -w, every byte written to SSP1BUF is also written to a trace file for blink0-ws281x to check, one line each:
+"w <cycle> <byte>", all in hex; each frame's first byte is preceded by "l <cycle> <leds[1] to leds[LED_COUNT]>",
+what leds[] held as the main loop kicked it off (when the address of leds[] is known)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "metrics.h"
+#include "pic16/pic16.h"
+
+/* these mirror blink0.h and usb_ch9.h in the firmware */
+#define LED_COUNT          18
+#define REPORT_ID_BLINK1   0x01
+#define REPORT_ID_STATUS   0x02
+#define REPORT_LEN         9
+#define STATUS_LEN         9
+#define EP_0_LEN           8
+#define GET_DESCRIPTOR     6
+#define SET_ADDRESS        5
+#define SET_CONFIGURATION  9
+#define DESC_DEVICE        1
+#define DESC_CONFIGURATION 2
+
+#define NO_SYMBOL 0xFFFF
+
+/* how long the host waits between retries of a NAKed transaction, and how long it waits before giving up */
+#define NAK_RETRY_CYCLES   60
+#define TIMEOUT_CYCLES     (100 * PIC16_CYCLES_PER_MS)
+
+struct stat_struct
+{
+	uint64_t min, max, sum;
+	unsigned count;
+};
+
+static struct pic16 pic;
+
+static uint16_t sym_usb_service = NO_SYMBOL;
+static uint16_t sym_calc_increment = NO_SYMBOL;
+static uint16_t sym_leds = NO_SYMBOL;
+
+static FILE *trace;
+
+/* isr() and the bytes it sends */
+static uint64_t isr_entry;
+static struct stat_struct isr_cycles, isr_gap, ws_bit, ws_frame;
+static uint64_t last_start, last_done, frame_start;
+static unsigned frame_bytes, last_frame_bytes;
+static bool in_frame;
+
+/* one tick of the main loop: from the SSP kick-off it does until it comes back round to usb_service() */
+static bool tick_pending, tick_record;
+static uint64_t tick_main;
+static struct stat_struct tick_cycles;
+
+/* calc_increment() */
+static bool calc_active, calc_record;
+static uint8_t calc_depth;
+static uint64_t calc_main;
+static struct stat_struct calc_cycles;
+
+static void stat_clear(struct stat_struct *stat)
+{
+	memset(stat, 0, sizeof(*stat));
+}
+
+static void stat_add(struct stat_struct *stat, uint64_t value)
+{
+	if (!stat->count || (value < stat->min))
+		stat->min = value;
+	if (value > stat->max)
+		stat->max = value;
+	stat->sum += value;
+	stat->count++;
+}
+
+static void stat_metrics(const char *prefix, const struct stat_struct *stat)
+{
+	char name[48];
+
+	if (!stat->count)
+		return;
+
+	snprintf(name, sizeof(name), "%s.min", prefix);
+	metric(name, stat->min);
+	snprintf(name, sizeof(name), "%s.mean", prefix);
+	metric(name, (double)stat->sum / stat->count);
+	snprintf(name, sizeof(name), "%s.max", prefix);
+	metric(name, stat->max);
+}
+
+static uint64_t main_cycles(void)
+{
+	return pic.cycles - pic.isr_cycles;
+}
+
+static void trace_leds(uint64_t cycle)
+{
+	unsigned index;
+
+	/* leds[0] is never sent */
+	fprintf(trace, "l %llx ", (unsigned long long)cycle);
+	for (index = 3; index < 3 * (LED_COUNT + 1); index++)
+		fprintf(trace, "%02x", pic16_peek(&pic, sym_leds + index));
+	fprintf(trace, "\n");
+}
+
+static void ssp_hook(struct pic16 *p, uint64_t cycle, uint8_t value)
+{
+	if (trace)
+	{
+		if (!p->in_isr && (NO_SYMBOL != sym_leds))
+			trace_leds(cycle);
+		fprintf(trace, "w %llx %02x\n", (unsigned long long)cycle, value);
+	}
+
+	if (!p->in_isr)
+	{
+		/* the main loop kicks off each frame with its first byte */
+		if (in_frame)
+		{
+			stat_add(&ws_frame, last_done - frame_start);
+			last_frame_bytes = frame_bytes;
+		}
+		in_frame = true;
+		frame_start = cycle;
+		frame_bytes = 0;
+
+		tick_pending = true;
+		tick_main = main_cycles();
+	}
+	else if (in_frame)
+	{
+		stat_add(&isr_gap, cycle - last_done);
+		stat_add(&ws_bit, cycle - last_start);
+	}
+
+	frame_bytes++;
+	last_start = cycle;
+	last_done = p->ssp_done;
+}
+
+static void step(void)
+{
+	uint16_t pc = pic.pc;
+	bool was_isr = pic.in_isr;
+	uint64_t cycles = pic.cycles;
+
+	pic16_step(&pic);
+
+	if (PIC16_FAULT == pic.event)
+	{
+		fprintf(stderr, "fault at 0x%04x (cycle %llu): %s\n", pc, (unsigned long long)cycles, pic.fault);
+		exit(2);
+	}
+
+	if (PIC16_INTERRUPTED == pic.event)
+	{
+		isr_entry = cycles;
+		return;
+	}
+
+	if (was_isr)
+	{
+		if (!pic.in_isr)
+			stat_add(&isr_cycles, pic.cycles - isr_entry);
+		return;
+	}
+
+	if (PIC16_EXECUTED != pic.event)
+		return;
+
+	if (pc == sym_usb_service)
+	{
+		if (tick_pending && tick_record)
+			stat_add(&tick_cycles, main_cycles() - tick_main);
+		tick_pending = false;
+	}
+
+	/* the CALL has already been pushed by the time the first instruction runs, and the RETURN pops it */
+	if (pc == sym_calc_increment)
+	{
+		calc_active = true;
+		calc_depth = pic.depth;
+		calc_main = main_cycles() - (pic.cycles - cycles);
+	}
+	else if (calc_active && (pic.depth < calc_depth))
+	{
+		calc_active = false;
+		if (calc_record)
+			stat_add(&calc_cycles, main_cycles() - calc_main);
+	}
+}
+
+static void run(uint64_t cycles)
+{
+	uint64_t until = pic.cycles + cycles;
+
+	while (pic.cycles < until)
+		step();
+}
+
+static void run_ms(unsigned ms)
+{
+	run((uint64_t)ms * PIC16_CYCLES_PER_MS);
+}
+
+/* a transaction, retried for as long as the device NAKs it */
+static int transaction(uint8_t pid, uint8_t ep, uint8_t *data, uint8_t length)
+{
+	uint64_t give_up = pic.cycles + TIMEOUT_CYCLES;
+	int result;
+
+	for (;;)
+	{
+		result = pic16_usb_token(&pic, pid, ep, data, length);
+		if ((PIC16_NAK != result) || (pic.cycles >= give_up))
+			return result;
+		run(NAK_RETRY_CYCLES);
+	}
+}
+
+/* a control transfer on EP0; returns the bytes transferred (or a PIC16_* error) and the cycles from SETUP to status */
+static int control(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index, uint8_t *data, uint16_t length, uint64_t *latency)
+{
+	uint8_t setup[8];
+	uint64_t start;
+	uint16_t done = 0;
+	uint8_t chunk;
+	int result;
+
+	setup[0] = request_type;
+	setup[1] = request;
+	setup[2] = value & 0xFF;
+	setup[3] = value >> 8;
+	setup[4] = index & 0xFF;
+	setup[5] = index >> 8;
+	setup[6] = length & 0xFF;
+	setup[7] = length >> 8;
+
+	start = pic.cycles;
+	result = transaction(PIC16_PID_SETUP, 0, setup, sizeof(setup));
+	if (result < 0)
+		return result;
+
+	/* data stage, then the status stage in the other direction */
+	while (done < length)
+	{
+		chunk = ((length - done) > EP_0_LEN) ? EP_0_LEN : (length - done);
+		result = transaction((request_type & 0x80) ? PIC16_PID_IN : PIC16_PID_OUT, 0, data + done, chunk);
+		if (result < 0)
+			return result;
+		done += (request_type & 0x80) ? result : chunk;
+		if ((request_type & 0x80) && (result < chunk))
+			break;
+	}
+
+	result = transaction((request_type & 0x80) ? PIC16_PID_OUT : PIC16_PID_IN, 0, NULL, 0);
+	if (result < 0)
+		return result;
+
+	if (latency)
+		*latency = pic.cycles - start;
+
+	return done;
+}
+
+static void enumerate(void)
+{
+	uint8_t descriptor[18];
+
+	pic16_usb_reset(&pic);
+	run_ms(1);
+
+	if ((control(0x80, GET_DESCRIPTOR, DESC_DEVICE << 8, 0, descriptor, sizeof(descriptor), NULL) != sizeof(descriptor))
+		|| (control(0x00, SET_ADDRESS, 1, 0, NULL, 0, NULL) < 0))
+	{
+		fprintf(stderr, "the device did not enumerate\n");
+		exit(2);
+	}
+
+	/* the new address only takes effect once the status stage is done */
+	pic.host_address = 1;
+
+	if (control(0x00, SET_CONFIGURATION, 1, 0, NULL, 0, NULL) < 0)
+	{
+		fprintf(stderr, "the device did not accept its configuration\n");
+		exit(2);
+	}
+}
+
+/* a Blink(1) 'c' command: fade LED ledn (zero for all of them) to r, g, b over fade * 10ms */
+static void fade_to(uint8_t ledn, uint8_t r, uint8_t g, uint8_t b, uint16_t fade)
+{
+	uint8_t report[REPORT_LEN] = { REPORT_ID_BLINK1, 'c', r, g, b, fade >> 8, fade & 0xFF, ledn, 0 };
+
+	/* SET_REPORT, feature report */
+	if (control(0x21, 0x09, (3 << 8) | REPORT_ID_BLINK1, 0, report, sizeof(report), NULL) < 0)
+	{
+		fprintf(stderr, "SET_REPORT failed\n");
+		exit(2);
+	}
+}
+
+/* let the main loop act on what it was sent, including any calc_increment() still in progress */
+static void settle(unsigned ms)
+{
+	run_ms(ms);
+	while (calc_active)
+		step();
+}
+
+static void measure_isr(void)
+{
+	/* every LED steady, so the frames that follow are nothing but the ISR sending them */
+	fade_to(0, 0x40, 0x80, 0xC0, 1);
+	settle(50);
+
+	stat_clear(&isr_cycles);
+	stat_clear(&isr_gap);
+	stat_clear(&ws_bit);
+	stat_clear(&ws_frame);
+	in_frame = false;
+	run_ms(100);
+
+	stat_metrics("isr.cycles", &isr_cycles);
+	stat_metrics("isr.gap", &isr_gap);
+	metric("isr.collisions", pic.ssp_collisions);
+	stat_metrics("ws.bit_cycles", &ws_bit);
+	stat_metrics("ws.frame_cycles", &ws_frame);
+	metric("ws.frame_bytes", last_frame_bytes);
+}
+
+static void measure_ticks(void)
+{
+	static const uint8_t counts[] = { 0, 1, 2, 4, 8, 12, 16, LED_COUNT };
+	unsigned index, active = 0;
+	char name[48];
+
+	if (NO_SYMBOL == sym_usb_service)
+	{
+		fprintf(stderr, "no address for usb_service(); skipping the tick measurements\n");
+		return;
+	}
+
+	/* all steady; then more and more LEDs start on a fade far longer than the measurement */
+	fade_to(0, 0, 0, 0, 1);
+	settle(50);
+
+	for (index = 0; index < sizeof(counts); index++)
+	{
+		while (active < counts[index])
+		{
+			active++;
+			fade_to(active, 0xFF, 0xFF, 0xFF, 60000);
+			settle(20);
+		}
+
+		stat_clear(&tick_cycles);
+		tick_record = true;
+		run_ms(100);
+		tick_record = false;
+
+		snprintf(name, sizeof(name), "tick.leds_%u", active);
+		stat_metrics(name, &tick_cycles);
+	}
+}
+
+static void measure_calc_increment(void)
+{
+	static const uint16_t fades[] = { 0, 1, 2, 5, 10, 100, 1000, 0xFFFF };
+	static const uint8_t distances[][2] = { { 0x00, 0xFF }, { 0xFF, 0x00 }, { 0x00, 0x01 }, { 0x80, 0x81 }, { 0x00, 0x00 } };
+	struct stat_struct all;
+	unsigned fade, distance;
+	char name[48];
+
+	if (NO_SYMBOL == sym_calc_increment)
+	{
+		fprintf(stderr, "no address for calc_increment(); skipping its measurements\n");
+		return;
+	}
+
+	stat_clear(&all);
+	for (fade = 0; fade < sizeof(fades) / sizeof(fades[0]); fade++)
+	{
+		stat_clear(&calc_cycles);
+
+		for (distance = 0; distance < sizeof(distances) / sizeof(distances[0]); distance++)
+		{
+			fade_to(1, distances[distance][0], distances[distance][0], distances[distance][0], 1);
+			settle(40);
+
+			calc_record = true;
+			fade_to(1, distances[distance][1], distances[distance][1], distances[distance][1], fades[fade]);
+			settle(10);
+			calc_record = false;
+		}
+
+		snprintf(name, sizeof(name), "calc_increment.fade_%u", fades[fade]);
+		stat_metrics(name, &calc_cycles);
+
+		if (calc_cycles.count)
+			stat_add(&all, calc_cycles.max);
+	}
+
+	metric("calc_increment.max", all.max);
+}
+
+static void measure_setup(void)
+{
+	uint8_t buffer[64];
+	uint8_t report[REPORT_LEN] = { REPORT_ID_BLINK1, 'c', 0x10, 0x20, 0x30, 0, 10, 0, 0 };
+	struct stat_struct device, config, set_report, get_report, set_idle;
+	uint64_t latency;
+	unsigned pass;
+
+	stat_clear(&device);
+	stat_clear(&config);
+	stat_clear(&set_report);
+	stat_clear(&get_report);
+	stat_clear(&set_idle);
+
+	/* each transfer starts at a different point of the main loop and of the WS281x frame */
+	for (pass = 0; pass < 32; pass++)
+	{
+		run(PIC16_CYCLES_PER_MS + pass * 379);
+		if (control(0x80, GET_DESCRIPTOR, DESC_DEVICE << 8, 0, buffer, 18, &latency) >= 0)
+			stat_add(&device, latency);
+
+		run(PIC16_CYCLES_PER_MS + pass * 211);
+		if (control(0x80, GET_DESCRIPTOR, DESC_CONFIGURATION << 8, 0, buffer, sizeof(buffer), &latency) >= 0)
+			stat_add(&config, latency);
+
+		run(PIC16_CYCLES_PER_MS + pass * 157);
+		if (control(0x21, 0x09, (3 << 8) | REPORT_ID_BLINK1, 0, report, sizeof(report), &latency) >= 0)
+			stat_add(&set_report, latency);
+
+		run(PIC16_CYCLES_PER_MS + pass * 97);
+		if (control(0xA1, 0x01, (3 << 8) | REPORT_ID_STATUS, 0, buffer, STATUS_LEN, &latency) >= 0)
+			stat_add(&get_report, latency);
+
+		run(PIC16_CYCLES_PER_MS + pass * 53);
+		if (control(0x21, 0x0A, 0, 0, NULL, 0, &latency) >= 0)
+			stat_add(&set_idle, latency);
+	}
+
+	stat_metrics("setup.get_descriptor_device", &device);
+	stat_metrics("setup.get_descriptor_config", &config);
+	stat_metrics("setup.set_report", &set_report);
+	stat_metrics("setup.get_report_status", &get_report);
+	stat_metrics("setup.set_idle", &set_idle);
+}
+
+static int load_symbols(const char *path)
+{
+	FILE *file;
+	char line[256], name[128];
+	unsigned value;
+
+	file = fopen(path, "r");
+	if (!file)
+	{
+		perror(path);
+		return -1;
+	}
+
+	/* XC8 lists one symbol per line: the name, then its value in hex, then where it lives */
+	while (fgets(line, sizeof(line), file))
+	{
+		if (2 != sscanf(line, "%127s %x", name, &value))
+			continue;
+		if (!strcmp(name, "_usb_service") && (NO_SYMBOL == sym_usb_service))
+			sym_usb_service = value;
+		else if (!strcmp(name, "_calc_increment") && (NO_SYMBOL == sym_calc_increment))
+			sym_calc_increment = value;
+		else if (!strcmp(name, "_leds") && (NO_SYMBOL == sym_leds))
+			sym_leds = value;
+	}
+
+	fclose(file);
+	return 0;
+}
+
+static int set_symbol(const char *arg)
+{
+	const char *equals = strchr(arg, '=');
+	unsigned value;
+
+	if (!equals || (1 != sscanf(equals + 1, "%x", &value)))
+		return -1;
+
+	if (!strncmp(arg, "usb_service=", equals - arg + 1))
+		sym_usb_service = value;
+	else if (!strncmp(arg, "calc_increment=", equals - arg + 1))
+		sym_calc_increment = value;
+	else if (!strncmp(arg, "leds=", equals - arg + 1))
+		sym_leds = value;
+	else
+		return -1;
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-o offset] [-s name=address]... [-c baseline.json] [-t percent] [-w trace] blink0.hex [blink0.sym]\n", name);
+	fprintf(stderr, "  -o  where the firmware was linked to (--codeoffset, in hex; 200 unless told otherwise)\n");
+	fprintf(stderr, "  -s  the address of usb_service, calc_increment or leds, in hex, where there is no .sym file\n");
+	fprintf(stderr, "  -c  compare against the output of an earlier run, and fail if anything went up\n");
+	fprintf(stderr, "  -t  how many percent a measurement may go up before -c counts it as a regression (default 0)\n");
+	fprintf(stderr, "  -w  write every byte sent to the WS281x, with its cycle, to a trace file for blink0-ws281x\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *baseline = NULL, *trace_path = NULL;
+	unsigned offset = 0x200;
+	double tolerance = 0.0;
+	uint64_t boot;
+	int opt, regressions = 0;
+
+	/* -s takes precedence over the .sym file, which is read after the options */
+	while ((opt = getopt(argc, argv, "o:s:c:t:w:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'o':
+			offset = strtoul(optarg, NULL, 16);
+			break;
+		case 's':
+			if (set_symbol(optarg))
+				usage(argv[0]);
+			break;
+		case 'c':
+			baseline = optarg;
+			break;
+		case 't':
+			tolerance = atof(optarg);
+			break;
+		case 'w':
+			trace_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if ((optind != argc - 1) && (optind != argc - 2))
+		usage(argv[0]);
+
+	if (pic16_load_hex(&pic, argv[optind]))
+		return 2;
+	if ((optind == argc - 2) && load_symbols(argv[optind + 1]))
+		return 2;
+
+	if (trace_path)
+	{
+		trace = fopen(trace_path, "w");
+		if (!trace)
+		{
+			perror(trace_path);
+			return 2;
+		}
+	}
+
+	pic16_bootloader_vectors(&pic, offset);
+	pic16_reset(&pic);
+	pic.ssp_hook = ssp_hook;
+
+	/* from reset until the firmware has the USB module on the bus */
+	while (!(pic16_peek(&pic, PIC16_UCON) & 0x08))
+	{
+		step();
+		if (pic.cycles > TIMEOUT_CYCLES)
+		{
+			fprintf(stderr, "the firmware never enabled the USB module\n");
+			return 2;
+		}
+	}
+	boot = pic.cycles;
+	metric("boot.cycles", boot);
+
+	enumerate();
+
+	measure_isr();
+	measure_ticks();
+	measure_calc_increment();
+	measure_setup();
+
+	metric("stack.max_depth", pic.max_depth);
+
+	print_metrics(stdout);
+
+	if (trace)
+		fclose(trace);
+
+	if (baseline)
+	{
+		regressions = compare_metrics(baseline, tolerance);
+		if (regressions < 0)
+			return 2;
+	}
+
+	return regressions ? 1 : 0;
+}
@@ -0,0 +1,497 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+blink0-emu: the firmware built for sim/ (the real main.c and USB stack), presented to the PC as a blink0, so that host
+software can be tested without one plugged in
+
+  -u           through UHID: the kernel makes a hidraw node of it, just as if a blink0 had been plugged in, and
+               libblink0, blink0d and anything else that uses hidraw find it by themselves
+  -s <path>    through a Unix socket instead, which needs no privileges; libblink0 opens it as "unix:<path>" (the
+               messages are described in libblink0.h)
+
+the simulated clock runs -x times faster than real time, so that a fade of a minute can be watched in a second; the
+report descriptor, vendor and product come from the firmware itself, and the serial number (which, on a real blink0,
+the bootloader keeps in flash at 0x81EE) from -n
+
+UHID can't pass on a STALL: the kernel turns any error into EIO, which looks as though the device had been unplugged;
+a SET_REPORT the firmware stalls because its command queue is full is therefore held, and retried every simulated
+millisecond until the firmware takes it, which is how long a real host's retries would take; over the socket, the
+STALL is passed on as EPIPE, as hidraw would have it from a real blink0
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/input.h>
+#include <linux/uhid.h>
+
+#include "sim.h"
+#include "libblink0/libblink0.h"
+
+#define MAX_CLIENTS 16
+
+/* standard requests, descriptor types and the HID class descriptor */
+#define GET_DESCRIPTOR    0x06
+#define DESC_DEVICE       0x01
+#define DESC_HID_REPORT   0x22
+
+/* the most simulated time run in one go, so that requests are still answered when the simulation can't keep up */
+#define MAX_RUN_MS 100
+
+/* how long a STALLed SET_REPORT over UHID is retried for, in simulated milliseconds (the kernel waits 5s) */
+#define UHID_RETRY_MS 4000
+
+static uint8_t report_descriptor[HID_MAX_DESCRIPTOR_SIZE];
+static unsigned report_descriptor_length;
+static uint16_t vendor_id, product_id, release;
+static const char *serial = "EMU00001";
+
+static int uhid_fd = -1, listener = -1;
+static int clients[MAX_CLIENTS];
+static unsigned client_count;
+
+static int verbose;
+static unsigned long sets, stalls, gets, inputs;
+static volatile sig_atomic_t quit;
+
+static uint8_t last_frame[1024];
+static unsigned last_length;
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* with -v, every WS281x frame that differs from the one before, as blink0-sim prints them */
+static void frame_hook(const uint8_t *grb, unsigned length, bool bad)
+{
+	unsigned index;
+
+	if (!bad && (length == last_length) && !memcmp(grb, last_frame, length))
+		return;
+	memcpy(last_frame, grb, length);
+	last_length = length;
+
+	printf("%llu: frame%s:", (unsigned long long)(sim_cycles() / SIM_CYCLES_PER_MS), bad ? " (bad)" : "");
+	for (index = 0; index + 3 <= length; index += 3)
+		printf(" %02x%02x%02x", grb[index + 1], grb[index], grb[index + 2]);
+	printf("\n");
+	fflush(stdout);
+}
+
+/* what the firmware says about itself, as the kernel would ask for it when the device is plugged in */
+static int read_descriptors(void)
+{
+	uint8_t device[18];
+	int length;
+
+	if (sim_control(0x80, GET_DESCRIPTOR, DESC_DEVICE << 8, 0, device, sizeof(device)) != sizeof(device))
+		return -1;
+	vendor_id = device[8] | (device[9] << 8);
+	product_id = device[10] | (device[11] << 8);
+	release = device[12] | (device[13] << 8);
+
+	/* the report descriptor of interface 0 */
+	length = sim_control(0x81, GET_DESCRIPTOR, DESC_HID_REPORT << 8, 0, report_descriptor, sizeof(report_descriptor));
+	if (length <= 0)
+		return -1;
+	report_descriptor_length = length;
+	return 0;
+}
+
+static void uhid_send(struct uhid_event *event)
+{
+	if (write(uhid_fd, event, sizeof(*event)) != sizeof(*event))
+		perror("uhid");
+}
+
+static int uhid_create(const char *path)
+{
+	struct uhid_event event;
+
+	uhid_fd = open(path, O_RDWR | O_CLOEXEC);
+	if (uhid_fd < 0)
+	{
+		perror(path);
+		return -1;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.type = UHID_CREATE2;
+	snprintf((char *)event.u.create2.name, sizeof(event.u.create2.name), "blink0-emu");
+	snprintf((char *)event.u.create2.phys, sizeof(event.u.create2.phys), "blink0-emu/%d", (int)getpid());
+	snprintf((char *)event.u.create2.uniq, sizeof(event.u.create2.uniq), "%s", serial);
+	event.u.create2.rd_size = report_descriptor_length;
+	event.u.create2.bus = BUS_USB;
+	event.u.create2.vendor = vendor_id;
+	event.u.create2.product = product_id;
+	event.u.create2.version = release;
+	memcpy(event.u.create2.rd_data, report_descriptor, report_descriptor_length);
+	uhid_send(&event);
+	return 0;
+}
+
+/* input reports from the firmware go to the kernel, or to every client of the socket */
+static void forward_inputs(void)
+{
+	struct uhid_event event;
+	uint8_t message[1 + 64];
+	unsigned index;
+	int length;
+
+	for (;;)
+	{
+		length = sim_in(1, message + 1, sizeof(message) - 1);
+		if (length < 0)
+			return;
+		inputs++;
+
+		if (uhid_fd >= 0)
+		{
+			memset(&event, 0, sizeof(event));
+			event.type = UHID_INPUT2;
+			event.u.input2.size = length;
+			memcpy(event.u.input2.data, message + 1, length);
+			uhid_send(&event);
+		}
+
+		/* a client that isn't reading misses input reports, rather than holding up the simulation */
+		message[0] = BLINK0_EMU_INPUT;
+		for (index = 0; index < client_count; index++)
+			send(clients[index], message, 1 + length, MSG_DONTWAIT | MSG_NOSIGNAL);
+	}
+}
+
+static void run(unsigned ms)
+{
+	while (ms--)
+	{
+		sim_run(1);
+		forward_inputs();
+	}
+}
+
+static void uhid_event(void)
+{
+	struct uhid_event event, reply;
+	unsigned waited;
+	int result;
+
+	if (read(uhid_fd, &event, sizeof(event)) <= 0)
+		return;
+
+	memset(&reply, 0, sizeof(reply));
+
+	switch (event.type)
+	{
+	case UHID_GET_REPORT:
+		gets++;
+		reply.type = UHID_GET_REPORT_REPLY;
+		reply.u.get_report_reply.id = event.u.get_report.id;
+		result = sim_get_report(event.u.get_report.rnum, reply.u.get_report_reply.data, 64);
+		if (result < 0)
+			reply.u.get_report_reply.err = EIO;
+		else
+			reply.u.get_report_reply.size = result;
+		uhid_send(&reply);
+		break;
+
+	case UHID_SET_REPORT:
+		sets++;
+		reply.type = UHID_SET_REPORT_REPLY;
+		reply.u.set_report_reply.id = event.u.set_report.id;
+		for (waited = 0; ; waited++)
+		{
+			result = sim_set_report(event.u.set_report.data, event.u.set_report.size);
+			if ((SIM_STALL != result) || (UHID_RETRY_MS == waited))
+				break;
+			if (!waited)
+				stalls++;
+			run(1);
+		}
+		if (result < 0)
+			reply.u.set_report_reply.err = EIO;
+		uhid_send(&reply);
+		break;
+
+	default:
+		break;
+	}
+}
+
+/* returns false once the client has gone */
+static bool client_message(int fd)
+{
+	uint8_t message[1 + 64], answer[2 + HID_MAX_DESCRIPTOR_SIZE];
+	ssize_t length;
+	int result;
+
+	length = recv(fd, message, sizeof(message), MSG_DONTWAIT);
+	if (0 == length)
+		return false;
+	if (length < 0)
+		return (EAGAIN == errno) || (EINTR == errno);
+
+	answer[0] = message[0];
+	switch (message[0])
+	{
+	case BLINK0_EMU_SET_REPORT:
+		if (length < 2)
+			return true;
+		sets++;
+		result = sim_set_report(message + 1, length - 1);
+		if (SIM_STALL == result)
+			stalls++;
+		answer[1] = (result >= 0) ? 0 : (SIM_STALL == result) ? EPIPE : EIO;
+		length = 2;
+		break;
+
+	case BLINK0_EMU_GET_REPORT:
+		if (length < 3)
+			return true;
+		gets++;
+		result = sim_get_report(message[1], answer + 2, (message[2] < 64) ? message[2] : 64);
+		answer[1] = (result >= 0) ? 0 : (SIM_STALL == result) ? EPIPE : EIO;
+		length = 2 + ((result > 0) ? result : 0);
+		break;
+
+	case BLINK0_EMU_DESCRIPTOR:
+		memcpy(answer + 1, report_descriptor, report_descriptor_length);
+		length = 1 + report_descriptor_length;
+		break;
+
+	case BLINK0_EMU_SERIAL:
+		length = 1 + snprintf((char *)answer + 1, sizeof(answer) - 1, "%s", serial);
+		break;
+
+	default:
+		return true;
+	}
+
+	send(fd, answer, length, MSG_NOSIGNAL);
+	return true;
+}
+
+static int listen_on(const char *path)
+{
+	struct sockaddr_un address;
+
+	listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (listener < 0)
+	{
+		perror("socket");
+		return -1;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+	unlink(path);
+
+	if ((bind(listener, (struct sockaddr *)&address, sizeof(address)) < 0) || (listen(listener, 4) < 0))
+	{
+		perror(path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void stop(int signal)
+{
+	(void)signal;
+	quit = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s (-u | -s socket) [-x speed] [-n serial] [-v]\n", name);
+	fprintf(stderr, "  -u  appear as a HID device through /dev/uhid\n");
+	fprintf(stderr, "  -s  answer on a Unix socket (libblink0 opens it as unix:<socket>)\n");
+	fprintf(stderr, "  -x  how many times faster than real time the simulated clock runs (default 1)\n");
+	fprintf(stderr, "  -n  the serial number (default EMU00001)\n");
+	fprintf(stderr, "  -v  print every WS281x frame that differs from the one before\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *socket_path = NULL;
+	struct pollfd fds[2 + MAX_CLIENTS];
+	double speed = 1.0, due = 0.0;
+	uint64_t last, now;
+	unsigned index, nfds, polled, whole;
+	int opt, use_uhid = 0, fd;
+
+	while ((opt = getopt(argc, argv, "us:x:n:v")) != -1)
+	{
+		switch (opt)
+		{
+		case 'u':
+			use_uhid = 1;
+			break;
+		case 's':
+			socket_path = optarg;
+			break;
+		case 'x':
+			speed = atof(optarg);
+			if (speed <= 0.0)
+				usage(argv[0]);
+			break;
+		case 'n':
+			serial = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if ((optind != argc) || (!use_uhid == !socket_path))
+		usage(argv[0]);
+
+	if (verbose)
+		sim_frame_hook = frame_hook;
+
+	sim_init();
+	if (sim_enumerate() || read_descriptors())
+	{
+		fprintf(stderr, "the firmware didn't enumerate\n");
+		return 1;
+	}
+
+	if (use_uhid && uhid_create("/dev/uhid"))
+		return 1;
+	if (socket_path && listen_on(socket_path))
+		return 1;
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	signal(SIGPIPE, SIG_IGN);
+
+	fprintf(stderr, "blink0-emu: %04x:%04x serial %s, %g times real time\n", vendor_id, product_id, serial, speed);
+
+	last = now_us();
+	while (!quit)
+	{
+		nfds = 0;
+		if (uhid_fd >= 0)
+		{
+			fds[nfds].fd = uhid_fd;
+			fds[nfds++].events = POLLIN;
+		}
+		if (listener >= 0)
+		{
+			fds[nfds].fd = listener;
+			fds[nfds++].events = POLLIN;
+		}
+		polled = client_count;
+		for (index = 0; index < polled; index++)
+		{
+			fds[nfds].fd = clients[index];
+			fds[nfds++].events = POLLIN;
+		}
+
+		/* wake up for each simulated millisecond (or each real one, when the clock runs faster than that) */
+		if ((poll(fds, nfds, (speed >= 1.0) ? 1 : (int)(1.0 / speed)) < 0) && (EINTR != errno))
+		{
+			perror("poll");
+			break;
+		}
+
+		nfds = 0;
+		if (uhid_fd >= 0)
+		{
+			if (fds[nfds++].revents & POLLIN)
+				uhid_event();
+		}
+		if (listener >= 0)
+			nfds++;
+
+		/* from the last client down, as dropping one moves the last into its place */
+		for (index = polled; index-- > 0;)
+		{
+			if ((fds[nfds + index].revents & (POLLIN | POLLHUP | POLLERR)) && !client_message(clients[index]))
+			{
+				close(clients[index]);
+				clients[index] = clients[--client_count];
+			}
+		}
+
+		if ((listener >= 0) && (fds[nfds - 1].revents & POLLIN))
+		{
+			fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+			if ((fd >= 0) && (MAX_CLIENTS == client_count))
+				close(fd);
+			else if (fd >= 0)
+				clients[client_count++] = fd;
+		}
+
+		/* let as much simulated time pass as real time has, times the speed */
+		now = now_us();
+		due += (now - last) * speed / 1000.0;
+		last = now;
+		whole = (due > MAX_RUN_MS) ? MAX_RUN_MS : (unsigned)due;
+		if (due > MAX_RUN_MS)
+			due = MAX_RUN_MS;
+		due -= whole;
+		run(whole);
+	}
+
+	if (uhid_fd >= 0)
+	{
+		struct uhid_event event = { .type = UHID_DESTROY };
+
+		uhid_send(&event);
+		close(uhid_fd);
+	}
+	if (socket_path)
+		unlink(socket_path);
+
+	fprintf(stderr, "blink0-emu: %llu ms simulated, %lu SET_REPORTs (%lu stalled), %lu GET_REPORTs, %lu input reports\n",
+		(unsigned long long)(sim_cycles() / SIM_CYCLES_PER_MS), sets, stalls, gets, inputs);
+	return 0;
+}
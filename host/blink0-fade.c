@@ -0,0 +1,450 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+blink0-fade: checks the model of the fade engine in fade.c, and what it says about the fades blink0 does
+
+  -c  runs the firmware itself (built against the simulated PIC in sim/) through a few thousand fades, 54 at a time
+      (every colour of every LED), and checks that every LED matches the model at every tick
+  -s  sweeps every distance, direction and fade time (1 to 65535 ticks); the model moves the same way from any start,
+      so this covers every start and target; it reports any fade that overshoots its target, and how far each jumps
+      on its last tick, when the final value is written
+  -b  compares every fade of up to 1000 ticks (and a few longer ones) with the straight line Blink(1) documents,
+      reaching the target fade_delay ticks later
+  -t  prints one fade (start,target,fade_delay) tick by tick, next to the straight line
+
+with none of them, it does -c, -s and -b; the exit status is 1 if the firmware and the model disagree, or a fade overshoots
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "fade.h"
+
+/* these mirror blink0.h in the firmware */
+#define LED_COUNT        18
+#define REPORT_ID_BLINK1 0x01
+#define REPORT_LEN       9
+
+/* how many of each sort of problem are described */
+#define REPORT_LIMIT 10
+
+static const char channel_names[3] = { 'g', 'r', 'b' };
+
+/* WS281x frames from the firmware, in the order they went out */
+static uint8_t (*frames)[3 * LED_COUNT];
+static unsigned frame_count, frames_allocated, bad_frames;
+
+static void frame_hook(const uint8_t *grb, unsigned length, bool bad)
+{
+	if (bad || (length != 3 * LED_COUNT))
+	{
+		bad_frames++;
+		return;
+	}
+
+	if (frame_count == frames_allocated)
+	{
+		frames_allocated = frames_allocated ? 2 * frames_allocated : 1024;
+		frames = realloc(frames, frames_allocated * sizeof(*frames));
+		if (!frames)
+		{
+			perror("realloc");
+			exit(2);
+		}
+	}
+
+	memcpy(frames[frame_count++], grb, length);
+}
+
+/* a Blink(1) 'c' command to one LED; the colours are given green, red, blue, as the WS281x has them */
+static int fade_to(uint8_t ledn, const uint8_t grb[3], uint16_t fade_delay)
+{
+	uint8_t report[REPORT_LEN] = { REPORT_ID_BLINK1, 'c', grb[1], grb[0], grb[2], fade_delay >> 8, fade_delay & 0xFF, ledn, 0 };
+
+	return sim_set_report(report, sizeof(report));
+}
+
+static int check(void)
+{
+	static const uint8_t pairs[][2] =
+	{
+		{ 0, 255 }, { 255, 0 }, { 0, 1 }, { 1, 0 }, { 254, 255 }, { 255, 254 }, { 0, 0 }, { 128, 128 },
+		{ 100, 101 }, { 101, 100 }, { 17, 240 }, { 240, 17 }, { 0, 128 }, { 128, 0 }, { 10, 20 }, { 20, 10 },
+		{ 3, 250 }, { 250, 3 }, { 64, 192 }, { 192, 64 }, { 99, 156 }, { 156, 99 }, { 1, 254 }, { 254, 1 },
+		{ 50, 51 }, { 200, 199 }, { 0, 2 }, { 2, 0 }, { 0, 10 }, { 10, 0 },
+	};
+	static const uint16_t fade_delays[] =
+	{
+		0, 1, 2, 3, 4, 5, 7, 10, 50, 99, 100, 101, 255, 256, 257, 300, 500, 511, 512, 1000, 2559, 2560, 2561, 10000, 65535,
+	};
+	struct fade_channel model[LED_COUNT][3];
+	bool differs[LED_COUNT][3];
+	unsigned first[LED_COUNT];
+	uint8_t start[3], target[3];
+	unsigned pass, led, channel, pair, tick, fades = 0, mismatches = 0;
+	uint16_t fade_delay;
+	const uint8_t *sent;
+
+	sim_frame_hook = frame_hook;
+	sim_init();
+	if (sim_enumerate())
+	{
+		fprintf(stderr, "the firmware did not enumerate\n");
+		return -1;
+	}
+
+	for (pass = 0; pass < sizeof(fade_delays) / sizeof(fade_delays[0]); pass++)
+	{
+		fade_delay = fade_delays[pass];
+
+		/* every LED goes straight to where its fades start */
+		for (led = 0; led < LED_COUNT; led++)
+		{
+			for (channel = 0; channel < 3; channel++)
+				start[channel] = pairs[(3 * led + channel + pass) % (sizeof(pairs) / sizeof(pairs[0]))][0];
+			if (fade_to(led + 1, start, 0) < 0)
+				return -1;
+		}
+		sim_run(30);
+
+		/* then each starts its fade; the first frame to go out after that still shows it where it started */
+		frame_count = 0;
+		for (led = 0; led < LED_COUNT; led++)
+		{
+			for (channel = 0; channel < 3; channel++)
+			{
+				pair = (3 * led + channel + pass) % (sizeof(pairs) / sizeof(pairs[0]));
+				model[led][channel].current = pairs[pair][0];
+				target[channel] = pairs[pair][1];
+				fade_set(&model[led][channel], target[channel], fade_delay);
+				differs[led][channel] = false;
+			}
+			if (fade_to(led + 1, target, fade_delay) < 0)
+				return -1;
+			first[led] = frame_count;
+			fades += 3;
+		}
+
+		/* until every fade has gone out, final value and all */
+		while (frame_count < first[LED_COUNT - 1] + fade_delay + 3)
+			sim_run(10);
+
+		for (led = 0; led < LED_COUNT; led++)
+		{
+			for (tick = 0; tick <= (unsigned)fade_delay + 2; tick++)
+			{
+				sent = &frames[first[led] + tick][3 * led];
+
+				for (channel = 0; channel < 3; channel++)
+				{
+					/* only the first difference in each fade is of any interest */
+					if (!differs[led][channel] && (sent[channel] != model[led][channel].current))
+					{
+						differs[led][channel] = true;
+						if (mismatches++ < REPORT_LIMIT)
+							printf("  fade of %u ticks, LED %u %c to %u: at tick %u the firmware has %u, the model %u\n", fade_delay,
+								led + 1, channel_names[channel], model[led][channel].target, tick, sent[channel], model[led][channel].current);
+					}
+					fade_tick(&model[led][channel]);
+				}
+			}
+		}
+	}
+
+	printf("check: %u fades in the firmware, %u of them differ from the model, %u bad frames\n", fades, mismatches, bad_frames);
+
+	return mismatches || bad_frames;
+}
+
+/* the fades are reported in bands of fade time, each ten times longer than the last */
+#define BANDS 5
+
+static unsigned band(uint16_t fade_delay)
+{
+	unsigned index = 0;
+
+	while ((fade_delay >= 10) && (index < BANDS - 1))
+	{
+		fade_delay /= 10;
+		index++;
+	}
+
+	return index;
+}
+
+static const char *band_names[BANDS] = { "1-9", "10-99", "100-999", "1000-9999", "10000-65535" };
+
+/* the model set up for a fade of a given distance and direction; it starts at 0 going up, and at 255 going down */
+static void fade_from_end(struct fade_channel *channel, bool up, uint8_t distance, uint16_t fade_delay)
+{
+	channel->current = up ? 0 : 255;
+	fade_set(channel, up ? distance : 255 - distance, fade_delay);
+}
+
+/* go through a fade tick by tick, and check fade_moved() agrees with it at every one */
+static bool moved_agrees(bool up, uint8_t distance, uint16_t fade_delay)
+{
+	struct fade_channel channel, reference;
+	uint32_t tick;
+	uint8_t expected;
+
+	fade_from_end(&channel, up, distance, fade_delay);
+	reference = channel;
+
+	for (tick = 1; tick <= fade_delay; tick++)
+	{
+		fade_tick(&channel);
+		expected = up ? fade_moved(&reference, tick) : 255 - fade_moved(&reference, tick);
+		if (channel.current != expected)
+			return false;
+	}
+
+	/* and on the tick after the last, the final value */
+	fade_tick(&channel);
+	return channel.current == reference.target;
+}
+
+static int sweep(void)
+{
+	static const uint16_t long_fades[] = { 1000, 2560, 10000, 65535 };
+	struct fade_channel channel;
+	unsigned jump_max[BANDS] = { 0 }, stuck[BANDS] = { 0 }, fades[BANDS] = { 0 };
+	uint8_t worst_distance[BANDS] = { 0 };
+	uint16_t worst_fade[BANDS] = { 0 };
+	bool worst_up[BANDS] = { false };
+	unsigned overshoots = 0, disagreements = 0, up, distance, index;
+	uint32_t fade_delay, moved;
+
+	/* fade_moved() is what makes the sweep quick enough; it is checked tick by tick for every short fade and a few long ones */
+	for (up = 0; up < 2; up++)
+		for (distance = 1; distance < 256; distance++)
+		{
+			for (fade_delay = 1; fade_delay <= 300; fade_delay++)
+				disagreements += !moved_agrees(up, distance, fade_delay);
+			for (index = 0; index < sizeof(long_fades) / sizeof(long_fades[0]); index++)
+				disagreements += !moved_agrees(up, distance, long_fades[index]);
+		}
+
+	for (fade_delay = 1; fade_delay <= 0xFFFF; fade_delay++)
+		for (up = 0; up < 2; up++)
+			for (distance = 1; distance < 256; distance++)
+			{
+				fade_from_end(&channel, up, distance, fade_delay);
+				moved = fade_moved(&channel, fade_delay);
+				index = band(fade_delay);
+				fades[index]++;
+
+				if (moved > distance)
+				{
+					if (overshoots++ < REPORT_LIMIT)
+						printf("  %s %u over %u ticks overshoots by %u\n", up ? "up" : "down", distance, fade_delay, moved - distance);
+					continue;
+				}
+
+				if (0 == moved)
+					stuck[index]++;
+
+				if ((distance - moved) > jump_max[index])
+				{
+					jump_max[index] = distance - moved;
+					worst_distance[index] = distance;
+					worst_fade[index] = fade_delay;
+					worst_up[index] = up;
+				}
+			}
+
+	printf("sweep: every distance and direction, over every fade of 1 to 65535 ticks\n");
+	printf("  fade_moved() and fade_tick() disagree on %u fades\n", disagreements);
+	printf("  %u fades overshoot\n", overshoots);
+	for (index = 0; index < BANDS; index++)
+		printf("  %s ticks: %u fades; the last tick jumps by up to %u (%s %u over %u); %u only move on the last tick\n", band_names[index],
+			fades[index], jump_max[index], worst_up[index] ? "up" : "down", worst_distance[index], worst_fade[index], stuck[index]);
+
+	return overshoots || disagreements;
+}
+
+static int compare(void)
+{
+	static const uint16_t long_fades[] = { 2000, 5000, 10000, 30000, 65535 };
+	struct fade_channel channel;
+	unsigned error_max[BANDS] = { 0 }, late_max[BANDS] = { 0 };
+	uint64_t error_sum[BANDS] = { 0 }, ticks[BANDS] = { 0 };
+	uint8_t worst_distance[BANDS] = { 0 };
+	uint16_t worst_fade[BANDS] = { 0 };
+	bool worst_up[BANDS] = { false };
+	unsigned up, distance, index, error, pass;
+	uint32_t fade_delay, tick, arrived;
+	uint8_t start;
+
+	for (pass = 0; pass < 1000 + sizeof(long_fades) / sizeof(long_fades[0]); pass++)
+	{
+		fade_delay = (pass < 1000) ? (pass + 1) : long_fades[pass - 1000];
+		index = band(fade_delay);
+
+		for (up = 0; up < 2; up++)
+			for (distance = 1; distance < 256; distance++)
+			{
+				fade_from_end(&channel, up, distance, fade_delay);
+				start = channel.current;
+				arrived = 0;
+
+				/* up to and including the tick on which the final value is written */
+				for (tick = 0; tick <= fade_delay + 1; tick++)
+				{
+					if (tick)
+						fade_tick(&channel);
+
+					error = abs((int)channel.current - fade_linear(start, channel.target, fade_delay, tick));
+					error_sum[index] += error;
+					ticks[index]++;
+					if (error > error_max[index])
+					{
+						error_max[index] = error;
+						worst_distance[index] = distance;
+						worst_fade[index] = fade_delay;
+						worst_up[index] = up;
+					}
+
+					if ((channel.current == channel.target) && !arrived)
+						arrived = tick;
+				}
+
+				if ((arrived - fade_delay) > late_max[index])
+					late_max[index] = arrived - fade_delay;
+			}
+	}
+
+	printf("compare: every distance and direction against a straight line reaching the target on time (Blink(1))\n");
+	for (index = 0; index < BANDS; index++)
+	{
+		if (!ticks[index])
+			continue;
+		printf("  %s ticks: off by %.2f on average, and up to %u (%s %u over %u); reaches the target up to %u tick%s late\n", band_names[index],
+			(double)error_sum[index] / ticks[index], error_max[index], worst_up[index] ? "up" : "down", worst_distance[index],
+			worst_fade[index], late_max[index], (1 == late_max[index]) ? "" : "s");
+	}
+
+	return 0;
+}
+
+static int trace(const char *arg)
+{
+	struct fade_channel channel;
+	unsigned start, target, fade_delay;
+	uint32_t tick;
+
+	if ((3 != sscanf(arg, "%u,%u,%u", &start, &target, &fade_delay)) || (start > 255) || (target > 255) || (fade_delay > 0xFFFF))
+		return -1;
+
+	channel.current = start;
+	fade_set(&channel, target, fade_delay);
+	printf("increment 0x%04x (%s)\n", channel.increment, (channel.increment & 1) ? "up" : "down");
+
+	for (tick = 0; tick <= fade_delay + 1; tick++)
+	{
+		if (tick)
+			fade_tick(&channel);
+		printf("%u: %u %u\n", tick, channel.current, fade_linear(start, target, fade_delay, tick));
+	}
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-c] [-s] [-b] [-t start,target,fade_delay]\n", name);
+	fprintf(stderr, "  -c  check the model against the firmware\n");
+	fprintf(stderr, "  -s  sweep every fade for overshoot, and for how far the last tick jumps\n");
+	fprintf(stderr, "  -b  compare the fades with the straight line Blink(1) documents\n");
+	fprintf(stderr, "  -t  print one fade tick by tick: the model, then the straight line\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	bool do_check = false, do_sweep = false, do_compare = false;
+	const char *trace_arg = NULL;
+	int opt, result, failed = 0;
+
+	while ((opt = getopt(argc, argv, "csbt:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'c':
+			do_check = true;
+			break;
+		case 's':
+			do_sweep = true;
+			break;
+		case 'b':
+			do_compare = true;
+			break;
+		case 't':
+			trace_arg = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc)
+		usage(argv[0]);
+
+	if (trace_arg)
+	{
+		if (trace(trace_arg))
+			usage(argv[0]);
+		return 0;
+	}
+
+	if (!do_check && !do_sweep && !do_compare)
+		do_check = do_sweep = do_compare = true;
+
+	if (do_check)
+	{
+		result = check();
+		if (result < 0)
+			return 2;
+		failed |= result;
+	}
+	if (do_sweep)
+		failed |= sweep();
+	if (do_compare)
+		failed |= compare();
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,251 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+blink0-latency: measures how long blink0 takes from receiving a command until it is shown
+
+every command is sent with a sequence number; the status report then tells us the USB frame in which
+the command arrived, how many frames later it was applied, and how many frames later the first
+WS281x frame carrying it began; this tool gathers those into histograms
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+
+/* these mirror blink0.h in the firmware */
+#define REPORT_ID_BLINK1  0x01
+#define REPORT_ID_STATUS  0x02
+#define REPORT_SEQ_INDEX  8
+#define STATUS_SEQ        1
+#define STATUS_FLAGS      2
+#define STATUS_RECEIVED   4
+#define STATUS_APPLIED    6
+#define STATUS_LIT        7
+#define STATUS_STAMPED_SEQ 8
+#define STATUS_LEN        9
+
+#define BUCKETS 256 /* one per millisecond; the firmware saturates its stamps at 255 */
+
+static unsigned applied_hist[BUCKETS], lit_hist[BUCKETS], host_hist[BUCKETS];
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int get_status(int fd, uint8_t *status)
+{
+	memset(status, 0, STATUS_LEN);
+	status[0] = REPORT_ID_STATUS;
+	return ioctl(fd, HIDIOCGFEATURE(STATUS_LEN), status);
+}
+
+static unsigned percentile(const unsigned *hist, unsigned total, double fraction)
+{
+	unsigned index, sum = 0;
+
+	for (index = 0; index < BUCKETS; index++)
+	{
+		sum += hist[index];
+		if (sum >= total * fraction)
+			return index;
+	}
+
+	return BUCKETS - 1;
+}
+
+static void print_histogram(const char *name, const unsigned *hist, unsigned total)
+{
+	unsigned index, peak = 0, bar;
+
+	printf("\n%s (ms): p50 %u  p90 %u  p99 %u  max %u\n", name,
+		percentile(hist, total, 0.50), percentile(hist, total, 0.90),
+		percentile(hist, total, 0.99), percentile(hist, total, 1.0));
+
+	for (index = 0; index < BUCKETS; index++)
+		if (hist[index] > peak)
+			peak = hist[index];
+
+	for (index = 0; index < BUCKETS; index++)
+	{
+		if (!hist[index])
+			continue;
+		printf("%4u%s | %6u ", index, (BUCKETS - 1 == index) ? "+" : " ", hist[index]);
+		for (bar = 0; bar < (hist[index] * 50 + peak - 1) / peak; bar++)
+			putchar('#');
+		putchar('\n');
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-n commands] [-i interval_ms] [-c] /dev/hidrawN\n", name);
+	fprintf(stderr, "  -c  print each command's stamps as CSV instead of histograms\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int fd, opt, length, csv = 0;
+	unsigned count = 1000, interval = 20, sent, total = 0, timeouts = 0;
+	uint8_t report[9], status[STATUS_LEN], seq = 0;
+	double start;
+
+	while ((opt = getopt(argc, argv, "n:i:c")) != -1)
+	{
+		switch (opt)
+		{
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			interval = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			csv = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind >= argc)
+		usage(argv[0]);
+
+	fd = open(argv[optind], O_RDWR);
+	if (fd < 0)
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+
+	/* read (and so clear) any stale flags before starting */
+	length = get_status(fd, status);
+	if (length < 0)
+	{
+		perror("status report (is this a blink0 with latency stamps?)");
+		return 1;
+	}
+	if (length < STATUS_LEN)
+	{
+		fprintf(stderr, "status report too short: this firmware doesn't say which command its stamps belong to\n");
+		return 1;
+	}
+
+	if (csv)
+		printf("seq,received_frame,applied_ms,lit_ms,host_ms\n");
+
+	for (sent = 0; sent < count; sent++)
+	{
+		seq = (255 == seq) ? 1 : seq + 1;
+
+		/* fade all LEDs to a colour that changes each time, over one 10ms step */
+		memset(report, 0, sizeof(report));
+		report[0] = REPORT_ID_BLINK1;
+		report[1] = 'c';
+		report[2] = sent * 37;
+		report[3] = sent * 59;
+		report[4] = sent * 83;
+		report[6] = 1;
+		report[REPORT_SEQ_INDEX] = seq;
+
+		start = now_ms();
+		if (ioctl(fd, HIDIOCSFEATURE(sizeof(report)), report) < 0)
+		{
+			perror("SET_REPORT");
+			return 1;
+		}
+
+		/* wait until the command has made it all the way out to the LEDs */
+		for (;;)
+		{
+			if (get_status(fd, status) < 0)
+			{
+				perror("GET_REPORT");
+				return 1;
+			}
+
+			if ((status[STATUS_STAMPED_SEQ] == seq) && (0xFF != status[STATUS_LIT]))
+				break;
+
+			if (now_ms() - start > 1000.0)
+			{
+				timeouts++;
+				break;
+			}
+		}
+
+		if ((status[STATUS_STAMPED_SEQ] == seq) && (0xFF != status[STATUS_LIT]))
+		{
+			unsigned host = (unsigned)(now_ms() - start);
+
+			applied_hist[status[STATUS_APPLIED]]++;
+			lit_hist[status[STATUS_LIT]]++;
+			host_hist[(host < BUCKETS) ? host : BUCKETS - 1]++;
+			total++;
+
+			if (csv)
+				printf("%u,%u,%u,%u,%u\n", seq,
+					status[STATUS_RECEIVED] | (status[STATUS_RECEIVED + 1] << 8),
+					status[STATUS_APPLIED], status[STATUS_LIT], host);
+		}
+
+		if (status[STATUS_FLAGS])
+			fprintf(stderr, "seq %u: device reported flags 0x%02x\n", seq, status[STATUS_FLAGS]);
+
+		usleep(interval * 1000);
+	}
+
+	close(fd);
+
+	if (csv)
+		return 0;
+
+	printf("%u commands, %u measured, %u timed out\n", count, total, timeouts);
+	if (!total)
+		return 1;
+
+	print_histogram("received -> applied to fade engine", applied_hist, total);
+	print_histogram("received -> first WS281x frame", lit_hist, total);
+	print_histogram("host SET_REPORT -> seen lit by host", host_hist, total);
+
+	return 0;
+}
@@ -0,0 +1,663 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+blink0-plan: works out how to get an animation onto the LEDs for the least USB traffic, within a given colour error
+
+the animation is a list of keyframes, one per line: "<led> <ms> <rrggbb>", LED 0 being all of them; each LED goes in a
+straight line from one keyframe to the next, and that is the ideal it is held to; it is played out a few ways, with
+the fade engine modelled bit for bit (fade.c), and each is measured against the ideal at every 10ms tick:
+
+  device      one 'c' command per keyframe, the firmware's fade doing the rest
+  split       the same, but any fade that strays too far from the ideal is split in two at its midpoint (by an
+              intermediate keyframe, on the ideal line), again and again until it doesn't
+  hid-stream  the host works out every frame (every -f ticks), sending an immediate 'c' for each LED that changed
+  cdc-stream  the same, as one Adalight frame over the CDC serial port (only for firmware built with BLINK0_CDC; -s)
+
+for each, the commands and control transfers it takes, the most SET_REPORTs it needs in any one tick, the bytes it
+puts on the bus (every packet of every transfer at full speed: SYNC, PID, token address and CRC, data and CRC, and
+handshake), and the largest and RMS colour error; the cheapest that is within the bound (-e) and that EP0 can carry is
+picked, and with -o, written out in libblink0's trace format, for blink0-replay to play to the firmware; the exit status
+is 1 if none of them will do
+
+a SET_REPORT through hidraw waits for its status stage, which takes at least a 1ms frame, so by default a plan may need
+no more than 10 in a tick (-b); the commands of a busier tick would be late, and the firmware's fades with them
+
+the commands are taken to be applied just before a tick, as the main loop does them between ticks; the LEDs' values
+after a tick are what the next frame shows, so they are held to where the ideal is at the next tick
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "fade.h"
+
+/* these mirror blink0.h and usb_config.h in the firmware */
+#define LED_COUNT        18
+#define REPORT_ID_BLINK1 0x01
+#define REPORT_LEN       9
+#define EP_0_LEN         8
+#define EP_2_OUT_LEN     64
+#define TICK_MS          10
+
+/* the SET_REPORTs the host can get through in a tick, one round trip per 1ms frame */
+#define TRANSFERS_PER_TICK TICK_MS
+
+/* an Adalight frame: "Ada", the LED count less one (big-endian), its checksum, and then the LEDs */
+#define ADALIGHT_LEN     (6 + 3 * LED_COUNT)
+
+/* full-speed packets: SYNC and PID, and then a token's address, endpoint and CRC5, or a data packet's data and CRC16 */
+#define TOKEN_BYTES      4
+#define HANDSHAKE_BYTES  2
+#define DATA_BYTES(n)    (4 + (n))
+
+#define MAX_KEYS 4096
+
+struct track_struct
+{
+	uint8_t ledn;
+	unsigned key_count;
+	uint32_t ticks[MAX_KEYS];
+	uint8_t rgb[MAX_KEYS][3];
+};
+
+struct command_struct
+{
+	uint32_t tick;
+	uint8_t ledn;
+	uint8_t rgb[3];
+	uint16_t fade_delay;
+};
+
+struct plan_struct
+{
+	const char *name;
+	bool streamed;  /* Adalight frames, rather than commands */
+	struct command_struct *commands;
+	unsigned count, size;
+	uint32_t *frames;
+	unsigned frame_count, frame_size;
+	double max_error, square_error;
+	uint64_t samples;
+	unsigned peak_transfers;  /* the most SET_REPORTs on any one tick */
+};
+
+static struct track_struct tracks[LED_COUNT + 1];
+static unsigned track_count;
+static double bound = 2.0;
+static unsigned transfers_per_tick = TRANSFERS_PER_TICK;
+
+/* where the ideal line is for one colour of a track at a tick */
+static double ideal(const struct track_struct *track, uint32_t tick, unsigned colour)
+{
+	unsigned key;
+	double from, to;
+
+	if (tick <= track->ticks[0])
+		return track->rgb[0][colour];
+
+	for (key = 1; key < track->key_count; key++)
+	{
+		if (tick > track->ticks[key])
+			continue;
+		from = track->rgb[key - 1][colour];
+		to = track->rgb[key][colour];
+		return from + (to - from) * (tick - track->ticks[key - 1]) / (track->ticks[key] - track->ticks[key - 1]);
+	}
+
+	return track->rgb[track->key_count - 1][colour];
+}
+
+static uint8_t ideal_rounded(const struct track_struct *track, uint32_t tick, unsigned colour)
+{
+	return (uint8_t)floor(ideal(track, tick, colour) + 0.5);
+}
+
+static void add_command(struct plan_struct *plan, uint32_t tick, uint8_t ledn, const uint8_t rgb[3], uint16_t fade_delay)
+{
+	struct command_struct *grown;
+
+	if (plan->count == plan->size)
+	{
+		plan->size = plan->size ? 2 * plan->size : 256;
+		grown = realloc(plan->commands, plan->size * sizeof(*grown));
+		if (!grown)
+		{
+			perror("realloc");
+			exit(2);
+		}
+		plan->commands = grown;
+	}
+
+	plan->commands[plan->count].tick = tick;
+	plan->commands[plan->count].ledn = ledn;
+	memcpy(plan->commands[plan->count].rgb, rgb, 3);
+	plan->commands[plan->count].fade_delay = fade_delay;
+	plan->count++;
+}
+
+static void add_frame(struct plan_struct *plan, uint32_t tick)
+{
+	uint32_t *grown;
+
+	if (plan->frame_count == plan->frame_size)
+	{
+		plan->frame_size = plan->frame_size ? 2 * plan->frame_size : 256;
+		grown = realloc(plan->frames, plan->frame_size * sizeof(*grown));
+		if (!grown)
+		{
+			perror("realloc");
+			exit(2);
+		}
+		plan->frames = grown;
+	}
+
+	plan->frames[plan->frame_count++] = tick;
+}
+
+/* one tick of a track's three colours, measured against the ideal */
+static double tick_error(const struct track_struct *track, struct fade_channel channels[3], uint32_t tick, double *square)
+{
+	double error, worst = 0.0;
+	unsigned colour;
+
+	for (colour = 0; colour < 3; colour++)
+	{
+		fade_tick(&channels[colour]);
+		error = fabs(channels[colour].current - ideal(track, tick + 1, colour));
+		if (error > worst)
+			worst = error;
+		if (square)
+			*square += error * error;
+	}
+
+	return worst;
+}
+
+static void send(struct fade_channel channels[3], const uint8_t rgb[3], uint16_t fade_delay)
+{
+	unsigned colour;
+
+	for (colour = 0; colour < 3; colour++)
+		fade_set(&channels[colour], rgb[colour], fade_delay);
+}
+
+/*
+a fade from tick start to tick end; if it strays too far (and split is set), two halves, each of which may split again,
+so long as the halves come out closer to the ideal than the whole did (the shorter a fade, the later in its ticks it
+lands, so halving doesn't always help); returns the largest error of what was planned
+*/
+static double plan_segment(struct plan_struct *plan, const struct track_struct *track, struct fade_channel channels[3],
+	uint32_t start, uint32_t end, const uint8_t rgb[3], bool split)
+{
+	struct fade_channel trial[3], halved[3];
+	struct plan_struct halves = { .name = NULL };
+	uint8_t middle_rgb[3];
+	uint32_t tick, middle, ticks = end - start;
+	unsigned colour, index;
+	double worst = 0.0, error;
+
+	/* a fade can't be longer than fade_delay can say */
+	if (ticks > 0xFFFF)
+	{
+		middle = start + 0xFFFF;
+		for (colour = 0; colour < 3; colour++)
+			middle_rgb[colour] = ideal_rounded(track, middle, colour);
+		worst = plan_segment(plan, track, channels, start, middle, middle_rgb, split);
+		error = plan_segment(plan, track, channels, middle, end, rgb, split);
+		return (error > worst) ? error : worst;
+	}
+
+	memcpy(trial, channels, sizeof(trial));
+	send(trial, rgb, ticks);
+	for (tick = start; tick < end; tick++)
+	{
+		error = tick_error(track, trial, tick, NULL);
+		if (error > worst)
+			worst = error;
+	}
+
+	if (split && (worst > bound) && (ticks > 1))
+	{
+		middle = start + ticks / 2;
+		for (colour = 0; colour < 3; colour++)
+			middle_rgb[colour] = ideal_rounded(track, middle + 1, colour);
+		memcpy(halved, channels, sizeof(halved));
+		error = plan_segment(&halves, track, halved, start, middle, middle_rgb, split);
+		if (error < worst)
+		{
+			error = fmax(error, plan_segment(&halves, track, halved, middle, end, rgb, split));
+			if (error < worst)
+			{
+				for (index = 0; index < halves.count; index++)
+					add_command(plan, halves.commands[index].tick, halves.commands[index].ledn, halves.commands[index].rgb,
+						halves.commands[index].fade_delay);
+				memcpy(channels, halved, sizeof(halved));
+				free(halves.commands);
+				return error;
+			}
+		}
+		free(halves.commands);
+	}
+
+	add_command(plan, start, track->ledn, rgb, ticks);
+	memcpy(channels, trial, sizeof(trial));
+	return worst;
+}
+
+/* device and split: a fade to each keyframe, from the one before */
+static void plan_fades(struct plan_struct *plan, bool split)
+{
+	struct fade_channel channels[3];
+	const struct track_struct *track;
+	unsigned index, key;
+
+	for (index = 0; index < track_count; index++)
+	{
+		track = &tracks[index];
+		memset(channels, 0, sizeof(channels));
+
+		/*
+		the first keyframe is where the LED starts, set straight away a tick ahead of it; on the same tick as the first
+		fade, that fade would start from whatever the LED showed before
+		*/
+		add_command(plan, track->ticks[0] - 1, track->ledn, track->rgb[0], 0);
+		send(channels, track->rgb[0], 0);
+		tick_error(track, channels, track->ticks[0] - 1, NULL);
+
+		for (key = 1; key < track->key_count; key++)
+			plan_segment(plan, track, channels, track->ticks[key - 1], track->ticks[key], track->rgb[key], split);
+	}
+}
+
+/* hid-stream and cdc-stream: the host works out each frame */
+static void plan_stream(struct plan_struct *plan, unsigned period, bool adalight)
+{
+	uint8_t sent[LED_COUNT + 1][3], rgb[3];
+	bool changed, any, known[LED_COUNT + 1] = { false };
+	uint32_t first = UINT32_MAX, last = 0, tick;
+	unsigned index, colour;
+
+	for (index = 0; index < track_count; index++)
+	{
+		if (tracks[index].ticks[0] - 1 < first)
+			first = tracks[index].ticks[0] - 1;
+		if (tracks[index].ticks[tracks[index].key_count - 1] > last)
+			last = tracks[index].ticks[tracks[index].key_count - 1];
+	}
+
+	for (tick = first; tick <= last; tick += period)
+	{
+		any = false;
+		for (index = 0; index < track_count; index++)
+		{
+			/* where the LED should be once this tick is over */
+			for (colour = 0; colour < 3; colour++)
+				rgb[colour] = ideal_rounded(&tracks[index], tick + 1, colour);
+			changed = !known[index] || memcmp(rgb, sent[index], 3);
+			memcpy(sent[index], rgb, 3);
+			known[index] = true;
+
+			if (changed && !adalight)
+				add_command(plan, tick, tracks[index].ledn, rgb, 0);
+			any |= changed;
+		}
+
+		if (any && adalight)
+			add_frame(plan, tick);
+	}
+}
+
+/* plays a plan out, tick by tick, against the ideal */
+static void measure(struct plan_struct *plan)
+{
+	struct fade_channel channels[3];
+	const struct track_struct *track;
+	uint8_t rgb[3];
+	uint32_t tick, last;
+	unsigned index, next_command, next_frame, colour;
+	double error;
+
+	for (index = 0; index < track_count; index++)
+	{
+		track = &tracks[index];
+		memset(channels, 0, sizeof(channels));
+		last = track->ticks[track->key_count - 1];
+		next_command = next_frame = 0;
+
+		/* from the start of the plan, as a stream may have set this LED before its first keyframe */
+		for (tick = 0; tick <= last; tick++)
+		{
+			/* the commands for this tick; they were planned in order, one track after another */
+			for (; next_command < plan->count; next_command++)
+			{
+				if ((plan->commands[next_command].ledn != track->ledn) || (plan->commands[next_command].tick < tick))
+					continue;
+				if (plan->commands[next_command].tick > tick)
+					break;
+				send(channels, plan->commands[next_command].rgb, plan->commands[next_command].fade_delay);
+			}
+
+			/* an Adalight frame sets every LED at the next tick */
+			for (; (next_frame < plan->frame_count) && (plan->frames[next_frame] <= tick); next_frame++)
+			{
+				if (plan->frames[next_frame] < tick)
+					continue;
+				for (colour = 0; colour < 3; colour++)
+					rgb[colour] = ideal_rounded(track, tick + 1, colour);
+				send(channels, rgb, 0);
+			}
+
+			if (tick + 1 < track->ticks[0])
+			{
+				tick_error(track, channels, tick, NULL);
+				continue;
+			}
+
+			error = tick_error(track, channels, tick, &plan->square_error);
+			if (error > plan->max_error)
+				plan->max_error = error;
+			plan->samples += 3;
+		}
+	}
+}
+
+static unsigned control_write_bytes(unsigned length)
+{
+	unsigned bytes, packet;
+
+	/* SETUP, then the data stage a packet at a time, and a zero-length IN for the status stage */
+	bytes = TOKEN_BYTES + DATA_BYTES(8) + HANDSHAKE_BYTES;
+	for (; length; length -= packet)
+	{
+		packet = (length > EP_0_LEN) ? EP_0_LEN : length;
+		bytes += TOKEN_BYTES + DATA_BYTES(packet) + HANDSHAKE_BYTES;
+	}
+	return bytes + TOKEN_BYTES + DATA_BYTES(0) + HANDSHAKE_BYTES;
+}
+
+static unsigned bulk_out_bytes(unsigned length)
+{
+	unsigned bytes = 0, packet;
+
+	for (; length; length -= packet)
+	{
+		packet = (length > EP_2_OUT_LEN) ? EP_2_OUT_LEN : length;
+		bytes += TOKEN_BYTES + DATA_BYTES(packet) + HANDSHAKE_BYTES;
+	}
+	return bytes;
+}
+
+static uint64_t plan_bytes(const struct plan_struct *plan)
+{
+	return (uint64_t)plan->count * control_write_bytes(REPORT_LEN) + (uint64_t)plan->frame_count * bulk_out_bytes(ADALIGHT_LEN);
+}
+
+static int compare_commands(const void *a, const void *b)
+{
+	const struct command_struct *x = a, *y = b;
+
+	return (x->tick > y->tick) - (x->tick < y->tick);
+}
+
+/* the most commands the plan sends on any one tick; leaves them in the order they are sent */
+static unsigned peak_transfers(struct plan_struct *plan)
+{
+	unsigned index, run, peak = 0;
+
+	/* qsort isn't stable, but commands on the same tick are for different LEDs */
+	qsort(plan->commands, plan->count, sizeof(plan->commands[0]), compare_commands);
+
+	for (index = run = 0; index < plan->count; index++)
+	{
+		run = (index && (plan->commands[index].tick == plan->commands[index - 1].tick)) ? run + 1 : 1;
+		if (run > peak)
+			peak = run;
+	}
+	return peak;
+}
+
+/* the plan as a libblink0 trace: each command a SET_REPORT, and each Adalight frame a "stream" line */
+static void write_plan(FILE *out, struct plan_struct *plan)
+{
+	uint8_t frame[ADALIGHT_LEN] = { 'A', 'd', 'a', 0, LED_COUNT - 1, 0 };
+	const struct command_struct *command;
+	unsigned index, led, track, colour;
+
+	frame[5] = frame[3] ^ frame[4] ^ 0x55;
+
+	for (index = 0; index < plan->count; index++)
+	{
+		command = &plan->commands[index];
+		fprintf(out, "%llu plan set %02x63%02x%02x%02x%02x%02x%02x00\n", (unsigned long long)command->tick * TICK_MS * 1000,
+			REPORT_ID_BLINK1, command->rgb[0], command->rgb[1], command->rgb[2], command->fade_delay >> 8,
+			command->fade_delay & 0xFF, command->ledn);
+	}
+
+	for (index = 0; index < plan->frame_count; index++)
+	{
+		memset(frame + 6, 0, 3 * LED_COUNT);
+		for (track = 0; track < track_count; track++)
+			for (led = 0; led < LED_COUNT; led++)
+				if (!tracks[track].ledn || (tracks[track].ledn == led + 1))
+					for (colour = 0; colour < 3; colour++)
+						frame[6 + 3 * led + colour] = ideal_rounded(&tracks[track], plan->frames[index] + 1, colour);
+
+		fprintf(out, "%llu plan stream ", (unsigned long long)plan->frames[index] * TICK_MS * 1000);
+		for (led = 0; led < sizeof(frame); led++)
+			fprintf(out, "%02x", frame[led]);
+		fprintf(out, "\n");
+	}
+}
+
+static int read_animation(FILE *file)
+{
+	char line[256];
+	unsigned ledn, ms, rgb, index, number = 0;
+	struct track_struct *track;
+
+	while (fgets(line, sizeof(line), file))
+	{
+		number++;
+		line[strcspn(line, "#")] = '\0';
+		if (strspn(line, " \t\r\n") == strlen(line))
+			continue;
+
+		if ((3 != sscanf(line, "%u %u %6x", &ledn, &ms, &rgb)) || (ledn > LED_COUNT))
+		{
+			fprintf(stderr, "line %u: expected <led> <ms> <rrggbb>\n", number);
+			return -1;
+		}
+
+		for (index = 0; index < track_count; index++)
+			if (tracks[index].ledn == ledn)
+				break;
+		if (index == track_count)
+		{
+			tracks[index].ledn = ledn;
+			tracks[index].key_count = 0;
+			track_count++;
+		}
+		track = &tracks[index];
+
+		/* the keyframes fall on ticks (from the second, so there is one ahead of them to start on), in order */
+		if ((MAX_KEYS == track->key_count) || (track->key_count && (1 + (ms + TICK_MS / 2) / TICK_MS <= track->ticks[track->key_count - 1])))
+		{
+			fprintf(stderr, "line %u: keyframes for an LED must be at least a tick apart, in order\n", number);
+			return -1;
+		}
+		track->ticks[track->key_count] = 1 + (ms + TICK_MS / 2) / TICK_MS;
+		track->rgb[track->key_count][0] = rgb >> 16;
+		track->rgb[track->key_count][1] = rgb >> 8;
+		track->rgb[track->key_count][2] = rgb;
+		track->key_count++;
+	}
+
+	if (!track_count)
+	{
+		fprintf(stderr, "no keyframes\n");
+		return -1;
+	}
+
+	/* LED 0 sets every LED, so the LEDs can't also be given their own keyframes */
+	for (index = 0; index < track_count; index++)
+		if (!tracks[index].ledn && (track_count > 1))
+		{
+			fprintf(stderr, "LED 0 is every LED, so it can't be mixed with the others\n");
+			return -1;
+		}
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-e bound] [-b transfers] [-f period] [-s] [-o plan] [animation]\n", name);
+	fprintf(stderr, "  -e  the largest colour error allowed, in LED counts (default 2)\n");
+	fprintf(stderr, "  -b  the most SET_REPORTs the host can make in a 10ms tick (default %u)\n", TRANSFERS_PER_TICK);
+	fprintf(stderr, "  -f  how often, in ticks, the host streams a frame (default 1)\n");
+	fprintf(stderr, "  -s  the firmware has the CDC serial port, so Adalight frames are an option\n");
+	fprintf(stderr, "  -o  write the cheapest plan within both, as a libblink0 trace\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	static struct plan_struct plans[4] =
+	{
+		{ .name = "device" },
+		{ .name = "split" },
+		{ .name = "hid-stream" },
+		{ .name = "cdc-stream", .streamed = true },
+	};
+	struct plan_struct *plan, *best = NULL;
+	const char *output = NULL;
+	unsigned period = 1, index, count;
+	bool cdc = false;
+	FILE *file = stdin;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "e:b:f:so:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'e':
+			bound = atof(optarg);
+			if (bound < 0.0)
+				usage(argv[0]);
+			break;
+		case 'b':
+			transfers_per_tick = strtoul(optarg, NULL, 0);
+			if (!transfers_per_tick)
+				usage(argv[0]);
+			break;
+		case 'f':
+			period = strtoul(optarg, NULL, 0);
+			if (!period)
+				usage(argv[0]);
+			break;
+		case 's':
+			cdc = true;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind + 1 < argc)
+		usage(argv[0]);
+
+	if (optind < argc)
+	{
+		file = fopen(argv[optind], "r");
+		if (!file)
+		{
+			perror(argv[optind]);
+			return 2;
+		}
+	}
+	if (read_animation(file))
+		return 2;
+
+	plan_fades(&plans[0], false);
+	plan_fades(&plans[1], true);
+	plan_stream(&plans[2], period, false);
+	count = 3;
+	if (cdc)
+	{
+		plan_stream(&plans[3], period, true);
+		count = 4;
+	}
+
+	printf("%-12s %9s %10s %9s %10s %9s %9s\n", "", "commands", "transfers", "per tick", "bytes", "max err", "rms err");
+	for (index = 0; index < count; index++)
+	{
+		plan = &plans[index];
+		measure(plan);
+		plan->peak_transfers = peak_transfers(plan);
+		printf("%-12s %9u %10u %9u %10llu %9.2f %9.2f%s%s\n", plan->name, plan->count, plan->count + plan->frame_count,
+			plan->peak_transfers, (unsigned long long)plan_bytes(plan), plan->max_error, sqrt(plan->square_error / plan->samples),
+			(plan->max_error <= bound) ? "" : "  (over the bound)",
+			(plan->peak_transfers <= transfers_per_tick) ? "" : "  (too many a tick)");
+
+		if ((plan->max_error <= bound) && (plan->peak_transfers <= transfers_per_tick)
+			&& (!best || (plan_bytes(plan) < plan_bytes(best))))
+			best = plan;
+	}
+
+	if (!best)
+	{
+		printf("none is within %g at %u transfers a tick\n", bound, transfers_per_tick);
+		return 1;
+	}
+	printf("cheapest within %g at %u transfers a tick: %s\n", bound, transfers_per_tick, best->name);
+
+	if (output)
+	{
+		file = fopen(output, "w");
+		if (!file)
+		{
+			perror(output);
+			return 2;
+		}
+		write_plan(file, best);
+		fclose(file);
+	}
+
+	return 0;
+}
@@ -0,0 +1,670 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+blink0-replay: plays a trace of the feature reports a host sent back into the firmware built for sim/, in the same
+order and with the same timing (or -x times faster), so that a problem seen in the field can be reproduced and measured
+
+the trace is what libblink0 writes with blink0_trace(), one transfer per line:
+
+  <microseconds> <device> set <report in hex> [stall]
+  <microseconds> <device> get <report ID> <length>
+  <microseconds> <device> stream <frame in hex>
+
+(a stream frame is written to the CDC serial port's bulk endpoint, 64 bytes a packet, and needs the firmware built with
+BLINK0_CDC: make SIM_CONFIG=-DBLINK0_CDC); or, with -m, the text usbmon gives (/sys/kernel/debug/usb/usbmon/<bus>u), of which only the HID SET_REPORTs and
+GET_REPORTs of feature reports are taken, the device being <bus>:<address>; -d picks out one device (by default, the
+first one in the trace)
+
+every 'c' and 'n' command is followed through the WS281x frames the firmware sends:
+
+  latency     from the SET_REPORT to the first frame in which its LEDs show it: at their new colour, or on their way
+              there (every colour that still has some way to go having moved closer, and none further away)
+  fade_late   for a fade, how much later than asked for its LEDs reached their new colour
+  inflight    at each command, how many (it included) had yet to show; a command scheduled with '@' waits its turn
+              here too
+  superseded  a newer command showed on all of its LEDs before it did (or before it finished fading)
+
+as well as the stream frames sent (and those the firmware wouldn't take), the SET_REPORTs the firmware stalled (and how many of those differ from what the trace says happened), the
+drop and overflow flags of the status reports the trace itself read (and of the input reports), and WS281x frames that
+went out broken (a byte that is neither a '0' nor a '1', or a frame cut short); in the simulation the main loop and
+isr() take no time, so such frames come from the firmware's logic and not its timing (blink0-cycles, on the
+instruction-level simulator, is the one for that)
+
+the results are printed as a JSON object, and can be checked against an earlier run with -c, as blink0-cycles does;
+-l writes the LED timeline, as blink0-sim prints it, and -v each command's latency to stderr
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "metrics.h"
+
+/* these mirror blink0.h in the firmware */
+#define LED_COUNT          18
+#define REPORT_ID_BLINK1   0x01
+#define REPORT_ID_STATUS   0x02
+#define STATUS_LEN         9
+#define STATUS_FLAGS       2
+#define STATUS_FLAG_DROPPED   0x01
+#define STATUS_FLAG_OVERFLOW  0x02
+#define MAX_REPORT         64
+#define STREAM_EP          2
+#define STREAM_PACKET      64
+
+/* the longest stream frame a trace line has room for */
+#define MAX_STREAM         192
+
+/* HID class requests, as usbmon shows them */
+#define HID_GET_REPORT     0x01
+#define HID_SET_REPORT     0x09
+#define HID_FEATURE        3
+
+struct entry_struct
+{
+	uint64_t us;
+	bool set, stalled, stream;
+	uint8_t report[MAX_STREAM];  /* a feature report, or a stream frame */
+	unsigned length;
+	uint64_t tag; /* usbmon's URB tag, to find its completion */
+};
+
+enum command_state { PENDING, SHOWN, DONE, SUPERSEDED };
+
+struct command_struct
+{
+	uint64_t sent;   /* simulated cycle of the SET_REPORT */
+	uint8_t rgb[3];
+	uint8_t ledn;
+	uint16_t fade_delay;
+	uint32_t leds;   /* the LEDs still to be accounted for, one bit each */
+	bool scheduled;
+	enum command_state state;
+};
+
+static struct entry_struct *entries;
+static unsigned entry_count, entry_size;
+
+static struct command_struct *commands;
+static unsigned command_count;
+
+/* the commands that are PENDING or SHOWN, oldest first */
+static unsigned *active;
+static unsigned active_count;
+
+/* what the LEDs showed in the last frame, and the one before (red, green, blue) */
+static uint8_t shown[LED_COUNT][3], previous[LED_COUNT][3];
+
+static struct samples_struct latency, fade_late, inflight;
+static unsigned frames, bad_frames, short_frames, superseded, scheduled;
+static unsigned stalls, diverged, dropped, overflowed;
+static unsigned streamed, stream_failed;
+
+static FILE *timeline;
+static bool verbose;
+
+static double ms_of(uint64_t cycles)
+{
+	return (double)cycles / SIM_CYCLES_PER_MS;
+}
+
+static struct entry_struct *new_entry(void)
+{
+	struct entry_struct *grown;
+
+	if (entry_count == entry_size)
+	{
+		entry_size = entry_size ? 2 * entry_size : 1024;
+		grown = realloc(entries, entry_size * sizeof(*grown));
+		if (!grown)
+		{
+			perror("realloc");
+			exit(2);
+		}
+		entries = grown;
+	}
+
+	memset(&entries[entry_count], 0, sizeof(entries[0]));
+	return &entries[entry_count++];
+}
+
+static unsigned parse_hex(const char *text, uint8_t *bytes, unsigned max)
+{
+	unsigned length = 0, byte;
+
+	while ((length < max) && (1 == sscanf(text, "%2x", &byte)))
+	{
+		bytes[length++] = byte;
+		text += 2;
+	}
+	return length;
+}
+
+/* a trace from libblink0 */
+static void read_trace(FILE *file, char *device)
+{
+	char line[512], name[256], what[8], rest[400];
+	unsigned long long us;
+	unsigned id, length;
+	struct entry_struct *entry;
+
+	while (fgets(line, sizeof(line), file))
+	{
+		rest[0] = '\0';
+		if (4 > sscanf(line, "%llu %255s %7s %399[^\n]", &us, name, what, rest))
+			continue;
+		if (!device[0])
+			snprintf(device, 256, "%s", name);
+		if (strcmp(device, name))
+			continue;
+
+		if (!strcmp(what, "set"))
+		{
+			entry = new_entry();
+			entry->us = us;
+			entry->set = true;
+			entry->length = parse_hex(rest, entry->report, MAX_REPORT);
+			entry->stalled = (NULL != strstr(rest, "stall"));
+		}
+		else if (!strcmp(what, "stream"))
+		{
+			entry = new_entry();
+			entry->us = us;
+			entry->stream = true;
+			entry->length = parse_hex(rest, entry->report, MAX_STREAM);
+		}
+		else if (!strcmp(what, "get") && (2 == sscanf(rest, "%u %u", &id, &length)))
+		{
+			entry = new_entry();
+			entry->us = us;
+			entry->report[0] = id;
+			entry->length = (length > MAX_REPORT) ? MAX_REPORT : length;
+		}
+	}
+}
+
+/*
+usbmon's text, e.g. a SET_REPORT and its completion:
+  ffff8c2a 3575914555 S Co:1:003:0 s 21 09 0301 0000 0009 9 = 01630000 00000000 00
+  ffff8c2a 3575916602 C Co:1:003:0 0 9 >
+*/
+static void read_usbmon(FILE *file, char *device)
+{
+	char line[512], type[4], address[32], name[32], *data;
+	unsigned long long tag, us;
+	unsigned request_type, request, value, index, length, bus, number, endpoint;
+	int status, offset;
+	struct entry_struct *entry;
+
+	while (fgets(line, sizeof(line), file))
+	{
+		if (4 != sscanf(line, "%llx %llu %3s %31s%n", &tag, &us, type, address, &offset))
+			continue;
+		if ((3 != sscanf(address + 3, "%u:%u:%u", &bus, &number, &endpoint)) || (0 != endpoint) || strncmp(address, "C", 1))
+			continue;
+		snprintf(name, sizeof(name), "%u:%03u", bus, number);
+
+		/* a SET_REPORT the device STALLed completes with -EPIPE */
+		if (!strcmp(type, "C"))
+		{
+			if ((1 == sscanf(line + offset, "%d", &status)) && (-32 == status))
+				for (index = entry_count; index-- > 0;)
+					if (entries[index].tag == tag)
+					{
+						entries[index].stalled = true;
+						break;
+					}
+			continue;
+		}
+
+		if (strcmp(type, "S") || (5 != sscanf(line + offset, " s %x %x %x %x %x", &request_type, &request, &value, &index, &length)))
+			continue;
+		if (HID_FEATURE != (value >> 8))
+			continue;
+		if (!device[0])
+			snprintf(device, 256, "%s", name);
+		if (strcmp(device, name))
+			continue;
+
+		if ((0x21 == request_type) && (HID_SET_REPORT == request))
+		{
+			entry = new_entry();
+			entry->us = us;
+			entry->tag = tag;
+			entry->set = true;
+
+			/* the data follows the '=', in words of up to four bytes */
+			data = strchr(line + offset, '=');
+			for (data = data ? strtok(data + 1, " \n") : NULL; data && (entry->length < MAX_REPORT); data = strtok(NULL, " \n"))
+				entry->length += parse_hex(data, entry->report + entry->length, MAX_REPORT - entry->length);
+
+			/* usbmon only keeps the first so many bytes; the rest were zero as far as anyone knows */
+			if (entry->length < length)
+				entry->length = (length > MAX_REPORT) ? MAX_REPORT : length;
+		}
+		else if ((0xA1 == request_type) && (HID_GET_REPORT == request))
+		{
+			entry = new_entry();
+			entry->us = us;
+			entry->tag = tag;
+			entry->report[0] = value & 0xFF;
+			entry->length = (length > MAX_REPORT) ? MAX_REPORT : length;
+		}
+	}
+}
+
+static void take_status(const uint8_t *status, int length)
+{
+	if ((length < STATUS_LEN) || (REPORT_ID_STATUS != status[0]))
+		return;
+	if (status[STATUS_FLAGS] & STATUS_FLAG_DROPPED)
+		dropped++;
+	if (status[STATUS_FLAGS] & STATUS_FLAG_OVERFLOW)
+		overflowed++;
+}
+
+static void print_command(const struct command_struct *command, const char *outcome)
+{
+	if (verbose)
+		fprintf(stderr, "%.1f: %s%u %02x%02x%02x %u: %s\n", ms_of(command->sent), command->scheduled ? "@" : "",
+			command->ledn, command->rgb[0], command->rgb[1], command->rgb[2], command->fade_delay * 10, outcome);
+}
+
+/* every LED of the command at its new colour (or, with started, at least on its way there) */
+static bool showing(const struct command_struct *command, bool started)
+{
+	unsigned led, colour, was, now;
+	bool closer, further, reached = true, moving = true;
+
+	for (led = 0; led < LED_COUNT; led++)
+	{
+		if (!(command->leds & (1UL << led)))
+			continue;
+
+		closer = further = false;
+		for (colour = 0; colour < 3; colour++)
+		{
+			was = abs(previous[led][colour] - command->rgb[colour]);
+			now = abs(shown[led][colour] - command->rgb[colour]);
+			closer |= now < was;
+			further |= now > was;
+		}
+
+		if (memcmp(shown[led], command->rgb, 3))
+		{
+			reached = false;
+			if (!closer || further)
+				moving = false;
+		}
+	}
+
+	return reached || (started && moving);
+}
+
+/* a command has shown on its LEDs, so older ones still to show there never will */
+static void supersede(unsigned newest, unsigned position)
+{
+	struct command_struct *command;
+	unsigned index;
+
+	for (index = 0; index < position; index++)
+	{
+		command = &commands[active[index]];
+		if ((SUPERSEDED == command->state) || (DONE == command->state))
+			continue;
+
+		command->leds &= ~commands[newest].leds;
+		if (!command->leds)
+		{
+			command->state = SUPERSEDED;
+			superseded++;
+			print_command(command, "superseded");
+		}
+	}
+}
+
+static void frame_hook(const uint8_t *grb, unsigned length, bool bad)
+{
+	static uint8_t last[LED_COUNT][3];
+	struct command_struct *command;
+	uint64_t now = sim_cycles();
+	unsigned led, index, kept;
+	char outcome[64];
+
+	frames++;
+	if (bad)
+		bad_frames++;
+	if (length < 3 * LED_COUNT)
+		short_frames++;
+
+	memcpy(previous, shown, sizeof(shown));
+	for (led = 0; (led < LED_COUNT) && (3 * led + 3 <= length); led++)
+	{
+		shown[led][0] = grb[3 * led + 1];
+		shown[led][1] = grb[3 * led + 0];
+		shown[led][2] = grb[3 * led + 2];
+	}
+
+	if (timeline && (memcmp(shown, last, sizeof(shown)) || bad))
+	{
+		fprintf(timeline, "%llu: frame%s:", (unsigned long long)(now / SIM_CYCLES_PER_MS), bad ? " (bad)" : "");
+		for (led = 0; led < LED_COUNT; led++)
+			fprintf(timeline, " %02x%02x%02x", shown[led][0], shown[led][1], shown[led][2]);
+		fprintf(timeline, "\n");
+		memcpy(last, shown, sizeof(shown));
+	}
+
+	/* newest first, as a command that shows takes its LEDs from any older one */
+	for (index = active_count; index-- > 0;)
+	{
+		command = &commands[active[index]];
+
+		if ((PENDING == command->state) && showing(command, true))
+		{
+			samples_add(&latency, ms_of(now - command->sent));
+			command->state = SHOWN;
+			supersede(active[index], index);
+			snprintf(outcome, sizeof(outcome), "shown after %.1fms", ms_of(now - command->sent));
+			print_command(command, outcome);
+		}
+
+		if ((SHOWN == command->state) && showing(command, false))
+		{
+			command->state = DONE;
+			if (command->fade_delay)
+			{
+				samples_add(&fade_late, ms_of(now - command->sent) - command->fade_delay * 10.0);
+				snprintf(outcome, sizeof(outcome), "faded in %.1fms", ms_of(now - command->sent));
+				print_command(command, outcome);
+			}
+		}
+	}
+
+	for (index = kept = 0; index < active_count; index++)
+		if ((PENDING == commands[active[index]].state) || (SHOWN == commands[active[index]].state))
+			active[kept++] = active[index];
+	active_count = kept;
+}
+
+static void new_command(const uint8_t *report, bool is_scheduled)
+{
+	struct command_struct *command = &commands[command_count];
+	unsigned index, waiting = 0;
+	uint8_t ledn = report[7];
+
+	if (ledn > LED_COUNT)
+		ledn = 0;
+
+	command->sent = sim_cycles();
+	memcpy(command->rgb, report + 2, 3);
+	command->fade_delay = (report[5] << 8) | report[6];
+	command->ledn = ledn;
+	command->leds = ledn ? (1UL << (ledn - 1)) : ((1UL << LED_COUNT) - 1);
+	command->scheduled = is_scheduled;
+	command->state = PENDING;
+	if (is_scheduled)
+		scheduled++;
+
+	active[active_count++] = command_count++;
+
+	for (index = 0; index < active_count; index++)
+		if (PENDING == commands[active[index]].state)
+			waiting++;
+	samples_add(&inflight, waiting);
+}
+
+static void run_ms(void)
+{
+	uint8_t report[MAX_REPORT];
+	int length;
+
+	sim_run(1);
+
+	/* the input reports the host would have been reading all along */
+	while ((length = sim_in(1, report, sizeof(report))) >= 0)
+		take_status(report, length);
+}
+
+static void replay(double speed, unsigned settle_ms)
+{
+	struct entry_struct *entry;
+	uint8_t report[MAX_REPORT];
+	uint64_t start = sim_cycles(), due;
+	unsigned index, offset, chunk;
+	bool armed = false;
+	int result;
+
+	for (index = 0; index < entry_count; index++)
+	{
+		entry = &entries[index];
+
+		/* let the time pass that passed on the host (USB only moves a millisecond at a time anyway) */
+		due = start + (uint64_t)((entry->us - entries[0].us) / speed * SIM_CYCLES_PER_MS / 1000.0);
+		while (sim_cycles() + SIM_CYCLES_PER_MS <= due)
+			run_ms();
+
+		if (entry->stream)
+		{
+			for (offset = 0; offset < entry->length; offset += chunk)
+			{
+				chunk = ((entry->length - offset) > STREAM_PACKET) ? STREAM_PACKET : (entry->length - offset);
+				if (sim_out(STREAM_EP, entry->report + offset, chunk) < 0)
+					break;
+			}
+			if (offset < entry->length)
+				stream_failed++;
+			else
+				streamed++;
+			continue;
+		}
+
+		if (!entry->set)
+		{
+			result = sim_get_report(entry->report[0], report, entry->length);
+			take_status(report, result);
+			continue;
+		}
+
+		result = sim_set_report(entry->report, entry->length);
+		if (SIM_STALL == result)
+			stalls++;
+		if ((SIM_STALL == result) != entry->stalled)
+			diverged++;
+		if ((result < 0) || (REPORT_ID_BLINK1 != entry->report[0]) || (entry->length < 8))
+			continue;
+
+		if (('c' == entry->report[1]) || ('n' == entry->report[1]))
+		{
+			new_command(entry->report, armed);
+			armed = false;
+		}
+		else if ('@' == entry->report[1])
+			armed = true;
+	}
+
+	/* then long enough for the last commands to show, and the last fades to finish */
+	for (index = 0; (index < settle_ms) || active_count; index++)
+	{
+		if (index >= settle_ms + 65535 * 10)
+			break;
+		run_ms();
+	}
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-m] [-d device] [-x speed] [-s settle_ms] [-l timeline] [-v] [-c baseline [-t tolerance]] [trace]\n", name);
+	fprintf(stderr, "  -m  the trace is usbmon's text, rather than libblink0's\n");
+	fprintf(stderr, "  -d  the device to replay (a path in libblink0's traces, bus:address in usbmon's; default the first)\n");
+	fprintf(stderr, "  -x  how many times faster than it was recorded to play it back (default 1)\n");
+	fprintf(stderr, "  -s  how long to carry on after the last transfer, at the least (default 1000ms)\n");
+	fprintf(stderr, "  -l  write what the LEDs showed, every time it changed, to a file\n");
+	fprintf(stderr, "  -v  print each command's latency (and whether it was superseded) to stderr\n");
+	fprintf(stderr, "  -c  compare against the output of an earlier run, and fail if anything went up\n");
+	fprintf(stderr, "  -t  how far, in percent, a metric may go up before it counts (default 0)\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	char device[256] = "";
+	const char *baseline = NULL;
+	double speed = 1.0, tolerance = 0.0;
+	unsigned settle_ms = 1000, index, sets = 0;
+	bool usbmon = false;
+	FILE *file = stdin;
+	int opt, regressions = 0;
+
+	while ((opt = getopt(argc, argv, "md:x:s:l:vc:t:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'm':
+			usbmon = true;
+			break;
+		case 'd':
+			snprintf(device, sizeof(device), "%s", optarg);
+			break;
+		case 'x':
+			speed = atof(optarg);
+			if (speed <= 0.0)
+				usage(argv[0]);
+			break;
+		case 's':
+			settle_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			timeline = fopen(optarg, "w");
+			if (!timeline)
+			{
+				perror(optarg);
+				return 2;
+			}
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		case 'c':
+			baseline = optarg;
+			break;
+		case 't':
+			tolerance = atof(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind + 1 < argc)
+		usage(argv[0]);
+
+	if (optind < argc)
+	{
+		file = fopen(argv[optind], "r");
+		if (!file)
+		{
+			perror(argv[optind]);
+			return 2;
+		}
+	}
+
+	if (usbmon)
+		read_usbmon(file, device);
+	else
+		read_trace(file, device);
+	if (!entry_count)
+	{
+		fprintf(stderr, "nothing to replay\n");
+		return 2;
+	}
+
+	for (index = 0; index < entry_count; index++)
+		sets += entries[index].set;
+	commands = calloc(sets, sizeof(*commands));
+	active = calloc(sets, sizeof(*active));
+	if (!commands || !active)
+	{
+		perror("calloc");
+		return 2;
+	}
+
+	sim_frame_hook = frame_hook;
+	sim_init();
+	if (sim_enumerate())
+	{
+		fprintf(stderr, "the firmware didn't enumerate\n");
+		return 2;
+	}
+
+	replay(speed, settle_ms);
+	if (stream_failed && !streamed)
+		fprintf(stderr, "no stream frame got through: the firmware needs BLINK0_CDC (make SIM_CONFIG=-DBLINK0_CDC)\n");
+
+	for (index = 0; index < active_count; index++)
+		print_command(&commands[active[index]], (PENDING == commands[active[index]].state) ? "never shown" : "never finished fading");
+
+	metric("trace.transfers", entry_count);
+	metric("trace.set_reports", sets);
+	metric("trace.duration_ms", (entries[entry_count - 1].us - entries[0].us) / 1000.0 / speed);
+	metric("trace.stream_frames", streamed + stream_failed);
+	metric("replay.stalls", stalls);
+	metric("replay.stream_failed", stream_failed);
+	metric("replay.diverged", diverged);
+	metric("status.dropped", dropped);
+	metric("status.overflow", overflowed);
+	metric("commands.count", command_count);
+	metric("commands.scheduled", scheduled);
+	metric("commands.superseded", superseded);
+	metric("commands.never_shown", active_count);
+	samples_metrics("latency_ms", &latency);
+	samples_metrics("fade_late_ms", &fade_late);
+	samples_metrics("inflight", &inflight);
+	metric("ws.frames", frames);
+	metric("ws.bad_frames", bad_frames);
+	metric("ws.short_frames", short_frames);
+	print_metrics(stdout);
+
+	if (timeline)
+		fclose(timeline);
+
+	if (baseline)
+	{
+		regressions = compare_metrics(baseline, tolerance);
+		if (regressions < 0)
+			return 2;
+	}
+
+	return regressions ? 1 : 0;
+}
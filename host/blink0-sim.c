@@ -0,0 +1,286 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+blink0-sim: runs the real firmware (main.c and the USB stack) on a PC against a simulated PIC16F1454 (see sim/sim.c)
+
+a script, one command per line, plays the part of the host; every WS281x frame that differs from the one before is printed
+with the millisecond it went out, as red, green and blue for each LED
+
+  enumerate                  reset the bus, set the address and select the configuration
+  reset                      reset the bus
+  set <byte>...              SET_REPORT of a feature report (the first byte is the report ID), in hex
+  get <id> <length>          GET_REPORT of a feature report, printed in hex
+  out <ep> <byte>...         bulk OUT transactions of up to 64 bytes each, in hex
+  in <ep>                    one IN transaction, printed in hex (or NAK/STALL)
+  run <ms>                   let that many milliseconds pass
+  suspend <ms>               suspend the bus for that many milliseconds, then resume it; prints how many of those
+                             milliseconds the core was awake, and how soon after the resume the next frame went out
+
+anything after a '#' is a comment
+
+at the end, the count of frames (and bad ones) is printed, with how many times the device NAKed the host's control transfers and OUTs
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+static uint8_t last_frame[1024];
+static unsigned last_length, frames, bad_frames;
+static int all_frames;
+
+static void frame_hook(const uint8_t *grb, unsigned length, bool bad)
+{
+	unsigned index;
+
+	frames++;
+	if (bad)
+		bad_frames++;
+
+	if (!all_frames && !bad && (length == last_length) && !memcmp(grb, last_frame, length))
+		return;
+
+	memcpy(last_frame, grb, length);
+	last_length = length;
+
+	printf("%llu: frame%s:", (unsigned long long)(sim_cycles() / SIM_CYCLES_PER_MS), bad ? " (bad)" : "");
+	for (index = 0; index + 3 <= length; index += 3)
+		printf(" %02x%02x%02x", grb[index + 1], grb[index], grb[index + 2]);
+	printf("\n");
+}
+
+static void print_result(const char *what, int result, const uint8_t *buf)
+{
+	int index;
+
+	printf("%llu: %s:", (unsigned long long)(sim_cycles() / SIM_CYCLES_PER_MS), what);
+	if (SIM_NAK == result)
+		printf(" NAK");
+	else if (SIM_STALL == result)
+		printf(" STALL");
+	else if (SIM_TIMEOUT == result)
+		printf(" timeout");
+	else
+		for (index = 0; index < result; index++)
+			printf(" %02x", buf[index]);
+	printf("\n");
+}
+
+static int run_line(char *line)
+{
+	char *cmd, *arg;
+	uint8_t buf[256];
+	unsigned length = 0, value, offset, chunk, ms, awake, before;
+	int result = 0;
+
+	cmd = strtok(line, " \t\r\n");
+	if (!cmd)
+		return 0;
+
+	if (!strcmp(cmd, "enumerate"))
+	{
+		result = sim_enumerate();
+		if (result)
+			printf("enumeration failed\n");
+	}
+	else if (!strcmp(cmd, "reset"))
+	{
+		sim_bus_reset();
+	}
+	else if (!strcmp(cmd, "set"))
+	{
+		while ((arg = strtok(NULL, " \t\r\n")) && (length < sizeof(buf)))
+			buf[length++] = strtoul(arg, NULL, 16);
+		if (!length)
+			return -1;
+		result = sim_set_report(buf, length);
+		if (result < 0)
+			print_result("set", result, buf);
+	}
+	else if (!strcmp(cmd, "get"))
+	{
+		arg = strtok(NULL, " \t\r\n");
+		if (!arg)
+			return -1;
+		value = strtoul(arg, NULL, 0);
+		arg = strtok(NULL, " \t\r\n");
+		length = arg ? strtoul(arg, NULL, 0) : 9;
+		if (length > sizeof(buf))
+			length = sizeof(buf);
+		result = sim_get_report(value, buf, length);
+		print_result("get", result, buf);
+	}
+	else if (!strcmp(cmd, "out"))
+	{
+		arg = strtok(NULL, " \t\r\n");
+		if (!arg)
+			return -1;
+		value = strtoul(arg, NULL, 0);
+		while ((arg = strtok(NULL, " \t\r\n")) && (length < sizeof(buf)))
+			buf[length++] = strtoul(arg, NULL, 16);
+		if (!length)
+			return -1;
+
+		/* bulk OUT, in as many 64-byte packets as it takes */
+		for (offset = 0; offset < length; offset += chunk)
+		{
+			chunk = ((length - offset) > 64) ? 64 : (length - offset);
+			result = sim_out(value, buf + offset, chunk);
+			if (result < 0)
+			{
+				print_result("out", result, buf);
+				break;
+			}
+		}
+	}
+	else if (!strcmp(cmd, "in"))
+	{
+		arg = strtok(NULL, " \t\r\n");
+		result = sim_in(arg ? strtoul(arg, NULL, 0) : 1, buf, 64);
+		print_result("in", result, buf);
+		if (result >= 0)
+			sim_step();
+	}
+	else if (!strcmp(cmd, "run"))
+	{
+		arg = strtok(NULL, " \t\r\n");
+		sim_run(arg ? strtoul(arg, NULL, 0) : 1);
+	}
+	else if (!strcmp(cmd, "suspend"))
+	{
+		arg = strtok(NULL, " \t\r\n");
+		value = arg ? strtoul(arg, NULL, 0) : 10;
+
+		/* how long the core stays awake once the bus has gone quiet; each millisecond awake costs the suspend current budget */
+		sim_suspend(true);
+		for (ms = awake = 0; ms < value; ms++)
+		{
+			sim_run(1);
+			if (!sim_asleep())
+				awake++;
+		}
+		printf("%llu: %s, awake for %u of %u ms suspended\n", (unsigned long long)(sim_cycles() / SIM_CYCLES_PER_MS),
+			sim_asleep() ? "asleep" : "awake", awake, value);
+
+		/* and how long after the resume the strip shows its colours again */
+		before = frames;
+		sim_suspend(false);
+		for (ms = 0; (frames == before) && (ms < 100); ms++)
+			sim_run(1);
+		printf("%llu: resumed, first frame within %u ms\n", (unsigned long long)(sim_cycles() / SIM_CYCLES_PER_MS), ms);
+	}
+	else
+	{
+		return -1;
+	}
+
+	if (sim_watchdog_enabled())
+	{
+		printf("%llu: watchdog enabled; the PIC would now reset into the bootloader\n", (unsigned long long)(sim_cycles() / SIM_CYCLES_PER_MS));
+		return 1;
+	}
+
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-a] [-b transactions] [script]\n", name);
+	fprintf(stderr, "  -a         print every frame, not only those that differ from the one before\n");
+	fprintf(stderr, "  -b         transactions the host gets onto the bus each time the firmware goes around its main loop (default 1)\n");
+	fprintf(stderr, "the script is read from standard input if no file is given\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, result;
+	unsigned line_number = 0;
+	char line[1024], *comment;
+	FILE *fp = stdin;
+
+	while ((opt = getopt(argc, argv, "ab:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'a':
+			all_frames = 1;
+			break;
+		case 'b':
+			sim_bus_transactions = strtoul(optarg, NULL, 0);
+			if (!sim_bus_transactions)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind < argc)
+	{
+		fp = fopen(argv[optind], "r");
+		if (!fp)
+		{
+			perror(argv[optind]);
+			return 2;
+		}
+	}
+
+	sim_frame_hook = frame_hook;
+	sim_init();
+
+	while (fgets(line, sizeof(line), fp))
+	{
+		line_number++;
+
+		comment = strchr(line, '#');
+		if (comment)
+			*comment = '\0';
+
+		result = run_line(line);
+		if (result < 0)
+		{
+			fprintf(stderr, "line %u: not understood\n", line_number);
+			return 2;
+		}
+		if (result > 0)
+			break;
+	}
+
+	printf("frames %u bad %u naks %lu\n", frames, bad_frames, sim_naks());
+
+	return bad_frames ? 1 : 0;
+}
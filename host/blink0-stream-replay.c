@@ -0,0 +1,142 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+blink0-stream-replay: feeds captured Adalight/TPM2 streams through the firmware's own stream parser (firmware/stream.c)
+
+captures are the raw bytes ambient lighting software wrote to the serial port; they are fed to the parser in
+USB-sized chunks, and every frame the firmware would show is printed, along with the parser's counters
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stream.h"
+
+#define MAX_LEDS 256
+
+static uint8_t frame[MAX_LEDS][3];
+static unsigned frame_leds, frame_number;
+static int quiet;
+
+/* the firmware gathers the LEDs in the same way, but only keeps as many as the strip has */
+void stream_led(uint8_t index, uint8_t r, uint8_t g, uint8_t b)
+{
+	frame[index - 1][0] = r;
+	frame[index - 1][1] = g;
+	frame[index - 1][2] = b;
+	frame_leds = index;
+}
+
+void stream_frame(void)
+{
+	unsigned index;
+
+	frame_number++;
+	if (!quiet)
+	{
+		printf("frame %u: %u LEDs:", frame_number, frame_leds);
+		for (index = 0; index < frame_leds; index++)
+			printf(" %02x%02x%02x", frame[index][0], frame[index][1], frame[index][2]);
+		printf("\n");
+	}
+	frame_leds = 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-c chunk] [-s chunks] [-q] capture...\n", name);
+	fprintf(stderr, "  -c chunk   bytes handed to the parser at a time (default 64, one full-speed bulk packet)\n");
+	fprintf(stderr, "  -s chunks  advance the 10ms tick after every so many chunks (default 0, never)\n");
+	fprintf(stderr, "  -q         only print the counters\n");
+	fprintf(stderr, "a tick is always advanced twice between captures, so a frame cut short at the end of one is abandoned\n");
+	fprintf(stderr, "exits with status 1 if the parser counted any errors\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, arg;
+	unsigned chunk = 64, chunks_per_tick = 0, chunks = 0;
+	uint8_t buf[255];
+	size_t len;
+	FILE *fp;
+
+	while ((opt = getopt(argc, argv, "c:s:q")) != -1)
+	{
+		switch (opt)
+		{
+		case 'c':
+			chunk = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			chunks_per_tick = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if ((optind >= argc) || (chunk < 1) || (chunk > sizeof(buf)))
+		usage(argv[0]);
+
+	for (arg = optind; arg < argc; arg++)
+	{
+		fp = fopen(argv[arg], "rb");
+		if (!fp)
+		{
+			perror(argv[arg]);
+			return 2;
+		}
+
+		while ((len = fread(buf, 1, chunk, fp)) > 0)
+		{
+			stream_parse(buf, len);
+			if (chunks_per_tick && (0 == (++chunks % chunks_per_tick)))
+				stream_tick();
+		}
+
+		fclose(fp);
+
+		stream_tick();
+		stream_tick();
+	}
+
+	printf("frames %u errors %u skipped %u\n", stream_counters.frames, stream_counters.errors, stream_counters.skipped);
+
+	return stream_counters.errors ? 1 : 0;
+}
@@ -0,0 +1,456 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+blink0-ws281x: rebuilds the WS281x waveform from a trace of SSP1BUF writes and checks it against the parts' timing
+
+the trace comes from blink0-cycles -w; the SPI clock is Fosc/4, so each byte written to SSP1BUF puts its eight bits
+on the line one instruction cycle (83.3ns) apiece, most significant first; in between bytes, the line is either low
+or (with -l hold) stays at the level of the last bit sent
+
+every high pulse is a bit, decoded by its length; each is checked against the high time windows of the part,
+and each bit period (rising edge to rising edge) against the part's; a low long enough that the part might take it
+as a reset ends a frame, and one that is not long enough to be certain of it is an error; a bit period that is too
+long, but not that long, is flagged as a gap, which is what a late isr() looks like on the line
+
+the decoded GRB bytes are compared with leds[] as it was when the frame was kicked off, and as it was when the next
+one was; the main loop fades leds[] while the ISR is sending it, so each byte should match one or the other
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define LED_COUNT   18
+#define FRAME_BYTES (3 * LED_COUNT)
+
+/* instruction cycles per microsecond; this is also the SPI bit rate */
+#define CYCLES_PER_US 12
+
+/* how many of each sort of problem are described, unless -v */
+#define REPORT_LIMIT 10
+
+/* the timing of each part, in ns, from its datasheet */
+struct part_struct
+{
+	const char *name;
+	unsigned t0h_min, t0h_max;
+	unsigned t1h_min, t1h_max;
+	unsigned period_min, period_max;
+	unsigned idle_max;  /* the longest low that is certainly not taken for a reset */
+	unsigned reset_min; /* the shortest low that is certain to be */
+};
+
+static const struct part_struct parts[] =
+{
+	/* WS2811 in its 800kHz mode */
+	{ "WS2811",  100, 400, 450, 750, 650, 1850, 5000, 50000 },
+	/* the V5 WS2812B wants 280us of reset, where older ones wanted 50us */
+	{ "WS2812B", 250, 550, 650, 950, 650, 1850, 5000, 280000 },
+	{ "SK6812",  150, 450, 450, 750, 650, 1850, 5000, 80000 },
+};
+
+struct write_struct
+{
+	uint64_t cycle;
+	uint8_t value;
+};
+
+struct snapshot_struct
+{
+	uint64_t cycle;
+	uint8_t leds[FRAME_BYTES];
+};
+
+static struct write_struct *writes;
+static unsigned write_count;
+static struct snapshot_struct *snapshots;
+static unsigned snapshot_count;
+
+static bool hold, verbose;
+
+/* the state of the checks for one part */
+static const struct part_struct *part;
+static unsigned errors, gaps, reported_errors, reported_gaps;
+static unsigned frames, bits, mismatches, updated;
+static uint64_t high0_min, high0_max, high1_min, high1_max, period_min, period_max, gap_max;
+static uint64_t gap_max_cycle;
+
+/* the frame being decoded */
+static bool in_frame;
+static uint64_t frame_start;
+static uint8_t frame[FRAME_BYTES + 1];
+static unsigned frame_bits;
+
+/* the line, and the bit in progress */
+static int level;
+static uint64_t level_since, rise;
+static bool bit_pending;
+
+static double ns(uint64_t cycles)
+{
+	return cycles * 1000.0 / CYCLES_PER_US;
+}
+
+static void error(uint64_t cycle, const char *format, ...)
+{
+	va_list args;
+
+	errors++;
+	if (!verbose && (reported_errors++ >= REPORT_LIMIT))
+		return;
+
+	printf("  %s: cycle %llu (frame %u, bit %u): ", part->name, (unsigned long long)cycle, frames, frame_bits);
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	printf("\n");
+}
+
+static void range(uint64_t *min, uint64_t *max, uint64_t value)
+{
+	if (!*max || (value < *min))
+		*min = value;
+	if (value > *max)
+		*max = value;
+}
+
+static void high_pulse(uint64_t start, uint64_t length)
+{
+	double width = ns(length);
+	bool one;
+
+	/* anything between the two windows is decoded as whichever it is nearer to */
+	one = (2 * width) > (part->t0h_max + part->t1h_min);
+
+	if (one)
+	{
+		range(&high1_min, &high1_max, length);
+		if ((width < part->t1h_min) || (width > part->t1h_max))
+			error(start, "'1' high for %.0fns", width);
+	}
+	else
+	{
+		range(&high0_min, &high0_max, length);
+		if ((width < part->t0h_min) || (width > part->t0h_max))
+			error(start, "'0' high for %.0fns", width);
+	}
+
+	if (frame_bits < 8 * sizeof(frame))
+		frame[frame_bits / 8] = (frame[frame_bits / 8] << 1) | one;
+	frame_bits++;
+	bits++;
+}
+
+/* the last snapshot of leds[] taken at or before a cycle; frames come in order, so the search carries on from the last one */
+static unsigned next_snapshot;
+
+static const struct snapshot_struct *snapshot_before(uint64_t cycle)
+{
+	while ((next_snapshot < snapshot_count) && (snapshots[next_snapshot].cycle <= cycle))
+		next_snapshot++;
+
+	return next_snapshot ? &snapshots[next_snapshot - 1] : NULL;
+}
+
+static void end_frame(void)
+{
+	const struct snapshot_struct *before, *after;
+	unsigned index;
+
+	if (!in_frame)
+		return;
+	in_frame = false;
+
+	if (frame_bits != 8 * FRAME_BYTES)
+		error(frame_start, "frame of %u bits", frame_bits);
+
+	/* leds[] at this frame's kick-off, and at the next one's */
+	before = snapshot_before(frame_start);
+	if (before && (frame_bits == 8 * FRAME_BYTES))
+	{
+		after = ((before + 1) < (snapshots + snapshot_count)) ? (before + 1) : NULL;
+
+		for (index = 0; index < FRAME_BYTES; index++)
+		{
+			if (frame[index] == before->leds[index])
+				continue;
+			if (after && (frame[index] == after->leds[index]))
+			{
+				updated++;
+				continue;
+			}
+
+			mismatches++;
+			if (verbose || (reported_errors++ < REPORT_LIMIT))
+				printf("  %s: frame %u at cycle %llu: LED %u byte %u sent as %02x, but leds[] held %02x\n", part->name, frames,
+					(unsigned long long)frame_start, index / 3 + 1, index % 3, frame[index], before->leds[index]);
+		}
+	}
+
+	frames++;
+}
+
+/* the line changes to the given level at the given cycle */
+static void line(int new_level, uint64_t cycle)
+{
+	uint64_t length;
+
+	if ((new_level == level) || (cycle == level_since))
+	{
+		level = new_level;
+		return;
+	}
+	length = cycle - level_since;
+
+	if (level)
+	{
+		/* a falling edge: the end of a bit's high time */
+		high_pulse(level_since, length);
+		bit_pending = true;
+	}
+	else
+	{
+		/* a rising edge: the end of the previous bit, or the start of a frame */
+		if (in_frame && (ns(length) > part->idle_max))
+		{
+			if (ns(length) < part->reset_min)
+				error(level_since, "low for %.0fns, which might or might not be taken as a reset", ns(length));
+			end_frame();
+		}
+
+		if (in_frame && bit_pending)
+		{
+			range(&period_min, &period_max, cycle - rise);
+			if (ns(cycle - rise) < part->period_min)
+				error(rise, "bit period of %.0fns", ns(cycle - rise));
+			else if (ns(cycle - rise) > part->period_max)
+			{
+				gaps++;
+				if ((cycle - rise) > gap_max)
+				{
+					gap_max = cycle - rise;
+					gap_max_cycle = rise;
+				}
+				if (verbose || (reported_gaps++ < REPORT_LIMIT))
+					printf("  %s: cycle %llu (frame %u, bit %u): gap, bit period of %.0fns\n", part->name, (unsigned long long)rise, frames, frame_bits - 1, ns(cycle - rise));
+			}
+		}
+
+		if (!in_frame)
+		{
+			in_frame = true;
+			frame_start = cycle;
+			frame_bits = 0;
+			memset(frame, 0, sizeof(frame));
+		}
+
+		rise = cycle;
+		bit_pending = false;
+	}
+
+	level = new_level;
+	level_since = cycle;
+}
+
+static int check(const struct part_struct *p)
+{
+	unsigned index, bit;
+	uint64_t cycle;
+
+	part = p;
+	errors = gaps = reported_errors = reported_gaps = 0;
+	frames = bits = mismatches = updated = 0;
+	high0_min = high0_max = high1_min = high1_max = period_min = period_max = gap_max = 0;
+	in_frame = bit_pending = false;
+	level = 0;
+	level_since = 0;
+	next_snapshot = 0;
+
+	for (index = 0; index < write_count; index++)
+	{
+		cycle = writes[index].cycle;
+
+		if (index && (cycle < writes[index - 1].cycle + 8))
+			error(cycle, "SSP1BUF written %llu cycles after the byte before, while it was still going out", (unsigned long long)(cycle - writes[index - 1].cycle));
+
+		for (bit = 0; bit < 8; bit++)
+			line((writes[index].value >> (7 - bit)) & 1, cycle + bit);
+
+		/* after the last bit, the line either returns low or holds */
+		if (!hold)
+			line(0, cycle + 8);
+	}
+
+	/* the line is left low for good at the end of the trace */
+	if (write_count)
+	{
+		cycle = writes[write_count - 1].cycle + 8;
+		line(0, cycle);
+		line(1, cycle + (uint64_t)part->reset_min * CYCLES_PER_US / 1000 + 1);
+		in_frame = false;
+	}
+
+	printf("%s: %u frames, %u bits\n", part->name, frames, bits);
+	if (high0_max)
+		printf("  '0' high: %.0f to %.0fns (%u to %u)\n", ns(high0_min), ns(high0_max), part->t0h_min, part->t0h_max);
+	if (high1_max)
+		printf("  '1' high: %.0f to %.0fns (%u to %u)\n", ns(high1_min), ns(high1_max), part->t1h_min, part->t1h_max);
+	if (period_max)
+		printf("  bit period: %.0f to %.0fns (%u to %u)\n", ns(period_min), ns(period_max), part->period_min, part->period_max);
+	printf("  gaps: %u", gaps);
+	if (gaps)
+		printf(", the longest %.0fns at cycle %llu", ns(gap_max), (unsigned long long)gap_max_cycle);
+	printf("\n");
+	if (snapshot_count)
+		printf("  leds[]: %u bytes sent as neither value, %u sent after the fade loop changed them\n", mismatches, updated);
+	printf("  errors: %u\n", errors + mismatches);
+
+	return errors + mismatches;
+}
+
+static int load_trace(const char *path)
+{
+	FILE *file;
+	char line_buf[512], hex[2 * FRAME_BYTES + 1];
+	unsigned long long cycle;
+	unsigned value, index, allocated = 0, snapshots_allocated = 0;
+
+	file = strcmp(path, "-") ? fopen(path, "r") : stdin;
+	if (!file)
+	{
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line_buf, sizeof(line_buf), file))
+	{
+		if (2 == sscanf(line_buf, "w %llx %x", &cycle, &value))
+		{
+			if (write_count == allocated)
+			{
+				allocated = allocated ? 2 * allocated : 4096;
+				writes = realloc(writes, allocated * sizeof(*writes));
+				if (!writes)
+					return -1;
+			}
+			writes[write_count].cycle = cycle;
+			writes[write_count].value = value;
+			write_count++;
+		}
+		else if (2 == sscanf(line_buf, "l %llx %108s", &cycle, hex))
+		{
+			if (strlen(hex) != 2 * FRAME_BYTES)
+				continue;
+			if (snapshot_count == snapshots_allocated)
+			{
+				snapshots_allocated = snapshots_allocated ? 2 * snapshots_allocated : 256;
+				snapshots = realloc(snapshots, snapshots_allocated * sizeof(*snapshots));
+				if (!snapshots)
+					return -1;
+			}
+			snapshots[snapshot_count].cycle = cycle;
+			for (index = 0; index < FRAME_BYTES; index++)
+			{
+				sscanf(hex + 2 * index, "%2x", &value);
+				snapshots[snapshot_count].leds[index] = value;
+			}
+			snapshot_count++;
+		}
+	}
+
+	if (file != stdin)
+		fclose(file);
+	return 0;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-p part] [-l low|hold] [-v] trace\n", name);
+	fprintf(stderr, "  -p  WS2811, WS2812B, SK6812 or all (the default)\n");
+	fprintf(stderr, "  -l  what the SPI data line does between bytes: returns low (the default) or holds the last bit\n");
+	fprintf(stderr, "  -v  describe every problem, rather than the first few of each sort\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *part_name = "all";
+	unsigned index;
+	bool found = false;
+	int opt, failed = 0;
+
+	while ((opt = getopt(argc, argv, "p:l:v")) != -1)
+	{
+		switch (opt)
+		{
+		case 'p':
+			part_name = optarg;
+			break;
+		case 'l':
+			if (!strcmp(optarg, "hold"))
+				hold = true;
+			else if (strcmp(optarg, "low"))
+				usage(argv[0]);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	if (load_trace(argv[optind]))
+		return 2;
+
+	for (index = 0; index < sizeof(parts) / sizeof(parts[0]); index++)
+	{
+		if (strcmp(part_name, "all") && strcasecmp(part_name, parts[index].name))
+			continue;
+		found = true;
+		if (check(&parts[index]))
+			failed = 1;
+	}
+
+	if (!found)
+		usage(argv[0]);
+
+	return failed;
+}
@@ -0,0 +1,649 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+blink0d: owns every blink0 on the machine, so that any number of processes can set LEDs without fighting over them
+
+clients connect to a Unix socket and send lines of text:
+
+  fade <serial> <led> <rrggbb> [ms]   fade an LED (0 for all of them) to a colour over ms (default 0); the serial
+                                      number picks the device, and * is every device
+  name <text>                         what to call this client in the stats
+  devices                             list the devices: serial number, hidraw node, and what they can do
+  stats                               throughput of every client and every device
+
+fades are fire and forget; only a line that isn't understood gets a reply ("error ..."); devices and stats reply with
+lines of text, and then a line holding only "."
+
+nothing is sent to a device the moment it is asked for; once a period (10ms, the firmware's tick, unless told
+otherwise) the latest fade for each LED is taken, and as few reports as will do are sent: when every LED has a fade
+due, the most common one goes to all of them at once, and then only the ones that differ; everything else that came in
+during the period never makes it to the device; libblink0 then coalesces whatever a slow device hasn't yet taken
+
+each client may send so many fades a second (-r); beyond that, they are dropped and counted
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+#include "libblink0/libblink0.h"
+
+#define MAX_CLIENTS  64
+#define MAX_DEVICES  32
+#define LINE_MAX_LEN 256
+
+/* how often to look for devices that have been plugged in */
+#define RESCAN_MS 2000
+
+/* the throughput figures are over this window */
+#define RATE_MS 1000
+
+struct counter_struct
+{
+	uint64_t total;
+	uint64_t window_start; /* total when the current window started */
+	double rate;           /* per second, over the last whole window */
+};
+
+struct client_struct
+{
+	int fd;
+	char name[64];
+	char line[LINE_MAX_LEN];
+	unsigned length;
+	double tokens; /* the rate limit's bucket */
+	struct counter_struct fades;
+	uint64_t limited, errors;
+};
+
+/* the latest fade asked for, for one LED, in this period */
+struct pending_struct
+{
+	bool due;
+	uint8_t rgb[3];
+	unsigned fade_ms;
+};
+
+struct device_struct
+{
+	struct blink0_device *device;
+	char serial[64];
+	struct pending_struct pending[BLINK0_LED_COUNT];
+	struct counter_struct fades;   /* fades asked of this device */
+	struct counter_struct reports; /* and what it took to pass them on */
+	uint64_t merged;               /* fades that a later one for the same LED replaced within a period */
+};
+
+static struct client_struct clients[MAX_CLIENTS];
+static unsigned client_count;
+static struct device_struct devices[MAX_DEVICES];
+static unsigned device_count;
+
+static const char *named[MAX_DEVICES];
+static unsigned named_count;
+
+static struct blink0_context *context;
+static double rate_limit = 1000.0;
+static volatile sig_atomic_t quit;
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void count(struct counter_struct *counter, unsigned amount)
+{
+	counter->total += amount;
+}
+
+static void roll(struct counter_struct *counter, uint64_t elapsed_ms)
+{
+	counter->rate = (counter->total - counter->window_start) * 1000.0 / elapsed_ms;
+	counter->window_start = counter->total;
+}
+
+static const char *device_key(const struct device_struct *device)
+{
+	/* a device with no serial number is known by its hidraw node instead */
+	return device->serial[0] ? device->serial : blink0_path(device->device);
+}
+
+static void add_device(struct blink0_device *device)
+{
+	struct device_struct *entry;
+	unsigned index;
+
+	for (index = 0; index < device_count; index++)
+		if (devices[index].device == device)
+			return;
+	if (MAX_DEVICES == device_count)
+		return;
+
+	entry = &devices[device_count++];
+	memset(entry, 0, sizeof(*entry));
+	entry->device = device;
+	snprintf(entry->serial, sizeof(entry->serial), "%s", blink0_serial(device));
+	fprintf(stderr, "blink0d: %s on %s\n", device_key(entry), blink0_path(device));
+}
+
+static void scan(void)
+{
+	struct blink0_device *device;
+	unsigned index;
+	bool open;
+
+	blink0_open_all(context);
+
+	/* the devices given with -d are opened again whenever they have gone */
+	for (index = 0; index < named_count; index++)
+	{
+		open = false;
+		for (device = blink0_next(context, NULL); device; device = blink0_next(context, device))
+			open |= !strcmp(blink0_path(device), named[index]);
+		if (!open)
+			blink0_open(context, named[index]);
+	}
+
+	for (device = blink0_next(context, NULL); device; device = blink0_next(context, device))
+		add_device(device);
+}
+
+static void callback(struct blink0_device *device, enum blink0_event event, unsigned value, void *user)
+{
+	unsigned index;
+
+	(void)user;
+
+	if (BLINK0_EVENT_LOST == event)
+		fprintf(stderr, "blink0d: %s lost a command (status flags 0x%02x)\n", blink0_path(device), value);
+
+	if (BLINK0_EVENT_GONE != event)
+		return;
+
+	for (index = 0; index < device_count; index++)
+	{
+		if (devices[index].device != device)
+			continue;
+		fprintf(stderr, "blink0d: %s has gone\n", device_key(&devices[index]));
+		devices[index] = devices[--device_count];
+		break;
+	}
+}
+
+/* the period is over; pass on the latest fade for each LED in as few reports as will do */
+static void flush(struct device_struct *device)
+{
+	struct pending_struct *pending = device->pending, *common = NULL;
+	unsigned led, other, votes, best = 0, due = 0;
+
+	for (led = 0; led < BLINK0_LED_COUNT; led++)
+		due += pending[led].due;
+	if (!due)
+		return;
+
+	/* with a fade due for every LED, the one most of them want can go to all of them in one report */
+	if (BLINK0_LED_COUNT == due)
+	{
+		for (led = 0; led < BLINK0_LED_COUNT; led++)
+		{
+			votes = 0;
+			for (other = 0; other < BLINK0_LED_COUNT; other++)
+				if ((pending[other].fade_ms == pending[led].fade_ms) && !memcmp(pending[other].rgb, pending[led].rgb, 3))
+					votes++;
+			if (votes > best)
+			{
+				best = votes;
+				common = &pending[led];
+			}
+		}
+
+		if (best > 1)
+		{
+			blink0_fade(device->device, 0, common->rgb[0], common->rgb[1], common->rgb[2], common->fade_ms);
+			count(&device->reports, 1);
+		}
+		else
+			common = NULL;
+	}
+
+	for (led = 0; led < BLINK0_LED_COUNT; led++)
+	{
+		if (!pending[led].due)
+			continue;
+		pending[led].due = false;
+
+		if (common && (pending[led].fade_ms == common->fade_ms) && !memcmp(pending[led].rgb, common->rgb, 3))
+			continue;
+
+		blink0_fade(device->device, led + 1, pending[led].rgb[0], pending[led].rgb[1], pending[led].rgb[2], pending[led].fade_ms);
+		count(&device->reports, 1);
+	}
+}
+
+static void fade(struct device_struct *device, unsigned ledn, const uint8_t rgb[3], unsigned fade_ms)
+{
+	struct pending_struct *pending;
+	unsigned led;
+
+	count(&device->fades, 1);
+
+	for (led = 0; led < BLINK0_LED_COUNT; led++)
+	{
+		if (ledn && (ledn != led + 1))
+			continue;
+
+		pending = &device->pending[led];
+		if (pending->due)
+			device->merged++;
+		pending->due = true;
+		memcpy(pending->rgb, rgb, 3);
+		pending->fade_ms = fade_ms;
+	}
+}
+
+static void reply(struct client_struct *client, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void reply(struct client_struct *client, const char *format, ...)
+{
+	char text[512];
+	va_list args;
+	int length;
+
+	va_start(args, format);
+	length = vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	if (length < 0)
+		return;
+	if (length >= (int)sizeof(text))
+		length = sizeof(text) - 1;
+
+	/* a client that doesn't read its replies loses them, rather than holding up everybody else */
+	send(client->fd, text, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+static void command_fade(struct client_struct *client, char *args)
+{
+	char serial[64];
+	unsigned ledn, rgb, fade_ms = 0, index;
+	uint8_t colour[3];
+	bool found = false;
+	int fields;
+
+	fields = sscanf(args, "%63s %u %6x %u", serial, &ledn, &rgb, &fade_ms);
+	if ((fields < 3) || (ledn > BLINK0_LED_COUNT))
+	{
+		client->errors++;
+		reply(client, "error fade <serial> <led> <rrggbb> [ms]\n");
+		return;
+	}
+
+	count(&client->fades, 1);
+
+	/* the bucket refills continuously in the main loop, up to a second's worth */
+	if (client->tokens < 1.0)
+	{
+		client->limited++;
+		return;
+	}
+	client->tokens -= 1.0;
+
+	colour[0] = rgb >> 16;
+	colour[1] = rgb >> 8;
+	colour[2] = rgb;
+
+	for (index = 0; index < device_count; index++)
+	{
+		if (strcmp(serial, "*") && strcmp(serial, device_key(&devices[index])))
+			continue;
+		fade(&devices[index], ledn, colour, fade_ms);
+		found = true;
+	}
+
+	if (!found && strcmp(serial, "*"))
+	{
+		client->errors++;
+		reply(client, "error no device %s\n", serial);
+	}
+}
+
+static void command_devices(struct client_struct *client)
+{
+	unsigned index, features;
+
+	for (index = 0; index < device_count; index++)
+	{
+		features = blink0_features(devices[index].device);
+		reply(client, "%s %s%s%s%s\n", device_key(&devices[index]), blink0_path(devices[index].device),
+			(features & BLINK0_HAS_STATUS) ? " status" : "", (features & BLINK0_HAS_READBACK) ? " readback" : "",
+			(features & BLINK0_HAS_STREAM) ? " stream" : "");
+	}
+	reply(client, ".\n");
+}
+
+static void command_stats(struct client_struct *client)
+{
+	struct blink0_stats stats;
+	unsigned index;
+
+	for (index = 0; index < client_count; index++)
+		reply(client, "client %s fades %llu (%.1f/s) limited %llu errors %llu\n", clients[index].name,
+			(unsigned long long)clients[index].fades.total, clients[index].fades.rate,
+			(unsigned long long)clients[index].limited, (unsigned long long)clients[index].errors);
+
+	for (index = 0; index < device_count; index++)
+	{
+		blink0_get_stats(devices[index].device, &stats);
+		reply(client, "device %s fades %llu (%.1f/s) merged %llu reports %llu (%.1f/s) sent %u streamed %u coalesced %u retries %u lost %u\n",
+			device_key(&devices[index]), (unsigned long long)devices[index].fades.total, devices[index].fades.rate,
+			(unsigned long long)devices[index].merged, (unsigned long long)devices[index].reports.total, devices[index].reports.rate,
+			stats.sent, stats.streamed, stats.coalesced, stats.retries, stats.lost);
+	}
+
+	reply(client, ".\n");
+}
+
+static void command(struct client_struct *client, char *line)
+{
+	char *args;
+
+	line[strcspn(line, "\r")] = '\0';
+	args = line + strcspn(line, " \t");
+	if (*args)
+		*args++ = '\0';
+
+	if (!strcmp(line, "fade"))
+		command_fade(client, args);
+	else if (!strcmp(line, "name"))
+		snprintf(client->name, sizeof(client->name), "%.*s", (int)strcspn(args, " \t"), args);
+	else if (!strcmp(line, "devices"))
+		command_devices(client);
+	else if (!strcmp(line, "stats"))
+		command_stats(client);
+	else if (*line)
+	{
+		client->errors++;
+		reply(client, "error unknown command %s\n", line);
+	}
+}
+
+static void drop_client(unsigned index)
+{
+	close(clients[index].fd);
+	clients[index] = clients[--client_count];
+}
+
+/* returns false once the client has gone */
+static bool read_client(struct client_struct *client)
+{
+	char buffer[4096];
+	ssize_t length, used;
+
+	length = recv(client->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+	if (0 == length)
+		return false;
+	if (length < 0)
+		return (EAGAIN == errno) || (EINTR == errno);
+
+	for (used = 0; used < length; used++)
+	{
+		if ('\n' == buffer[used])
+		{
+			client->line[client->length] = '\0';
+			command(client, client->line);
+			client->length = 0;
+			continue;
+		}
+
+		/* an overlong line is cut short, and taken as whatever it was cut down to */
+		if (client->length < sizeof(client->line) - 1)
+			client->line[client->length++] = buffer[used];
+	}
+
+	return true;
+}
+
+static int listen_on(const char *path)
+{
+	struct sockaddr_un address;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		perror("socket");
+		return -1;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+	unlink(path);
+
+	if ((bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) || (listen(fd, 16) < 0))
+	{
+		perror(path);
+		close(fd);
+		return -1;
+	}
+
+	/* anyone on the machine may set LEDs */
+	chmod(path, 0666);
+	return fd;
+}
+
+static void accept_client(int listener)
+{
+	struct client_struct *client;
+	int fd;
+
+	fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (fd < 0)
+		return;
+
+	if (MAX_CLIENTS == client_count)
+	{
+		close(fd);
+		return;
+	}
+
+	client = &clients[client_count++];
+	memset(client, 0, sizeof(*client));
+	client->fd = fd;
+	client->tokens = rate_limit;
+	snprintf(client->name, sizeof(client->name), "fd%d", fd);
+}
+
+static void stop(int signal)
+{
+	(void)signal;
+	quit = 1;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-s socket] [-p period_ms] [-r fades_per_second] [-d device]...\n", name);
+	fprintf(stderr, "  -s  where to listen (default /run/blink0d.sock)\n");
+	fprintf(stderr, "  -p  how often fades are passed on to the devices (default 10ms, the firmware's tick)\n");
+	fprintf(stderr, "  -r  how many fades a second each client may send (default 1000)\n");
+	fprintf(stderr, "  -d  a device to open besides the blink0s found through hidraw, e.g. unix:<socket> for blink0-emu\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *socket_path = "/run/blink0d.sock";
+	struct pollfd fds[1 + MAX_CLIENTS + MAX_DEVICES];
+	unsigned period_ms = 10, index, nfds, polled;
+	uint64_t now, next_period, next_scan, rate_start, last;
+	int listener, opt, timeout, wait;
+
+	while ((opt = getopt(argc, argv, "s:p:r:d:")) != -1)
+	{
+		switch (opt)
+		{
+		case 's':
+			socket_path = optarg;
+			break;
+		case 'p':
+			period_ms = strtoul(optarg, NULL, 0);
+			if (!period_ms)
+				usage(argv[0]);
+			break;
+		case 'd':
+			if (MAX_DEVICES == named_count)
+				usage(argv[0]);
+			named[named_count++] = optarg;
+			break;
+		case 'r':
+			rate_limit = atof(optarg);
+			if (rate_limit <= 0.0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+
+	context = blink0_init(callback, NULL);
+	if (!context)
+		return 2;
+
+	listener = listen_on(socket_path);
+	if (listener < 0)
+		return 2;
+
+	signal(SIGINT, stop);
+	signal(SIGTERM, stop);
+	signal(SIGPIPE, SIG_IGN);
+
+	scan();
+	last = rate_start = now_ms();
+	next_period = last + period_ms;
+	next_scan = last + RESCAN_MS;
+
+	while (!quit)
+	{
+		fds[0].fd = listener;
+		fds[0].events = POLLIN;
+		for (index = 0; index < client_count; index++)
+		{
+			fds[1 + index].fd = clients[index].fd;
+			fds[1 + index].events = POLLIN;
+		}
+		polled = client_count;
+		nfds = 1 + polled;
+		nfds += blink0_pollfds(context, fds + nfds, sizeof(fds) / sizeof(fds[0]) - nfds);
+
+		now = now_ms();
+		timeout = (next_period > now) ? (int)(next_period - now) : 0;
+		wait = blink0_timeout(context);
+		if ((wait >= 0) && (wait < timeout))
+			timeout = wait;
+
+		if ((poll(fds, nfds, timeout) < 0) && (EINTR != errno))
+		{
+			perror("poll");
+			break;
+		}
+
+		now = now_ms();
+
+		/* refill every client's bucket for the time that has gone by */
+		for (index = 0; index < client_count; index++)
+		{
+			clients[index].tokens += rate_limit * (now - last) / 1000.0;
+			if (clients[index].tokens > rate_limit)
+				clients[index].tokens = rate_limit;
+		}
+		last = now;
+
+		/* from the last client down, as dropping one moves the last into its place */
+		for (index = polled; index-- > 0;)
+		{
+			if ((fds[1 + index].revents & (POLLIN | POLLHUP | POLLERR)) && !read_client(&clients[index]))
+				drop_client(index);
+		}
+
+		if (fds[0].revents & POLLIN)
+			accept_client(listener);
+
+		if (now >= next_period)
+		{
+			for (index = 0; index < device_count; index++)
+				flush(&devices[index]);
+			next_period += period_ms;
+			if (next_period <= now)
+				next_period = now + period_ms;
+		}
+
+		blink0_process(context);
+
+		if (now >= next_scan)
+		{
+			scan();
+			next_scan = now + RESCAN_MS;
+		}
+
+		if (now - rate_start >= RATE_MS)
+		{
+			for (index = 0; index < client_count; index++)
+				roll(&clients[index].fades, now - rate_start);
+			for (index = 0; index < device_count; index++)
+			{
+				roll(&devices[index].fades, now - rate_start);
+				roll(&devices[index].reports, now - rate_start);
+			}
+			rate_start = now;
+		}
+	}
+
+	unlink(socket_path);
+	blink0_exit(context);
+	return 0;
+}
@@ -0,0 +1,102 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include "fade.h"
+
+void fade_set(struct fade_channel *channel, uint8_t target, uint16_t fade_delay)
+{
+	uint8_t updir;
+	uint16_t distance;
+
+	channel->target = target;
+	channel->fade_delay = fade_delay;
+
+	updir = target > channel->current;
+	distance = updir ? (target - channel->current) : (channel->current - target);
+	distance <<= 8;
+
+	channel->increment = 0;
+	channel->fraction = 0;
+
+	if (0 == fade_delay)
+		return;
+
+	/* the firmware subtracts fade_delay for as long as what is left is still bigger; that is a division, less one */
+	if (distance)
+		channel->increment = (distance - 1) / fade_delay;
+
+	/* odd for up, even for down; zero either way doesn't move */
+	if ((updir && !(channel->increment & 1) && channel->increment) || (!updir && (channel->increment & 1)))
+		channel->increment--;
+}
+
+void fade_tick(struct fade_channel *channel)
+{
+	uint16_t change;
+	uint8_t msb;
+
+	if (0 == channel->fade_delay)
+	{
+		/* the fade has elapsed; the final value is written */
+		channel->current = channel->target;
+		return;
+	}
+
+	channel->fade_delay--;
+
+	/* adjust_led(): the whole part of the step goes into the LED, and the rest stays in fraction */
+	change = (uint16_t)channel->fraction + channel->increment;
+	msb = change >> 8;
+	if (channel->increment & 1)
+		channel->current += msb;
+	else
+		channel->current -= msb;
+	channel->fraction = change & 0xFF;
+}
+
+uint32_t fade_moved(const struct fade_channel *channel, uint32_t ticks)
+{
+	return ((uint64_t)channel->increment * ticks) >> 8;
+}
+
+uint8_t fade_linear(uint8_t start, uint8_t target, uint16_t fade_delay, uint32_t tick)
+{
+	int32_t distance = (int32_t)target - start;
+
+	if (tick >= fade_delay)
+		return target;
+
+	/* rounded half away from zero, so that going up and going down are mirror images */
+	if (distance >= 0)
+		return start + (uint8_t)(((uint32_t)distance * tick * 2 + fade_delay) / (2 * fade_delay));
+	else
+		return start - (uint8_t)(((uint32_t)-distance * tick * 2 + fade_delay) / (2 * fade_delay));
+}
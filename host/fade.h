@@ -0,0 +1,73 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+a model of the blink0 fade engine on a PC, bit for bit: calc_increment() and adjust_led() in main.c, and the fade loop
+the main loop goes through once a tick (every 10ms)
+
+it is kept separate from the firmware so that it can be checked against it (see blink0-fade), and so that host tools
+can tell what the LEDs will show at each tick without asking
+*/
+
+#ifndef FADE_H
+#define FADE_H
+
+#include <stdint.h>
+
+/* one colour of one LED: its leds[] byte, and what targets[] holds for it */
+struct fade_channel
+{
+	uint8_t current;     /* leds[] */
+	uint8_t target;      /* targets[].leds */
+	uint16_t fade_delay; /* targets[].fade_delay: the ticks left in the fade */
+	uint16_t increment;  /* bookkeep_struct: the step per tick in 1/256ths, with the direction hidden in its lsb */
+	uint8_t fraction;
+};
+
+/* a 'c' command for this LED: set_target() and calc_increment() */
+void fade_set(struct fade_channel *channel, uint8_t target, uint16_t fade_delay);
+
+/* one tick of the fade loop */
+void fade_tick(struct fade_channel *channel);
+
+/*
+how far from where it started a fade has moved after a number of ticks, without going through them one by one;
+the fraction carries exactly, so this is increment * ticks / 256 (only good until the fade ends, at tick fade_delay + 1)
+*/
+uint32_t fade_moved(const struct fade_channel *channel, uint32_t ticks);
+
+/*
+what Blink(1) documents for the same command: a straight line from start to target, reached fade_delay ticks later;
+each tick is rounded to the nearest whole value
+*/
+uint8_t fade_linear(uint8_t start, uint8_t target, uint16_t fade_delay, uint32_t tick);
+
+#endif /* FADE_H */
@@ -0,0 +1,991 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <libgen.h>
+#include <limits.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/hidraw.h>
+
+#include "libblink0.h"
+#include "reports.h"
+
+/* how many transfers blink0_process() does for one device before going on to the next */
+#define TRANSFER_BUDGET 4
+
+/*
+after an immediate change, how long to allow before the device has surely shown it, and an Adalight frame can't
+overtake it (a tick, plus time for the command to get there)
+*/
+#define SETTLE_MS 30
+
+/* how long blink0-emu has to answer a request */
+#define EMU_TIMEOUT_MS 1000
+
+#define EMU_PREFIX "unix:"
+
+/* a change not yet sent; the queue holds one per LED at most, as a newer change replaces an older one */
+struct change_struct
+{
+	uint8_t ledn;
+	uint8_t rgb[3];
+	uint16_t fade_delay; /* in 10ms ticks, as the firmware has it */
+};
+
+struct blink0_device
+{
+	struct blink0_context *context;
+	struct blink0_device *next;
+	char path[PATH_MAX];
+	char serial[64];
+	int fd;        /* hidraw, or blink0-emu's socket */
+	int stream_fd; /* the CDC serial port, or -1 */
+	bool emulated;
+	unsigned features;
+
+	/* a status input report from blink0-emu that arrived while waiting for the answer to a request */
+	uint8_t input[STATUS_LEN];
+	bool input_held;
+
+	struct change_struct queue[BLINK0_LED_COUNT + 1];
+	unsigned queued;
+
+	/* sequence numbers: the last one sent, and the last the device said it applied */
+	uint8_t seq, confirmed;
+	bool stalled;
+
+	/* what every LED is heading for, when that is known, and when the last fade sent will be over */
+	uint8_t target[BLINK0_LED_COUNT][3];
+	bool target_known;
+	uint64_t settled_ms;
+
+	struct blink0_stats stats;
+	bool gone;
+};
+
+struct blink0_context
+{
+	struct blink0_device *devices;
+	struct blink0_device *resume; /* where the next blink0_process() starts, so that every device gets its turn first */
+	blink0_callback callback;
+	void *user;
+	FILE *trace;
+};
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void trace(struct blink0_device *device, const char *what, const uint8_t *report, size_t length, int result)
+{
+	struct timespec ts;
+	FILE *file = device->context->trace;
+	size_t index;
+
+	if (!file)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	fprintf(file, "%llu %s %s ", (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000, device->path, what);
+	if (!strcmp(what, "get"))
+		fprintf(file, "%u %u", report[0], (unsigned)length);
+	else
+		for (index = 0; index < length; index++)
+			fprintf(file, "%02x", report[index]);
+	fprintf(file, "%s\n", (-EPIPE == result) ? " stall" : "");
+}
+
+static void event(struct blink0_device *device, enum blink0_event what, unsigned value)
+{
+	if (device->context->callback)
+		device->context->callback(device, what, value, device->context->user);
+}
+
+/* a device that has gone away is only marked here; blink0_process() closes it once nothing is using it */
+static int failed(struct blink0_device *device, int error)
+{
+	if ((ENODEV == error) || (EIO == error) || (ESHUTDOWN == error))
+		device->gone = true;
+	return -error;
+}
+
+/* sequence numbers count 1 to 255, and then wrap back to 1 */
+static uint8_t seq_after(uint8_t seq)
+{
+	return (255 == seq) ? 1 : seq + 1;
+}
+
+static unsigned unconfirmed(const struct blink0_device *device)
+{
+	if (!(device->features & BLINK0_HAS_STATUS))
+		return 0;
+	return (device->seq + 255 - device->confirmed) % 255;
+}
+
+/*
+an input report that arrives while a request to blink0-emu is waiting for its answer is held until read_inputs();
+status reports only add to what was said before, so a newer one is merged into one still held, except for the
+latency stamps, which are taken whole from the newer one so that they stay with the command STATUS_STAMPED_SEQ names
+*/
+static void hold_input(struct blink0_device *device, const uint8_t *report, ssize_t length)
+{
+	if ((length < STATUS_LEN) || (REPORT_ID_STATUS != report[0]))
+		return;
+
+	if (device->input_held)
+	{
+		device->input[STATUS_SEQ] = report[STATUS_SEQ];
+		device->input[STATUS_FLAGS] |= report[STATUS_FLAGS];
+		device->input[STATUS_EVENTS] |= report[STATUS_EVENTS];
+		memcpy(&device->input[STATUS_RECEIVED], &report[STATUS_RECEIVED], STATUS_STAMPED_SEQ + 1 - STATUS_RECEIVED);
+		return;
+	}
+
+	memcpy(device->input, report, STATUS_LEN);
+	device->input_held = true;
+}
+
+/* a request to blink0-emu, and its answer; returns the answer's length, or a negative errno */
+static int emu_request(struct blink0_device *device, const uint8_t *request, size_t length, uint8_t *answer, size_t size)
+{
+	struct pollfd fd = { device->fd, POLLIN, 0 };
+	ssize_t received;
+
+	if (send(device->fd, request, length, MSG_NOSIGNAL) != (ssize_t)length)
+		return failed(device, (EPIPE == errno) ? ENODEV : errno);
+
+	for (;;)
+	{
+		if (poll(&fd, 1, EMU_TIMEOUT_MS) <= 0)
+			return failed(device, ENODEV);
+
+		received = recv(device->fd, answer, size, MSG_DONTWAIT);
+		if (0 == received)
+			return failed(device, ENODEV);
+		if (received < 0)
+		{
+			if ((EAGAIN == errno) || (EINTR == errno))
+				continue;
+			return failed(device, errno);
+		}
+
+		if (BLINK0_EMU_INPUT == answer[0])
+		{
+			hold_input(device, answer + 1, received - 1);
+			continue;
+		}
+		if (answer[0] == request[0])
+			return received;
+	}
+}
+
+static int get_transfer(struct blink0_device *device, uint8_t *report, size_t length)
+{
+	uint8_t request[3] = { BLINK0_EMU_GET_REPORT, report[0], length }, answer[2 + 64];
+	int received;
+
+	if (device->emulated)
+	{
+		received = emu_request(device, request, sizeof(request), answer, sizeof(answer));
+		if (received < 0)
+			return received;
+		if (received < 2)
+			return -EPROTO;
+		if (answer[1])
+			return -answer[1];
+		memcpy(report, answer + 2, ((size_t)received - 2 < length) ? (size_t)received - 2 : length);
+		return 0;
+	}
+
+	if (ioctl(device->fd, HIDIOCGFEATURE(length), report) < 0)
+		return failed(device, errno);
+	return 0;
+}
+
+static int set_transfer(struct blink0_device *device, uint8_t *report, size_t length)
+{
+	uint8_t request[1 + 64] = { BLINK0_EMU_SET_REPORT }, answer[2];
+	int received;
+
+	if (device->emulated)
+	{
+		if (length > sizeof(request) - 1)
+			return -EINVAL;
+		memcpy(request + 1, report, length);
+		received = emu_request(device, request, 1 + length, answer, sizeof(answer));
+		if (received < 0)
+			return received;
+		if (received < 2)
+			return -EPROTO;
+		return -answer[1];
+	}
+
+	if (ioctl(device->fd, HIDIOCSFEATURE(length), report) < 0)
+		return failed(device, errno);
+	return 0;
+}
+
+static int get_feature(struct blink0_device *device, uint8_t *report, size_t length)
+{
+	uint8_t report_id = report[0];
+	int result;
+
+	result = get_transfer(device, report, length);
+	trace(device, "get", &report_id, length, result);
+	return result;
+}
+
+static int set_feature(struct blink0_device *device, uint8_t *report, size_t length)
+{
+	int result;
+
+	result = set_transfer(device, report, length);
+	trace(device, "set", report, length, result);
+	return result;
+}
+
+/* a status report, from a GET_REPORT or an input report */
+static void take_status(struct blink0_device *device, const uint8_t *status)
+{
+	uint8_t flags = status[STATUS_FLAGS];
+
+	device->stats.statuses++;
+
+	/* a SET_REPORT this library had stalled (and then sent again) sets the overflow flag too */
+	if (device->stalled)
+	{
+		flags &= ~STATUS_FLAG_OVERFLOW;
+		device->stalled = false;
+	}
+	if (flags & (STATUS_FLAG_DROPPED | STATUS_FLAG_OVERFLOW))
+	{
+		device->stats.lost++;
+		event(device, BLINK0_EVENT_LOST, flags);
+	}
+
+	if (status[STATUS_SEQ] && (status[STATUS_SEQ] != device->confirmed))
+	{
+		device->confirmed = status[STATUS_SEQ];
+		event(device, BLINK0_EVENT_APPLIED, device->confirmed);
+	}
+
+	if (status[STATUS_EVENTS] & STATUS_EVENT_FADE_DONE)
+		event(device, BLINK0_EVENT_FADE_DONE, 0);
+}
+
+static int get_status(struct blink0_device *device)
+{
+	uint8_t status[STATUS_LEN] = { REPORT_ID_STATUS };
+	int result;
+
+	result = get_feature(device, status, sizeof(status));
+	if (!result)
+		take_status(device, status);
+	return result;
+}
+
+static int read_descriptor(struct blink0_device *device, struct hidraw_report_descriptor *descriptor)
+{
+	uint8_t request[1] = { BLINK0_EMU_DESCRIPTOR }, answer[1 + HID_MAX_DESCRIPTOR_SIZE];
+	int length;
+
+	if (device->emulated)
+	{
+		length = emu_request(device, request, sizeof(request), answer, sizeof(answer));
+		if (length < 1)
+			return -EPROTO;
+		descriptor->size = length - 1;
+		memcpy(descriptor->value, answer + 1, descriptor->size);
+		return 0;
+	}
+
+	if ((ioctl(device->fd, HIDIOCGRDESCSIZE, &length) < 0) || (length <= 0) || (length > HID_MAX_DESCRIPTOR_SIZE))
+		return -EPROTO;
+	descriptor->size = length;
+	if (ioctl(device->fd, HIDIOCGRDESC, descriptor) < 0)
+		return -errno;
+	return 0;
+}
+
+/* which report IDs the report descriptor has */
+static unsigned find_features(struct blink0_device *device)
+{
+	struct hidraw_report_descriptor descriptor;
+	unsigned index, size, features = 0;
+
+	if (read_descriptor(device, &descriptor))
+		return 0;
+
+	for (index = 0; index < descriptor.size; index += 1 + size)
+	{
+		/* short items: the bottom two bits give the size, where 3 means 4 */
+		size = descriptor.value[index] & 0x03;
+		if (3 == size)
+			size = 4;
+
+		/* a long item gives its own size */
+		if (0xFE == descriptor.value[index])
+		{
+			size = (index + 1 < descriptor.size) ? 2 + descriptor.value[index + 1] : 0;
+			continue;
+		}
+
+		/* REPORT_ID */
+		if ((0x85 == descriptor.value[index]) && (index + 1 < descriptor.size))
+		{
+			if (REPORT_ID_STATUS == descriptor.value[index + 1])
+				features |= BLINK0_HAS_STATUS;
+			if (REPORT_ID_READBACK == descriptor.value[index + 1])
+				features |= BLINK0_HAS_READBACK;
+		}
+	}
+
+	return features;
+}
+
+/* the hidraw node's USB device in sysfs, e.g. /sys/devices/.../1-1 */
+static int usb_device_dir(const char *path, char *dir, size_t size)
+{
+	char link[PATH_MAX], resolved[PATH_MAX], *name;
+
+	name = basename((char *)path);
+	snprintf(link, sizeof(link), "/sys/class/hidraw/%s/device", name);
+	if (!realpath(link, resolved))
+		return -errno;
+
+	/* .../1-1/1-1:1.0/0003:27B8:01ED.0001: up past the HID device and the USB interface */
+	snprintf(dir, size, "%s", dirname(dirname(resolved)));
+	return 0;
+}
+
+/* the CDC serial port on the same USB device, if the firmware was built with one */
+static void open_stream(struct blink0_device *device)
+{
+	char dir[PATH_MAX], pattern[PATH_MAX + 32], tty[PATH_MAX];
+	struct termios termios;
+	glob_t found;
+
+	device->stream_fd = -1;
+	if (usb_device_dir(device->path, dir, sizeof(dir)))
+		return;
+
+	snprintf(pattern, sizeof(pattern), "%s/*:*/tty/ttyACM*", dir);
+	if (glob(pattern, 0, NULL, &found) || !found.gl_pathc)
+	{
+		globfree(&found);
+		return;
+	}
+	snprintf(tty, sizeof(tty), "/dev/%s", basename(found.gl_pathv[0]));
+	globfree(&found);
+
+	device->stream_fd = open(tty, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (device->stream_fd < 0)
+		return;
+
+	/* raw bytes; the firmware ignores the baud rate */
+	if (!tcgetattr(device->stream_fd, &termios))
+	{
+		cfmakeraw(&termios);
+		tcsetattr(device->stream_fd, TCSANOW, &termios);
+	}
+
+	device->features |= BLINK0_HAS_STREAM;
+}
+
+static void read_serial(struct blink0_device *device)
+{
+	char dir[PATH_MAX], path[PATH_MAX + 32], line[256];
+	uint8_t request[1] = { BLINK0_EMU_SERIAL }, answer[64];
+	FILE *file;
+	int length;
+
+	if (device->emulated)
+	{
+		length = emu_request(device, request, sizeof(request), answer, sizeof(answer) - 1);
+		if (length >= 1)
+			snprintf(device->serial, sizeof(device->serial), "%.*s", length - 1, (char *)answer + 1);
+		return;
+	}
+
+	if (!usb_device_dir(device->path, dir, sizeof(dir)))
+	{
+		snprintf(path, sizeof(path), "%s/serial", dir);
+		file = fopen(path, "r");
+		if (file)
+		{
+			if (fgets(device->serial, sizeof(device->serial), file))
+				device->serial[strcspn(device->serial, "\r\n")] = '\0';
+			fclose(file);
+			return;
+		}
+	}
+
+	/* a HID device with no USB device under it (such as blink0-emu's over UHID) may still have a serial number */
+	snprintf(path, sizeof(path), "/sys/class/hidraw/%s/device/uevent", basename(device->path));
+	file = fopen(path, "r");
+	if (!file)
+		return;
+	while (fgets(line, sizeof(line), file))
+		if (!strncmp(line, "HID_UNIQ=", 9))
+		{
+			line[strcspn(line, "\r\n")] = '\0';
+			snprintf(device->serial, sizeof(device->serial), "%.*s", (int)sizeof(device->serial) - 1, line + 9);
+		}
+	fclose(file);
+}
+
+static int connect_emu(const char *path)
+{
+	struct sockaddr_un address;
+	int fd;
+
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -1;
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+	if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void read_colours(struct blink0_device *device)
+{
+	uint8_t report[1 + 3 * BLINK0_LED_COUNT] = { REPORT_ID_READBACK };
+	unsigned led;
+
+	if (get_feature(device, report, sizeof(report)))
+		return;
+
+	/* green, red, blue for each LED */
+	for (led = 0; led < BLINK0_LED_COUNT; led++)
+	{
+		device->target[led][0] = report[1 + 3 * led + 1];
+		device->target[led][1] = report[1 + 3 * led + 0];
+		device->target[led][2] = report[1 + 3 * led + 2];
+	}
+	device->target_known = true;
+}
+
+struct blink0_context *blink0_init(blink0_callback callback, void *user)
+{
+	struct blink0_context *context;
+
+	context = calloc(1, sizeof(*context));
+	if (!context)
+		return NULL;
+
+	context->callback = callback;
+	context->user = user;
+	return context;
+}
+
+void blink0_exit(struct blink0_context *context)
+{
+	while (context->devices)
+		blink0_close(context->devices);
+	free(context);
+}
+
+struct blink0_device *blink0_open(struct blink0_context *context, const char *path)
+{
+	struct blink0_device *device;
+	uint8_t status[STATUS_LEN] = { REPORT_ID_STATUS };
+
+	device = calloc(1, sizeof(*device));
+	if (!device)
+		return NULL;
+
+	device->context = context;
+	snprintf(device->path, sizeof(device->path), "%s", path);
+	device->emulated = !strncmp(path, EMU_PREFIX, strlen(EMU_PREFIX));
+	if (device->emulated)
+		device->fd = connect_emu(path + strlen(EMU_PREFIX));
+	else
+		device->fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (device->fd < 0)
+	{
+		free(device);
+		return NULL;
+	}
+
+	device->features = find_features(device);
+
+	/* carry on from the device's sequence numbers, so the first command sent doesn't look like one went missing */
+	if ((device->features & BLINK0_HAS_STATUS) && !get_feature(device, status, sizeof(status)))
+		device->seq = device->confirmed = status[STATUS_SEQ];
+
+	if (device->features & BLINK0_HAS_READBACK)
+		read_colours(device);
+
+	read_serial(device);
+	if (device->emulated)
+		device->stream_fd = -1;
+	else
+		open_stream(device);
+
+	device->next = context->devices;
+	context->devices = device;
+	return device;
+}
+
+void blink0_close(struct blink0_device *device)
+{
+	struct blink0_device **link;
+
+	for (link = &device->context->devices; *link; link = &(*link)->next)
+	{
+		if (*link == device)
+		{
+			*link = device->next;
+			break;
+		}
+	}
+	if (device->context->resume == device)
+		device->context->resume = NULL;
+
+	close(device->fd);
+	if (device->stream_fd >= 0)
+		close(device->stream_fd);
+	free(device);
+}
+
+static bool already_open(struct blink0_context *context, const char *path)
+{
+	struct blink0_device *device;
+
+	for (device = context->devices; device; device = device->next)
+		if (!strcmp(device->path, path))
+			return true;
+
+	return false;
+}
+
+int blink0_open_all(struct blink0_context *context)
+{
+	char uevent[PATH_MAX], line[256], path[PATH_MAX];
+	unsigned bus, vendor, product, index;
+	glob_t found;
+	FILE *file;
+	bool match;
+	int opened = 0;
+
+	if (glob("/sys/class/hidraw/hidraw*", 0, NULL, &found))
+		return 0;
+
+	for (index = 0; index < found.gl_pathc; index++)
+	{
+		/* the HID device's uevent says what it is, e.g. HID_ID=0003:000027B8:000001ED */
+		snprintf(uevent, sizeof(uevent), "%s/device/uevent", found.gl_pathv[index]);
+		file = fopen(uevent, "r");
+		if (!file)
+			continue;
+		match = false;
+		while (fgets(line, sizeof(line), file))
+			if ((3 == sscanf(line, "HID_ID=%x:%x:%x", &bus, &vendor, &product)) && (BLINK0_VENDOR_ID == vendor) && (BLINK0_PRODUCT_ID == product))
+				match = true;
+		fclose(file);
+		if (!match)
+			continue;
+
+		snprintf(path, sizeof(path), "/dev/%s", basename(found.gl_pathv[index]));
+		if (already_open(context, path))
+			continue;
+		if (blink0_open(context, path))
+			opened++;
+	}
+
+	globfree(&found);
+	return opened;
+}
+
+struct blink0_device *blink0_next(struct blink0_context *context, struct blink0_device *device)
+{
+	return device ? device->next : context->devices;
+}
+
+const char *blink0_path(const struct blink0_device *device)
+{
+	return device->path;
+}
+
+const char *blink0_serial(const struct blink0_device *device)
+{
+	return device->serial;
+}
+
+unsigned blink0_features(const struct blink0_device *device)
+{
+	return device->features;
+}
+
+void blink0_get_stats(const struct blink0_device *device, struct blink0_stats *stats)
+{
+	*stats = device->stats;
+}
+
+int blink0_fade(struct blink0_device *device, uint8_t ledn, uint8_t r, uint8_t g, uint8_t b, unsigned fade_ms)
+{
+	struct change_struct *change;
+	unsigned index, kept = 0;
+
+	if (ledn > BLINK0_LED_COUNT)
+		return -EINVAL;
+	if (device->gone)
+		return -ENODEV;
+
+	/* whatever is queued for this LED (or, for all of them, everything queued) will never be seen */
+	for (index = 0; index < device->queued; index++)
+	{
+		if (!ledn || (device->queue[index].ledn == ledn))
+		{
+			device->stats.coalesced++;
+			continue;
+		}
+		device->queue[kept++] = device->queue[index];
+	}
+	device->queued = kept;
+
+	change = &device->queue[device->queued++];
+	change->ledn = ledn;
+	change->rgb[0] = r;
+	change->rgb[1] = g;
+	change->rgb[2] = b;
+	fade_ms = (fade_ms + 5) / 10;
+	change->fade_delay = (fade_ms > 0xFFFF) ? 0xFFFF : fade_ms;
+
+	device->stats.queued++;
+	return 0;
+}
+
+int blink0_set_report(struct blink0_device *device, uint8_t *report, size_t length)
+{
+	if (device->gone)
+		return -ENODEV;
+	return set_feature(device, report, length);
+}
+
+int blink0_get_report(struct blink0_device *device, uint8_t *report, size_t length)
+{
+	if (device->gone)
+		return -ENODEV;
+	return get_feature(device, report, length);
+}
+
+bool blink0_busy(const struct blink0_device *device)
+{
+	return device->queued || unconfirmed(device);
+}
+
+/* a change takes effect on the device; keep track of what every LED is heading for */
+static void note_change(struct blink0_device *device, const struct change_struct *change)
+{
+	unsigned led;
+	uint64_t settled;
+
+	for (led = 0; led < BLINK0_LED_COUNT; led++)
+		if (!change->ledn || (change->ledn == led + 1))
+			memcpy(device->target[led], change->rgb, 3);
+	if (!change->ledn)
+		device->target_known = true;
+
+	settled = now_ms() + (uint64_t)change->fade_delay * 10 + SETTLE_MS;
+	if (settled > device->settled_ms)
+		device->settled_ms = settled;
+}
+
+/*
+an Adalight frame can stand in for the whole queue when every change in it is immediate, every other LED is known
+and no longer fading, and nothing sent over HID might still be on its way to the LEDs
+*/
+static bool can_stream(const struct blink0_device *device)
+{
+	unsigned index;
+
+	if (!(device->features & BLINK0_HAS_STREAM) || !device->target_known || unconfirmed(device) || (now_ms() < device->settled_ms))
+		return false;
+
+	for (index = 0; index < device->queued; index++)
+		if (device->queue[index].fade_delay)
+			return false;
+
+	return true;
+}
+
+static int send_stream(struct blink0_device *device)
+{
+	uint8_t frame[6 + 3 * BLINK0_LED_COUNT] = { 'A', 'd', 'a', 0, BLINK0_LED_COUNT - 1, 0 };
+	unsigned index, led;
+	ssize_t written;
+
+	frame[5] = frame[3] ^ frame[4] ^ 0x55;
+
+	for (index = 0; index < device->queued; index++)
+		for (led = 0; led < BLINK0_LED_COUNT; led++)
+			if (!device->queue[index].ledn || (device->queue[index].ledn == led + 1))
+				memcpy(device->target[led], device->queue[index].rgb, 3);
+
+	for (led = 0; led < BLINK0_LED_COUNT; led++)
+		memcpy(&frame[6 + 3 * led], device->target[led], 3);
+
+	/* the frame is small enough that the tty takes it whole or not at all; if not, it goes over HID instead */
+	written = write(device->stream_fd, frame, sizeof(frame));
+	if (written != sizeof(frame))
+		return -EAGAIN;
+	trace(device, "stream", frame, sizeof(frame), 0);
+
+	device->stats.streamed += device->queued;
+	device->stats.frames++;
+	device->queued = 0;
+	device->settled_ms = now_ms() + SETTLE_MS;
+	return 0;
+}
+
+static int send_change(struct blink0_device *device)
+{
+	struct change_struct *change = &device->queue[0];
+	uint8_t report[REPORT_LEN] = { REPORT_ID_BLINK1, 'c', change->rgb[0], change->rgb[1], change->rgb[2],
+		change->fade_delay >> 8, change->fade_delay & 0xFF, change->ledn, 0 };
+	int result;
+
+	if (device->features & BLINK0_HAS_STATUS)
+		report[REPORT_SEQ_INDEX] = seq_after(device->seq);
+
+	result = set_feature(device, report, sizeof(report));
+	if (-EPIPE == result)
+	{
+		/* the firmware's command queue was full; it goes again once the status report says the device has caught up */
+		if (device->features & BLINK0_HAS_STATUS)
+			device->stalled = true;
+		device->stats.retries++;
+		return result;
+	}
+	if (result)
+		return result;
+
+	if (device->features & BLINK0_HAS_STATUS)
+		device->seq = report[REPORT_SEQ_INDEX];
+	note_change(device, change);
+	device->stats.sent++;
+
+	device->queued--;
+	memmove(&device->queue[0], &device->queue[1], device->queued * sizeof(device->queue[0]));
+	return 0;
+}
+
+static void read_inputs(struct blink0_device *device)
+{
+	uint8_t report[1 + 64];
+	ssize_t length;
+
+	if (device->input_held)
+	{
+		device->input_held = false;
+		take_status(device, device->input);
+	}
+
+	for (;;)
+	{
+		if (device->emulated)
+		{
+			length = recv(device->fd, report, sizeof(report), MSG_DONTWAIT);
+			if (0 == length)
+			{
+				failed(device, ENODEV);
+				return;
+			}
+			if ((length > 0) && (BLINK0_EMU_INPUT != report[0]))
+				continue;
+			if (length > 0)
+				memmove(report, report + 1, --length);
+		}
+		else
+			length = read(device->fd, report, sizeof(report));
+
+		if (length < 0)
+		{
+			if ((EAGAIN != errno) && (EINTR != errno))
+				failed(device, errno);
+			return;
+		}
+		if ((length >= STATUS_LEN) && (REPORT_ID_STATUS == report[0]))
+			take_status(device, report);
+	}
+}
+
+static void process_device(struct blink0_device *device)
+{
+	unsigned transfers = 0;
+
+	read_inputs(device);
+
+	if (device->queued && can_stream(device) && !send_stream(device))
+		return;
+
+	while (device->queued && !device->gone && (transfers < TRANSFER_BUDGET))
+	{
+		/* the device can only hold so many commands; find out how far it has got before sending more */
+		if (device->stalled || (unconfirmed(device) >= COMMAND_COUNT))
+		{
+			transfers++;
+			if (get_status(device) || (unconfirmed(device) >= COMMAND_COUNT))
+				return;
+			continue;
+		}
+
+		transfers++;
+		if (send_change(device))
+			return;
+	}
+
+	/* everything has gone; one GET_REPORT confirms the whole burst */
+	if (!device->queued && unconfirmed(device) && !device->gone && (transfers < TRANSFER_BUDGET))
+		get_status(device);
+}
+
+int blink0_process(struct blink0_context *context)
+{
+	struct blink0_device *device, *next, *start;
+
+	/* carry on from the device after the one that went first last time */
+	start = context->resume ? context->resume : context->devices;
+	device = start;
+	while (device)
+	{
+		process_device(device);
+		device = device->next ? device->next : context->devices;
+		if (device == start)
+			break;
+	}
+	context->resume = (start && start->next) ? start->next : context->devices;
+
+	for (device = context->devices; device; device = next)
+	{
+		next = device->next;
+		if (device->gone)
+		{
+			event(device, BLINK0_EVENT_GONE, 0);
+			blink0_close(device);
+		}
+	}
+
+	return 0;
+}
+
+int blink0_pollfds(struct blink0_context *context, struct pollfd *fds, unsigned max)
+{
+	struct blink0_device *device;
+	unsigned count = 0;
+
+	for (device = context->devices; device && (count < max); device = device->next)
+	{
+		fds[count].fd = device->fd;
+		fds[count].events = POLLIN;
+		fds[count].revents = 0;
+		count++;
+	}
+
+	return count;
+}
+
+int blink0_timeout(struct blink0_context *context)
+{
+	struct blink0_device *device;
+	int timeout = -1;
+
+	for (device = context->devices; device; device = device->next)
+	{
+		if (device->input_held)
+			return 0;
+		if (device->queued && !device->stalled && (unconfirmed(device) < COMMAND_COUNT))
+			return 0;
+		/* a device that has fallen behind, or a burst that didn't get confirmed in one go, is tried again shortly */
+		if (device->queued || unconfirmed(device))
+			timeout = 10;
+	}
+
+	return timeout;
+}
+
+int blink0_flush(struct blink0_context *context, int timeout_ms)
+{
+	struct pollfd fds[64];
+	struct blink0_device *device;
+	uint64_t give_up = now_ms() + timeout_ms;
+	int count, wait;
+	bool busy;
+
+	for (;;)
+	{
+		blink0_process(context);
+
+		busy = false;
+		for (device = context->devices; device; device = device->next)
+			busy |= blink0_busy(device);
+		if (!busy)
+			return 0;
+		if (now_ms() >= give_up)
+			return -ETIMEDOUT;
+
+		count = blink0_pollfds(context, fds, sizeof(fds) / sizeof(fds[0]));
+		wait = blink0_timeout(context);
+		if ((wait < 0) || (wait > (int)(give_up - now_ms())))
+			wait = give_up - now_ms();
+		if (poll(fds, count, wait) < 0 && (EINTR != errno))
+			return -errno;
+	}
+}
+
+void blink0_trace(struct blink0_context *context, FILE *file)
+{
+	context->trace = file;
+}
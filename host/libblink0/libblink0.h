@@ -0,0 +1,174 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+libblink0: drives any number of blink0s (or Blink(1)s) from one thread, through Linux hidraw
+
+every call that changes an LED only queues the change, and returns straight away; blink0_process() sends what is
+queued and reads what the devices have to say, and fits in a poll() loop alongside anything else; a change to an LED
+that is still queued when a newer one for the same LED comes along is dropped, so a device that is being sent colours
+faster than it can take them only ever gets the latest ones
+
+what the firmware advertises decides how commands go:
+  - report ID 1 (every Blink(1) and blink0) carries each change as a 'c' command
+  - with the status report (ID 2), commands are sent back to back with sequence numbers, and a whole burst is confirmed
+    with one GET_REPORT; events (such as a fade finishing) arrive as input reports, without polling
+  - with the readback report (ID 3), the colours the LEDs already show are read when the device is opened
+  - with the CDC serial port (BLINK0_CDC), a burst of changes that are all immediate goes out as one Adalight frame
+    on the serial port instead, with no round trip at all
+
+hidraw only does feature reports synchronously, so a SET_REPORT still waits for its control transfer (a couple of
+milliseconds); blink0_process() does no more than a few of those per device per call, going round the devices in turn,
+so no one device holds the others up
+
+a device can also be blink0-emu, the firmware running on the PC, through a Unix socket rather than hidraw: its path
+is then "unix:" and the socket's path
+
+functions returning int give zero (or a count) on success and a negative errno on failure
+*/
+
+#ifndef LIBBLINK0_H
+#define LIBBLINK0_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <poll.h>
+
+#define BLINK0_VENDOR_ID  0x27B8
+#define BLINK0_PRODUCT_ID 0x01ED
+#define BLINK0_LED_COUNT  18
+
+/* what a device advertised when it was opened */
+#define BLINK0_HAS_STATUS   0x01 /* sequence numbers, the status report, and status input reports */
+#define BLINK0_HAS_READBACK 0x02 /* the readback report */
+#define BLINK0_HAS_STREAM   0x04 /* the CDC serial port, for Adalight frames */
+
+enum blink0_event
+{
+	BLINK0_EVENT_APPLIED,   /* the device has applied every command up to this sequence number */
+	BLINK0_EVENT_FADE_DONE, /* at least one LED finished its fade */
+	BLINK0_EVENT_LOST,      /* the device dropped a command (value holds the status flags) */
+	BLINK0_EVENT_GONE,      /* the device went away; it is closed once the callback returns */
+};
+
+/*
+blink0-emu's socket (SOCK_SEQPACKET), one message per packet, each starting with what it is:
+  'S' report...    SET_REPORT of a feature report; answered by 'S' and an errno (zero, or EPIPE for a STALL)
+  'G' id length    GET_REPORT; answered by 'G', an errno, and the report
+  'D'              answered by 'D' and the HID report descriptor
+  'U'              answered by 'U' and the serial number
+  'I' report...    sent by the device, unasked, for each input report
+*/
+#define BLINK0_EMU_SET_REPORT 'S'
+#define BLINK0_EMU_GET_REPORT 'G'
+#define BLINK0_EMU_DESCRIPTOR 'D'
+#define BLINK0_EMU_SERIAL     'U'
+#define BLINK0_EMU_INPUT      'I'
+
+struct blink0_stats
+{
+	unsigned queued;    /* changes asked for */
+	unsigned coalesced; /* of those, how many a later change replaced before they were sent */
+	unsigned sent;      /* 'c' commands sent as SET_REPORTs */
+	unsigned streamed;  /* changes sent in Adalight frames */
+	unsigned frames;    /* Adalight frames */
+	unsigned statuses;  /* status reports read, by GET_REPORT or as input reports */
+	unsigned retries;   /* SET_REPORTs the device stalled because its command queue was full */
+	unsigned lost;      /* commands the device said it lost */
+};
+
+struct blink0_context;
+struct blink0_device;
+
+typedef void (*blink0_callback)(struct blink0_device *device, enum blink0_event event, unsigned value, void *user);
+
+struct blink0_context *blink0_init(blink0_callback callback, void *user);
+void blink0_exit(struct blink0_context *context);
+
+/* open every blink0 under /sys/class/hidraw that isn't already open; returns how many were opened */
+int blink0_open_all(struct blink0_context *context);
+
+/* open one device by its hidraw node (e.g. /dev/hidraw3), or blink0-emu by its socket (e.g. unix:/tmp/blink0.sock) */
+struct blink0_device *blink0_open(struct blink0_context *context, const char *path);
+void blink0_close(struct blink0_device *device);
+
+/* the devices that are open, one after another (NULL to start, and at the end) */
+struct blink0_device *blink0_next(struct blink0_context *context, struct blink0_device *device);
+
+const char *blink0_path(const struct blink0_device *device);
+
+/* the USB serial number (the one the bootloader keeps at 0x81EE in flash), or "" if there is none to be had */
+const char *blink0_serial(const struct blink0_device *device);
+unsigned blink0_features(const struct blink0_device *device);
+void blink0_get_stats(const struct blink0_device *device, struct blink0_stats *stats);
+
+/*
+fade LED ledn (1 to BLINK0_LED_COUNT, or 0 for all of them) to a colour over fade_ms (to the nearest 10ms; zero is
+immediate); this only queues it
+*/
+int blink0_fade(struct blink0_device *device, uint8_t ledn, uint8_t r, uint8_t g, uint8_t b, unsigned fade_ms);
+
+/*
+a feature report straight to or from the device (report[0] is the report ID), bypassing the queue, for programs that
+measure the device itself; a SET_REPORT the device stalls gives -EPIPE
+*/
+int blink0_set_report(struct blink0_device *device, uint8_t *report, size_t length);
+int blink0_get_report(struct blink0_device *device, uint8_t *report, size_t length);
+
+/* true while a device has changes queued, or sent but not yet confirmed */
+bool blink0_busy(const struct blink0_device *device);
+
+/*
+for a poll() loop: the file descriptors to wait on (returns how many were filled in), and how long poll() may wait
+before blink0_process() next needs calling (zero while there is something to send, -1 if it can wait forever)
+*/
+int blink0_pollfds(struct blink0_context *context, struct pollfd *fds, unsigned max);
+int blink0_timeout(struct blink0_context *context);
+
+/* send what is queued and read what has arrived, calling the callback as things happen */
+int blink0_process(struct blink0_context *context);
+
+/* poll() and blink0_process() until nothing is left to send or confirm, or timeout_ms has gone by */
+int blink0_flush(struct blink0_context *context, int timeout_ms);
+
+/*
+record every feature report transfer, and every frame written to the CDC serial port, to a file (NULL to stop), one
+line each, for blink0-replay to play back:
+  <microseconds> <device> set <report in hex> [stall]
+  <microseconds> <device> get <report ID> <length>
+  <microseconds> <device> stream <frame in hex>
+the time is CLOCK_MONOTONIC, and the device is its path
+*/
+void blink0_trace(struct blink0_context *context, FILE *file);
+
+#endif /* LIBBLINK0_H */
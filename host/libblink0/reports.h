@@ -0,0 +1,61 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+the layout of blink0's HID reports, as the host tools see it; these mirror blink0.h in the firmware, which can't be
+included from here as it pulls in usb_config.h and the rest of the stack, and are shared by libblink0 and the tools
+that drive a device themselves, so that a change to a report only has to be made here
+*/
+
+#ifndef REPORTS_H
+#define REPORTS_H
+
+#define REPORT_ID_BLINK1   0x01
+#define REPORT_ID_STATUS   0x02
+#define REPORT_ID_READBACK 0x03
+#define REPORT_LEN         9
+#define REPORT_SEQ_INDEX   8
+
+#define STATUS_LEN         9
+#define STATUS_SEQ         1
+#define STATUS_FLAGS       2
+#define STATUS_EVENTS      3
+#define STATUS_RECEIVED    4
+#define STATUS_APPLIED     6
+#define STATUS_LIT         7
+#define STATUS_STAMPED_SEQ 8
+#define STATUS_FLAG_DROPPED   0x01
+#define STATUS_FLAG_OVERFLOW  0x02
+#define STATUS_EVENT_FADE_DONE 0x01
+
+#define COMMAND_COUNT      4 /* commands the firmware can hold before it stalls the next SET_REPORT */
+
+#endif /* REPORTS_H */
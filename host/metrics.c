@@ -0,0 +1,179 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "metrics.h"
+
+struct metric_struct
+{
+	char name[48];
+	double value;
+};
+
+static struct metric_struct metrics[256];
+static unsigned metric_count;
+
+void metric(const char *name, double value)
+{
+	if (metric_count == sizeof(metrics) / sizeof(metrics[0]))
+		return;
+
+	snprintf(metrics[metric_count].name, sizeof(metrics[0].name), "%s", name);
+	metrics[metric_count].value = value;
+	metric_count++;
+}
+
+void samples_add(struct samples_struct *samples, double value)
+{
+	double *grown;
+
+	if (samples->count == samples->size)
+	{
+		grown = realloc(samples->values, (samples->size ? 2 * samples->size : 256) * sizeof(*grown));
+		if (!grown)
+			return;
+		samples->values = grown;
+		samples->size = samples->size ? 2 * samples->size : 256;
+	}
+
+	samples->values[samples->count++] = value;
+}
+
+void samples_clear(struct samples_struct *samples)
+{
+	free(samples->values);
+	memset(samples, 0, sizeof(*samples));
+}
+
+static int ascending(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* the nearest-rank percentile of sorted values */
+static double percentile(const struct samples_struct *samples, unsigned percent)
+{
+	unsigned rank = (samples->count * percent + 99) / 100;
+
+	return samples->values[rank ? rank - 1 : 0];
+}
+
+void samples_metrics(const char *prefix, struct samples_struct *samples)
+{
+	static const unsigned percents[] = { 50, 90, 99 };
+	char name[48];
+	double sum = 0.0;
+	unsigned index;
+
+	snprintf(name, sizeof(name), "%s.count", prefix);
+	metric(name, samples->count);
+	if (!samples->count)
+		return;
+
+	qsort(samples->values, samples->count, sizeof(samples->values[0]), ascending);
+	for (index = 0; index < samples->count; index++)
+		sum += samples->values[index];
+
+	snprintf(name, sizeof(name), "%s.min", prefix);
+	metric(name, samples->values[0]);
+	snprintf(name, sizeof(name), "%s.mean", prefix);
+	metric(name, sum / samples->count);
+	for (index = 0; index < sizeof(percents) / sizeof(percents[0]); index++)
+	{
+		snprintf(name, sizeof(name), "%s.p%u", prefix, percents[index]);
+		metric(name, percentile(samples, percents[index]));
+	}
+	snprintf(name, sizeof(name), "%s.max", prefix);
+	metric(name, samples->values[samples->count - 1]);
+}
+
+void print_metrics(FILE *out)
+{
+	unsigned index;
+
+	fprintf(out, "{\n");
+	for (index = 0; index < metric_count; index++)
+		fprintf(out, "\t\"%s\": %.10g%s\n", metrics[index].name, metrics[index].value, (index + 1 < metric_count) ? "," : "");
+	fprintf(out, "}\n");
+}
+
+int compare_metrics(const char *path, double tolerance)
+{
+	FILE *file;
+	char line[256], name[48];
+	double value;
+	size_t length;
+	unsigned index;
+	int regressions = 0;
+	bool worse;
+
+	file = fopen(path, "r");
+	if (!file)
+	{
+		perror(path);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), file))
+	{
+		if (2 != sscanf(line, " \"%47[^\"]\": %lf", name, &value))
+			continue;
+
+		for (index = 0; index < metric_count; index++)
+			if (!strcmp(name, metrics[index].name))
+				break;
+		if (index == metric_count)
+		{
+			fprintf(stderr, "%s: no longer measured\n", name);
+			continue;
+		}
+
+		if (metrics[index].value == value)
+			continue;
+
+		length = strlen(name);
+		if ((length >= 6) && !strcmp(name + length - 6, "_per_s"))
+			worse = metrics[index].value < value * (1.0 - tolerance / 100.0);
+		else
+			worse = metrics[index].value > value * (1.0 + tolerance / 100.0);
+		fprintf(stderr, "%s: %.10g -> %.10g%s\n", name, value, metrics[index].value, worse ? " REGRESSION" : "");
+		if (worse)
+			regressions++;
+	}
+
+	fclose(file);
+	return regressions;
+}
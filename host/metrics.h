@@ -0,0 +1,65 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+the results of the host benchmarks: named values, printed as a JSON object, and checked against an earlier run's output
+so that anything that went up (latencies, drops, overruns) is caught from one firmware version to the next
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+
+/* every value of something measured over a run, from which its percentiles are taken */
+struct samples_struct
+{
+	double *values;
+	unsigned count, size;
+};
+
+void metric(const char *name, double value);
+
+void samples_add(struct samples_struct *samples, double value);
+void samples_clear(struct samples_struct *samples);
+
+/* prefix.count, .min, .mean, .p50, .p90, .p99 and .max (only the count, if there are none) */
+void samples_metrics(const char *prefix, struct samples_struct *samples);
+
+void print_metrics(FILE *out);
+
+/*
+returns how many metrics got worse by more than the tolerance (in percent), or -1 if the file can't be read; a metric
+whose name ends in "_per_s" (a rate) gets worse by going down, and any other by going up
+*/
+int compare_metrics(const char *path, double tolerance);
+
+#endif /* METRICS_H */
@@ -0,0 +1,595 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+pic16-test: checks the instruction-level simulator in pic16.c against the PIC16F1454 datasheet
+
+each test loads a few hand-assembled instructions at address 0, sets up W, STATUS and the file registers they use,
+executes them one at a time, and checks the results, the flags and the cycles they took; a failed check is printed
+with its line number, and the exit status is 1 if any failed
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pic16.h"
+
+/* instruction encodings, from the datasheet's instruction set summary */
+#define ADDWF(f, d)   (0x0700 | ((d) << 7) | (f))
+#define ADDWFC(f, d)  (0x3D00 | ((d) << 7) | (f))
+#define ANDWF(f, d)   (0x0500 | ((d) << 7) | (f))
+#define ASRF(f, d)    (0x3700 | ((d) << 7) | (f))
+#define LSLF(f, d)    (0x3500 | ((d) << 7) | (f))
+#define LSRF(f, d)    (0x3600 | ((d) << 7) | (f))
+#define CLRF(f)       (0x0180 | (f))
+#define CLRW          0x0100
+#define COMF(f, d)    (0x0900 | ((d) << 7) | (f))
+#define DECF(f, d)    (0x0300 | ((d) << 7) | (f))
+#define INCF(f, d)    (0x0A00 | ((d) << 7) | (f))
+#define IORWF(f, d)   (0x0400 | ((d) << 7) | (f))
+#define MOVF(f, d)    (0x0800 | ((d) << 7) | (f))
+#define MOVWF(f)      (0x0080 | (f))
+#define RLF(f, d)     (0x0D00 | ((d) << 7) | (f))
+#define RRF(f, d)     (0x0C00 | ((d) << 7) | (f))
+#define SUBWF(f, d)   (0x0200 | ((d) << 7) | (f))
+#define SUBWFB(f, d)  (0x3B00 | ((d) << 7) | (f))
+#define SWAPF(f, d)   (0x0E00 | ((d) << 7) | (f))
+#define XORWF(f, d)   (0x0600 | ((d) << 7) | (f))
+#define DECFSZ(f, d)  (0x0B00 | ((d) << 7) | (f))
+#define INCFSZ(f, d)  (0x0F00 | ((d) << 7) | (f))
+#define BCF(f, b)     (0x1000 | ((b) << 7) | (f))
+#define BSF(f, b)     (0x1400 | ((b) << 7) | (f))
+#define BTFSC(f, b)   (0x1800 | ((b) << 7) | (f))
+#define BTFSS(f, b)   (0x1C00 | ((b) << 7) | (f))
+#define ADDLW(k)      (0x3E00 | (k))
+#define ANDLW(k)      (0x3900 | (k))
+#define IORLW(k)      (0x3800 | (k))
+#define MOVLB(k)      (0x0020 | (k))
+#define MOVLP(k)      (0x3180 | (k))
+#define MOVLW(k)      (0x3000 | (k))
+#define RETLW(k)      (0x3400 | (k))
+#define SUBLW(k)      (0x3C00 | (k))
+#define XORLW(k)      (0x3A00 | (k))
+#define BRA(k)        (0x3200 | ((k) & 0x1FF))
+#define BRW           0x000B
+#define CALL(k)       (0x2000 | (k))
+#define CALLW         0x000A
+#define GOTO(k)       (0x2800 | (k))
+#define RETFIE        0x0009
+#define RETURN        0x0008
+#define NOP           0x0000
+#define SLEEP         0x0063
+#define ADDFSR(n, k)  (0x3100 | ((n) << 6) | ((k) & 0x3F))
+#define MOVIW_PRE_INC(n)  (0x0010 | ((n) << 2))
+#define MOVIW_PRE_DEC(n)  (0x0011 | ((n) << 2))
+#define MOVIW_POST_INC(n) (0x0012 | ((n) << 2))
+#define MOVIW_POST_DEC(n) (0x0013 | ((n) << 2))
+#define MOVWI_POST_INC(n) (0x001A | ((n) << 2))
+#define MOVIW_K(n, k)     (0x3F00 | ((n) << 6) | ((k) & 0x3F))
+#define MOVWI_K(n, k)     (0x3F80 | ((n) << 6) | ((k) & 0x3F))
+
+#define W 0
+#define F 1
+
+/* general purpose RAM in bank 0 */
+#define GPR 0x20
+
+#define STATUS_TO 0x10
+#define STATUS_PD 0x08
+
+static struct pic16 pic;
+static unsigned checks, failures;
+
+#define CHECK(what, got, want) check(__LINE__, what, got, want)
+
+static void check(int line, const char *what, unsigned got, unsigned want)
+{
+	checks++;
+	if (got == want)
+		return;
+
+	failures++;
+	printf("line %d: %s is 0x%x, expected 0x%x\n", line, what, got, want);
+}
+
+/* load a program at address 0 (the rest of flash unprogrammed), and reset the core with W and STATUS as given */
+static void load(const uint16_t *program, unsigned words, uint8_t w, uint8_t status)
+{
+	memset(pic.flash, 0, sizeof(pic.flash));
+	memset(pic.programmed, 0, sizeof(pic.programmed));
+	memcpy(pic.flash, program, words * sizeof(program[0]));
+	memset(pic.programmed, true, words);
+
+	pic.cycles = 0;
+	pic16_reset(&pic);
+	pic16_poke(&pic, PIC16_WREG, w);
+	pic16_poke(&pic, PIC16_STATUS, (pic16_peek(&pic, PIC16_STATUS) & ~0x07) | status);
+}
+
+/* execute count instructions; returns the cycles they took */
+static unsigned run(unsigned count)
+{
+	uint64_t start = pic.cycles;
+
+	while (count--)
+		pic16_step(&pic);
+	return pic.cycles - start;
+}
+
+static unsigned wreg(void)
+{
+	return pic16_peek(&pic, PIC16_WREG);
+}
+
+static unsigned flags(void)
+{
+	return pic16_peek(&pic, PIC16_STATUS) & (PIC16_C | PIC16_DC | PIC16_Z);
+}
+
+static unsigned file(uint16_t address)
+{
+	return pic16_peek(&pic, address);
+}
+
+static void test_arithmetic(void)
+{
+	uint16_t addwf[] = { ADDWF(GPR, W), ADDWF(GPR + 1, F) };
+	uint16_t addwfc[] = { ADDWFC(GPR, F) };
+	uint16_t subwf[] = { SUBWF(GPR, W), SUBWF(GPR + 1, F) };
+	uint16_t subwfb[] = { SUBWFB(GPR, F) };
+	uint16_t literal[] = { ADDLW(0x01), SUBLW(0x10), SUBLW(0x00) };
+
+	/* W + f: the digit carry comes out of bit 3, the carry out of bit 7 */
+	load(addwf, 2, 0x0F, 0);
+	pic16_poke(&pic, GPR, 0x01);
+	pic16_poke(&pic, GPR + 1, 0xF1);
+	CHECK("ADDWF cycles", run(1), 1);
+	CHECK("ADDWF W", wreg(), 0x10);
+	CHECK("ADDWF flags", flags(), PIC16_DC);
+	CHECK("ADDWF f untouched", file(GPR), 0x01);
+	run(1);
+	CHECK("ADDWF,F f", file(GPR + 1), 0x01);
+	CHECK("ADDWF,F flags", flags(), PIC16_C);
+
+	/* the carry in is added too */
+	load(addwfc, 1, 0x01, PIC16_C);
+	pic16_poke(&pic, GPR, 0xFE);
+	run(1);
+	CHECK("ADDWFC f", file(GPR), 0x00);
+	CHECK("ADDWFC flags", flags(), PIC16_C | PIC16_DC | PIC16_Z);
+
+	/* f - W: the carry is set when there was no borrow */
+	load(subwf, 2, 0x06, 0);
+	pic16_poke(&pic, GPR, 0x05);
+	pic16_poke(&pic, GPR + 1, 0x06);
+	run(1);
+	CHECK("SUBWF W", wreg(), 0xFF);
+	CHECK("SUBWF flags (borrow)", flags(), 0);
+	pic16_poke(&pic, PIC16_WREG, 0x06);
+	run(1);
+	CHECK("SUBWF,F f", file(GPR + 1), 0x00);
+	CHECK("SUBWF,F flags", flags(), PIC16_C | PIC16_DC | PIC16_Z);
+
+	/* f - W - borrow, where a clear carry is a borrow */
+	load(subwfb, 1, 0x01, 0);
+	pic16_poke(&pic, GPR, 0x10);
+	run(1);
+	CHECK("SUBWFB f", file(GPR), 0x0E);
+	CHECK("SUBWFB flags", flags(), PIC16_C);
+
+	/* ADDLW is W + k, SUBLW is k - W */
+	load(literal, 3, 0xFF, 0);
+	run(1);
+	CHECK("ADDLW W", wreg(), 0x00);
+	CHECK("ADDLW flags", flags(), PIC16_C | PIC16_DC | PIC16_Z);
+	pic16_poke(&pic, PIC16_WREG, 0x01);
+	run(1);
+	CHECK("SUBLW W", wreg(), 0x0F);
+	CHECK("SUBLW flags", flags(), PIC16_C);
+	run(1);
+	CHECK("SUBLW W (borrow)", wreg(), 0xF1);
+	CHECK("SUBLW flags (borrow)", flags(), 0);
+}
+
+static void test_logic(void)
+{
+	uint16_t program[] = { ANDWF(GPR, F), IORWF(GPR, W), XORWF(GPR, F), ANDLW(0x00), IORLW(0x81), XORLW(0x81), COMF(GPR, F), SWAPF(GPR + 1, F) };
+
+	/* the logical operations only touch Z */
+	load(program, 8, 0x3C, PIC16_C | PIC16_DC);
+	pic16_poke(&pic, GPR, 0xF0);
+	pic16_poke(&pic, GPR + 1, 0x12);
+	run(1);
+	CHECK("ANDWF f", file(GPR), 0x30);
+	CHECK("ANDWF flags", flags(), PIC16_C | PIC16_DC);
+	run(1);
+	CHECK("IORWF W", wreg(), 0x3C);
+	run(1);
+	CHECK("XORWF f", file(GPR), 0x0C);
+	run(1);
+	CHECK("ANDLW W", wreg(), 0x00);
+	CHECK("ANDLW flags", flags(), PIC16_C | PIC16_DC | PIC16_Z);
+	run(1);
+	CHECK("IORLW W", wreg(), 0x81);
+	CHECK("IORLW flags", flags(), PIC16_C | PIC16_DC);
+	run(1);
+	CHECK("XORLW W", wreg(), 0x00);
+	CHECK("XORLW flags", flags(), PIC16_C | PIC16_DC | PIC16_Z);
+	run(1);
+	CHECK("COMF f", file(GPR), 0xF3);
+	CHECK("COMF flags", flags(), PIC16_C | PIC16_DC);
+
+	/* SWAPF touches no flags at all */
+	pic16_poke(&pic, PIC16_STATUS, pic16_peek(&pic, PIC16_STATUS) | PIC16_Z);
+	run(1);
+	CHECK("SWAPF f", file(GPR + 1), 0x21);
+	CHECK("SWAPF flags", flags(), PIC16_C | PIC16_DC | PIC16_Z);
+}
+
+static void test_increment(void)
+{
+	uint16_t program[] = { INCF(GPR, F), DECF(GPR, F), DECF(GPR, W), CLRF(GPR + 1), CLRW, MOVF(GPR + 2, W), MOVF(GPR + 3, F), MOVWF(GPR + 4) };
+
+	/* INCF and DECF set Z but leave the carry alone */
+	load(program, 8, 0x55, PIC16_C);
+	pic16_poke(&pic, GPR, 0xFF);
+	pic16_poke(&pic, GPR + 1, 0x77);
+	pic16_poke(&pic, GPR + 2, 0x00);
+	pic16_poke(&pic, GPR + 3, 0x80);
+	run(1);
+	CHECK("INCF f", file(GPR), 0x00);
+	CHECK("INCF flags", flags(), PIC16_C | PIC16_Z);
+	run(1);
+	CHECK("DECF f", file(GPR), 0xFF);
+	CHECK("DECF flags", flags(), PIC16_C);
+	run(1);
+	CHECK("DECF,W W", wreg(), 0xFE);
+	CHECK("DECF,W f untouched", file(GPR), 0xFF);
+	run(1);
+	CHECK("CLRF f", file(GPR + 1), 0x00);
+	CHECK("CLRF flags", flags(), PIC16_C | PIC16_Z);
+	run(1);
+	CHECK("CLRW W", wreg(), 0x00);
+
+	/* MOVF sets Z from the value moved, and MOVF f,F is how a register is tested */
+	run(1);
+	CHECK("MOVF,W flags", flags(), PIC16_C | PIC16_Z);
+	run(1);
+	CHECK("MOVF,F f", file(GPR + 3), 0x80);
+	CHECK("MOVF,F flags", flags(), PIC16_C);
+	pic16_poke(&pic, PIC16_WREG, 0xA5);
+	run(1);
+	CHECK("MOVWF f", file(GPR + 4), 0xA5);
+	CHECK("MOVWF flags", flags(), PIC16_C);
+}
+
+static void test_shifts(void)
+{
+	uint16_t program[] = { RLF(GPR, F), RRF(GPR + 1, F), LSLF(GPR + 2, F), LSRF(GPR + 3, F), ASRF(GPR + 4, F), ASRF(GPR + 5, W) };
+
+	/* RLF and RRF rotate through the carry, and leave Z alone */
+	load(program, 6, 0, PIC16_C | PIC16_Z);
+	pic16_poke(&pic, GPR, 0x80);
+	pic16_poke(&pic, GPR + 1, 0x00);
+	pic16_poke(&pic, GPR + 2, 0x81);
+	pic16_poke(&pic, GPR + 3, 0x01);
+	pic16_poke(&pic, GPR + 4, 0x82);
+	pic16_poke(&pic, GPR + 5, 0x40);
+	run(1);
+	CHECK("RLF f", file(GPR), 0x01);
+	CHECK("RLF flags", flags(), PIC16_C | PIC16_Z);
+	run(1);
+	CHECK("RRF f", file(GPR + 1), 0x80);
+	CHECK("RRF flags", flags(), PIC16_Z);
+
+	/* the shifts shift a zero in (or the sign bit, for ASRF), and set both C and Z */
+	run(1);
+	CHECK("LSLF f", file(GPR + 2), 0x02);
+	CHECK("LSLF flags", flags(), PIC16_C);
+	run(1);
+	CHECK("LSRF f", file(GPR + 3), 0x00);
+	CHECK("LSRF flags", flags(), PIC16_C | PIC16_Z);
+	run(1);
+	CHECK("ASRF f", file(GPR + 4), 0xC1);
+	CHECK("ASRF flags", flags(), 0);
+	run(1);
+	CHECK("ASRF,W W", wreg(), 0x20);
+}
+
+static void test_bits_and_skips(void)
+{
+	uint16_t bits[] = { BSF(GPR, 7), BCF(GPR, 0), BTFSC(GPR, 0), NOP, BTFSS(GPR, 0), NOP };
+	uint16_t counts[] = { DECFSZ(GPR, F), DECFSZ(GPR, F), NOP, INCFSZ(GPR + 1, W), NOP };
+
+	load(bits, 6, 0, 0);
+	pic16_poke(&pic, GPR, 0x01);
+	run(2);
+	CHECK("BSF/BCF f", file(GPR), 0x80);
+
+	/* a skip turns the next instruction into a NOP: two cycles, and past it */
+	CHECK("BTFSC cycles (skip)", run(1), 2);
+	CHECK("BTFSC PC (skip)", pic.pc, 4);
+	CHECK("BTFSS cycles (no skip)", run(1), 1);
+	CHECK("BTFSS PC (no skip)", pic.pc, 5);
+
+	/* DECFSZ and INCFSZ skip when the result is zero, and touch no flags */
+	load(counts, 5, 0, 0);
+	pic16_poke(&pic, GPR, 0x02);
+	pic16_poke(&pic, GPR + 1, 0xFF);
+	CHECK("DECFSZ cycles (no skip)", run(1), 1);
+	CHECK("DECFSZ f", file(GPR), 0x01);
+	CHECK("DECFSZ cycles (skip)", run(1), 2);
+	CHECK("DECFSZ PC (skip)", pic.pc, 3);
+	CHECK("DECFSZ flags", flags(), 0);
+	CHECK("INCFSZ cycles (skip)", run(1), 2);
+	CHECK("INCFSZ W", wreg(), 0x00);
+	CHECK("INCFSZ f untouched", file(GPR + 1), 0xFF);
+}
+
+static void test_branches(void)
+{
+	uint16_t jumps[] = { MOVLP(0x08), GOTO(0x005) };
+	uint16_t calls[] = { CALL(0x003), MOVLW(0x11), NOP, CALL(0x005), RETURN, RETLW(0x42) };
+	uint16_t relative[] = { BRA(2), NOP, NOP, BRA(-1) };
+	uint16_t computed[] = { MOVLW(0x02), BRW, NOP, NOP, NOP, MOVLP(0x01), MOVLW(0x23), CALLW };
+	uint16_t pcl[] = { MOVLP(0x01), MOVLW(0x10), MOVWF(PIC16_PCL) };
+
+	/* GOTO and CALL take the top of the address from PCLATH<6:3> */
+	load(jumps, 2, 0, 0);
+	run(1);
+	CHECK("GOTO cycles", run(1), 2);
+	CHECK("GOTO PC", pic.pc, 0x0805);
+
+	/* CALL, a nested CALL, RETLW and RETURN */
+	load(calls, 6, 0, 0);
+	CHECK("CALL cycles", run(1), 2);
+	CHECK("CALL PC", pic.pc, 3);
+	CHECK("CALL depth", pic.depth, 1);
+	run(1);
+	CHECK("nested CALL depth", pic.depth, 2);
+	CHECK("RETLW cycles", run(1), 2);
+	CHECK("RETLW W", wreg(), 0x42);
+	CHECK("RETLW PC", pic.pc, 4);
+	CHECK("RETURN cycles", run(1), 2);
+	CHECK("RETURN PC", pic.pc, 1);
+	CHECK("RETURN depth", pic.depth, 0);
+	CHECK("deepest stack", pic.max_depth, 2);
+
+	/* BRA is relative to the instruction after it, in either direction */
+	load(relative, 4, 0, 0);
+	CHECK("BRA cycles", run(1), 2);
+	CHECK("BRA PC (forward)", pic.pc, 3);
+	run(1);
+	CHECK("BRA PC (back to itself)", pic.pc, 3);
+
+	/* BRW adds W to the address of the next instruction; CALLW calls PCLATH:W */
+	load(computed, 8, 0, 0);
+	run(1);
+	CHECK("BRW cycles", run(1), 2);
+	CHECK("BRW PC", pic.pc, 4);
+	pic.pc = 5;
+	run(2);
+	CHECK("CALLW cycles", run(1), 2);
+	CHECK("CALLW PC", pic.pc, 0x0123);
+	CHECK("CALLW return address", pic.stack[0], 8);
+
+	/* a write to PCL is a computed jump to PCLATH:value, and takes an extra cycle */
+	load(pcl, 3, 0, 0);
+	run(2);
+	CHECK("MOVWF PCL cycles", run(1), 2);
+	CHECK("MOVWF PCL PC", pic.pc, 0x0110);
+}
+
+static void test_banks(void)
+{
+	uint16_t program[] = { MOVLB(1), MOVWF(GPR), MOVLB(31), MOVWF(0x70), MOVF(PIC16_WREG, W), MOVLB(2), MOVF(0x70, W) };
+
+	load(program, 7, 0x5A, 0);
+	run(1);
+	CHECK("MOVLB BSR", pic16_peek(&pic, PIC16_BSR), 1);
+	run(1);
+	CHECK("banked write", file(0x80 + GPR), 0x5A);
+	CHECK("bank 0 untouched", file(GPR), 0x00);
+
+	/* the common RAM (0x70 to 0x7F) and the core registers are the same in every bank */
+	run(2);
+	CHECK("common RAM", file(0x70), 0x5A);
+	run(1);
+	CHECK("WREG through bank 31", wreg(), 0x5A);
+	pic16_poke(&pic, PIC16_WREG, 0);
+	run(2);
+	CHECK("common RAM through bank 2", wreg(), 0x5A);
+}
+
+static void test_indirect(void)
+{
+	uint16_t program[] = {
+		MOVIW_PRE_INC(0), MOVIW_POST_DEC(0), MOVIW_PRE_DEC(0), MOVIW_POST_INC(0),
+		MOVWI_POST_INC(1), MOVWI_K(1, -2), MOVIW_K(1, 31),
+		ADDFSR(0, -1), MOVF(PIC16_INDF0, W), MOVIW_K(1, 0),
+		RETLW(0x99)
+	};
+
+	/* FSR0 works through linear memory: 0x2000 onwards is the GPRs of each bank, 80 bytes at a time */
+	load(program, 11, 0, 0);
+	pic16_poke(&pic, PIC16_FSR0L, 0x4F);
+	pic16_poke(&pic, PIC16_FSR0H, 0x20);
+	pic16_poke(&pic, 0x80 + GPR, 0x11);  /* linear 0x2050 */
+	pic16_poke(&pic, GPR + 0x4F, 0x22);  /* linear 0x204F */
+	pic16_poke(&pic, GPR + 0x4E, 0x00);  /* linear 0x204E */
+
+	CHECK("MOVIW ++FSR cycles", run(1), 1);
+	CHECK("MOVIW ++FSR W", wreg(), 0x11);
+	CHECK("MOVIW ++FSR FSR", pic16_peek(&pic, PIC16_FSR0L), 0x50);
+	run(1);
+	CHECK("MOVIW FSR-- W", wreg(), 0x11);
+	CHECK("MOVIW FSR-- FSR", pic16_peek(&pic, PIC16_FSR0L), 0x4F);
+	run(1);
+	CHECK("MOVIW --FSR W", wreg(), 0x00);
+	CHECK("MOVIW --FSR flags", flags(), PIC16_Z);
+	run(1);
+	CHECK("MOVIW FSR++ FSR", pic16_peek(&pic, PIC16_FSR0L), 0x4F);
+
+	/* FSR1 at traditional addresses (bank * 0x80 + offset) */
+	pic16_poke(&pic, PIC16_FSR1L, 0xA2);
+	pic16_poke(&pic, PIC16_FSR1H, 0x00);
+	pic16_poke(&pic, PIC16_WREG, 0x77);
+	run(1);
+	CHECK("MOVWI FSR++ f", file(0xA2), 0x77);
+	CHECK("MOVWI FSR++ FSR", pic16_peek(&pic, PIC16_FSR1L), 0xA3);
+	run(1);
+	CHECK("MOVWI k[FSR] f", file(0xA1), 0x77);
+	pic16_poke(&pic, 0xC2, 0x33);
+	run(1);
+	CHECK("MOVIW k[FSR] W", wreg(), 0x33);
+	CHECK("MOVIW k[FSR] FSR untouched", pic16_peek(&pic, PIC16_FSR1L), 0xA3);
+
+	run(1);
+	CHECK("ADDFSR FSR", pic16_peek(&pic, PIC16_FSR0L), 0x4E);
+	pic16_poke(&pic, GPR + 0x4E, 0x44);
+	run(1);
+	CHECK("INDF0 W", wreg(), 0x44);
+
+	/* from 0x8000, an FSR reads the low byte of each program word, and it takes a cycle longer */
+	pic16_poke(&pic, PIC16_FSR1L, 10);
+	pic16_poke(&pic, PIC16_FSR1H, 0x80);
+	CHECK("MOVIW program memory cycles", run(1), 2);
+	CHECK("MOVIW program memory W", wreg(), 0x99);
+}
+
+static void test_sleep_and_interrupts(void)
+{
+	uint16_t program[] = { SLEEP, NOP, NOP, NOP, MOVLW(0x00), MOVLB(5), RETFIE };
+
+	/* SLEEP clears PD and sets TO, and the core sleeps until an enabled interrupt is pending */
+	load(program, 7, 0x3C, PIC16_C);
+	run(1);
+	CHECK("SLEEP PD/TO", pic16_peek(&pic, PIC16_STATUS) & (STATUS_TO | STATUS_PD), STATUS_TO);
+	run(1);
+	CHECK("asleep", pic.event, PIC16_SLEEPING);
+
+	/* TMR2IF with TMR2IE and PEIE wakes it; without GIE it carries on after the SLEEP */
+	pic16_poke(&pic, PIC16_PIE1, 0x02);
+	pic16_poke(&pic, PIC16_PIR1, 0x02);
+	pic16_poke(&pic, PIC16_INTCON, 0x40);
+	run(1);
+	CHECK("woken", pic.event, PIC16_EXECUTED);
+	CHECK("PC after wake", pic.pc, 2);
+
+	/* with GIE set, an interrupt is a CALL to 0x0004 with W, STATUS, BSR and the rest saved, and RETFIE restores them */
+	pic16_poke(&pic, PIC16_INTCON, 0xC0);
+	CHECK("interrupt cycles", run(1), 2);
+	CHECK("interrupt event", pic.event, PIC16_INTERRUPTED);
+	CHECK("interrupt PC", pic.pc, 4);
+	CHECK("GIE cleared", pic16_peek(&pic, PIC16_INTCON) & 0x80, 0);
+	run(2);
+	CHECK("W in the ISR", wreg(), 0x00);
+	CHECK("RETFIE cycles", run(1), 2);
+	CHECK("RETFIE PC", pic.pc, 2);
+	CHECK("RETFIE W", wreg(), 0x3C);
+	CHECK("RETFIE BSR", pic16_peek(&pic, PIC16_BSR), 0);
+	CHECK("RETFIE flags", flags(), PIC16_C);
+	CHECK("GIE set", pic16_peek(&pic, PIC16_INTCON) & 0x80, 0x80);
+}
+
+static void test_faults(void)
+{
+	uint16_t option[] = { 0x0062 };
+	uint16_t recurse[] = { CALL(0x000) };
+
+	/* OPTION and TRIS aren't for the enhanced core; running into unprogrammed flash or overflowing the stack is a fault too */
+	load(option, 1, 0, 0);
+	run(1);
+	CHECK("OPTION faults", pic.event, PIC16_FAULT);
+
+	load(option, 0, 0, 0);
+	run(1);
+	CHECK("unprogrammed flash faults", pic.event, PIC16_FAULT);
+
+	load(recurse, 1, 0, 0);
+	run(PIC16_STACK_DEPTH);
+	CHECK("16 deep", pic.event, PIC16_EXECUTED);
+	run(1);
+	CHECK("17 deep faults", pic.event, PIC16_FAULT);
+}
+
+static void test_hex(void)
+{
+	char path[] = "/tmp/pic16-test-XXXXXX";
+	FILE *fp;
+	int fd;
+
+	/*
+	XC8's hex files are byte addressed, low byte first; an extended address record moves the rest up,
+	and the configuration words (at 0x8007 onwards in words) are beyond flash and ignored
+	*/
+	fd = mkstemp(path);
+	if (fd < 0)
+	{
+		perror("mkstemp");
+		exit(2);
+	}
+	fp = fdopen(fd, "w");
+	fprintf(fp, ":0400000080315A30C1\n");
+	fprintf(fp, ":0200000400F00A\n");
+	fprintf(fp, ":02000E00E43FCD\n");
+	fprintf(fp, ":00000001FF\n");
+	fclose(fp);
+
+	memset(pic.flash, 0, sizeof(pic.flash));
+	memset(pic.programmed, 0, sizeof(pic.programmed));
+	CHECK("hex loads", pic16_load_hex(&pic, path), 0);
+	CHECK("hex word 0", pic.flash[0], MOVLP(0x00));
+	CHECK("hex word 1", pic.flash[1], MOVLW(0x5A));
+	CHECK("hex word 2 unprogrammed", pic.programmed[2], 0);
+	unlink(path);
+}
+
+int main(void)
+{
+	test_arithmetic();
+	test_logic();
+	test_increment();
+	test_shifts();
+	test_bits_and_skips();
+	test_branches();
+	test_banks();
+	test_indirect();
+	test_sleep_and_interrupts();
+	test_faults();
+	test_hex();
+
+	printf("pic16: %u checks, %u failed\n", checks, failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,1040 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+an instruction-level simulator of the PIC16F1454 (see pic16.h)
+
+the instruction set, cycle counts, interrupt entry (with its shadow registers) and indirect addressing are those of the
+enhanced mid-range core; the peripherals are modelled only as far as blink0 uses them:
+- TMR2, with its prescaler and postscaler, setting TMR2IF
+- the SSP as an SPI master, taking eight SPI clocks per byte and setting SSP1IF; a write whilst busy sets WCOL
+- the USB SIE: buffer descriptors (in all four ping-pong modes), STALLs, PKTDIS and a SOF every millisecond;
+  USTAT only holds one transaction, so the host must wait for TRNIF to be cleared before the next
+- SLEEP(), which wakes on any enabled interrupt
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pic16.h"
+
+/* the core registers */
+#define W(pic)      ((pic)->ram[PIC16_WREG])
+#define STATUS(pic) ((pic)->ram[PIC16_STATUS])
+#define BSR(pic)    ((pic)->ram[PIC16_BSR])
+#define PCLATH(pic) ((pic)->ram[PIC16_PCLATH])
+#define INTCON(pic) ((pic)->ram[PIC16_INTCON])
+
+#define INTCON_GIE  0x80
+#define INTCON_PEIE 0x40
+
+#define PIR1_TMR2IF 0x02
+#define PIR1_SSP1IF 0x08
+#define PIR2_USBIF  0x04
+
+#define STATUS_PD   0x08
+#define STATUS_TO   0x10
+
+#define UCON_SUSPND 0x02
+#define UCON_USBEN  0x08
+#define UCON_PKTDIS 0x10
+#define UCON_PPBRST 0x40
+
+#define UIR_URSTIF  0x01
+#define UIR_TRNIF   0x08
+#define UIR_STALLIF 0x20
+#define UIR_SOFIF   0x40
+
+#define UEP_EPSTALL  0x01
+#define UEP_EPINEN   0x02
+#define UEP_EPOUTEN  0x04
+#define UEP_EPCONDIS 0x08
+
+#define BD_UOWN   0x80
+#define BD_BSTALL 0x04
+
+/* the linear view of the GPRs: 80 bytes from each bank in turn */
+#define LINEAR_BASE 0x2000
+#define LINEAR_END  (LINEAR_BASE + 31 * 80)
+
+/* program memory, as seen through the FSRs */
+#define FLASH_BASE  0x8000
+
+static void fault(struct pic16 *pic, const char *why)
+{
+	if (!pic->fault)
+		pic->fault = why;
+}
+
+static uint16_t banked(uint16_t address)
+{
+	/* linear addresses run through the GPRs of bank 0, then bank 1, and so on */
+	if ((address >= LINEAR_BASE) && (address < LINEAR_END))
+	{
+		address -= LINEAR_BASE;
+		return (address / 80) * 0x80 + 0x20 + (address % 80);
+	}
+	return address & 0xFFF;
+}
+
+static uint8_t *cell(struct pic16 *pic, uint16_t address)
+{
+	/* the core registers and the common RAM appear in every bank, but are kept in bank 0 */
+	if (((address & 0x7F) < 0x0C) || ((address & 0x7F) >= 0x70))
+		address &= 0x7F;
+	return &pic->ram[address];
+}
+
+uint8_t pic16_peek(struct pic16 *pic, uint16_t address)
+{
+	if ((address >= 0x1000) && ((address < LINEAR_BASE) || (address >= LINEAR_END)))
+		return 0;
+	return *cell(pic, banked(address));
+}
+
+void pic16_poke(struct pic16 *pic, uint16_t address, uint8_t value)
+{
+	if ((address >= 0x1000) && ((address < LINEAR_BASE) || (address >= LINEAR_END)))
+		return;
+	*cell(pic, banked(address)) = value;
+}
+
+static void usb_irq(struct pic16 *pic)
+{
+	/* USBIF is set by any USB interrupt flag that is enabled in UIE */
+	if (pic->ram[PIC16_UIR] & pic->ram[PIC16_UIE])
+		pic->ram[PIC16_PIR2] |= PIR2_USBIF;
+}
+
+/* data memory, with the side effects an instruction would have */
+
+static uint8_t read_file(struct pic16 *pic, uint16_t address);
+static void write_file(struct pic16 *pic, uint16_t address, uint8_t value);
+
+/* extra cycles taken by the instruction being executed (a write to PCL, or a read of program memory through an FSR) */
+static unsigned extra_cycles;
+
+static uint16_t fsr(struct pic16 *pic, uint8_t n)
+{
+	return pic->ram[PIC16_FSR0L + 2 * n] | (pic->ram[PIC16_FSR0H + 2 * n] << 8);
+}
+
+static void set_fsr(struct pic16 *pic, uint8_t n, uint16_t value)
+{
+	pic->ram[PIC16_FSR0L + 2 * n] = value & 0xFF;
+	pic->ram[PIC16_FSR0H + 2 * n] = value >> 8;
+}
+
+static uint8_t read_indirect(struct pic16 *pic, uint16_t address)
+{
+	if (address >= FLASH_BASE)
+	{
+		/* reading program memory returns the low byte of the word (the literal of a RETLW), and takes a cycle longer */
+		extra_cycles = 1;
+		address -= FLASH_BASE;
+		return (address < PIC16_FLASH_WORDS) ? (pic->flash[address] & 0xFF) : 0;
+	}
+
+	if (address < 0x1000)
+	{
+		/* INDF through INDF reads as zero */
+		if ((address & 0x7F) <= PIC16_INDF1)
+			return 0;
+		return read_file(pic, address);
+	}
+
+	if (address < LINEAR_BASE || address >= LINEAR_END)
+		return 0;
+	return read_file(pic, banked(address));
+}
+
+static void write_indirect(struct pic16 *pic, uint16_t address, uint8_t value)
+{
+	if (address >= FLASH_BASE)
+		return;
+
+	if (address < 0x1000)
+	{
+		if ((address & 0x7F) > PIC16_INDF1)
+			write_file(pic, address, value);
+		return;
+	}
+
+	if ((address >= LINEAR_BASE) && (address < LINEAR_END))
+		write_file(pic, banked(address), value);
+}
+
+static uint8_t read_file(struct pic16 *pic, uint16_t address)
+{
+	switch (address & 0x7F)
+	{
+	case PIC16_INDF0:
+		return read_indirect(pic, fsr(pic, 0));
+	case PIC16_INDF1:
+		return read_indirect(pic, fsr(pic, 1));
+	case PIC16_PCL:
+		return pic->pc & 0xFF;
+	}
+
+	/* reading SSP1BUF empties the receive buffer */
+	if (PIC16_SSP1BUF == address)
+		pic->ram[PIC16_SSP1STAT] &= ~0x01;
+
+	return *cell(pic, address);
+}
+
+static void ssp_write(struct pic16 *pic, uint8_t value)
+{
+	uint8_t con1 = pic->ram[PIC16_SSP1CON1];
+	unsigned divider;
+	uint64_t start;
+
+	pic->ram[PIC16_SSP1BUF] = value;
+
+	/* only an enabled SPI master clocks anything out */
+	if (!(con1 & 0x20) || ((con1 & 0x0F) > 0x03 && (con1 & 0x0F) != 0x0A))
+		return;
+
+	if (pic->ssp_busy)
+	{
+		/* WCOL: the write is ignored */
+		pic->ram[PIC16_SSP1CON1] |= 0x80;
+		pic->ssp_collisions++;
+		return;
+	}
+
+	switch (con1 & 0x0F)
+	{
+	case 0x01:
+		divider = 4;
+		break;
+	case 0x02:
+		divider = 16;
+		break;
+	case 0x0A:
+		divider = pic->ram[PIC16_SSP1ADD] + 1;
+		break;
+	default:
+		divider = 1;
+		break;
+	}
+
+	/* the byte starts going out as the instruction that wrote it finishes */
+	start = pic->cycles + 1;
+	pic->ssp_busy = true;
+	pic->ssp_done = start + 8 * divider;
+
+	if (pic->ssp_hook)
+		pic->ssp_hook(pic, start, value);
+}
+
+static void write_file(struct pic16 *pic, uint16_t address, uint8_t value)
+{
+	switch (address & 0x7F)
+	{
+	case PIC16_INDF0:
+		write_indirect(pic, fsr(pic, 0), value);
+		return;
+	case PIC16_INDF1:
+		write_indirect(pic, fsr(pic, 1), value);
+		return;
+	case PIC16_PCL:
+		/* a computed jump, which takes an extra cycle */
+		pic->pc = (PCLATH(pic) << 8) | value;
+		extra_cycles = 1;
+		return;
+	case PIC16_STATUS:
+		/* TO and PD are read-only */
+		STATUS(pic) = (STATUS(pic) & (STATUS_TO | STATUS_PD)) | (value & 0x07);
+		return;
+	case PIC16_BSR:
+		BSR(pic) = value & 0x1F;
+		return;
+	case PIC16_PCLATH:
+		PCLATH(pic) = value & 0x7F;
+		return;
+	}
+
+	switch (address)
+	{
+	case PIC16_SSP1BUF:
+		ssp_write(pic, value);
+		return;
+	case PIC16_TMR2:
+	case PIC16_T2CON:
+		/* a write to either clears the prescaler and postscaler */
+		pic->tmr2_prescale = 0;
+		pic->tmr2_postscale = 0;
+		break;
+	case PIC16_UIR:
+		/* the USB interrupt flags can only be cleared */
+		pic->ram[PIC16_UIR] &= value;
+		return;
+	case PIC16_UCON:
+		if (value & UCON_PPBRST)
+			memset(pic->ppbi, 0, sizeof(pic->ppbi));
+		break;
+	}
+
+	*cell(pic, address) = value;
+
+	if (PIC16_UIE == address)
+		usb_irq(pic);
+}
+
+/* the core */
+
+static void push(struct pic16 *pic, uint16_t address)
+{
+	if (pic->depth >= PIC16_STACK_DEPTH)
+	{
+		fault(pic, "stack overflow");
+		return;
+	}
+	pic->stack[pic->depth++] = address;
+	if (pic->depth > pic->max_depth)
+		pic->max_depth = pic->depth;
+}
+
+static uint16_t pop(struct pic16 *pic)
+{
+	if (0 == pic->depth)
+	{
+		fault(pic, "stack underflow");
+		return 0;
+	}
+	return pic->stack[--pic->depth];
+}
+
+static void set_flags(struct pic16 *pic, uint8_t mask, uint8_t flags)
+{
+	STATUS(pic) = (STATUS(pic) & ~mask) | (flags & mask);
+}
+
+static uint8_t zero(uint8_t value)
+{
+	return value ? 0 : PIC16_Z;
+}
+
+static uint8_t add(struct pic16 *pic, uint8_t a, uint8_t b, uint8_t carry)
+{
+	unsigned sum = a + b + carry;
+	uint8_t flags = zero(sum & 0xFF);
+
+	if (sum > 0xFF)
+		flags |= PIC16_C;
+	if (((a & 0x0F) + (b & 0x0F) + carry) > 0x0F)
+		flags |= PIC16_DC;
+	set_flags(pic, PIC16_C | PIC16_DC | PIC16_Z, flags);
+
+	return sum & 0xFF;
+}
+
+static int16_t sign_extend(uint16_t value, unsigned bits)
+{
+	return (int16_t)(value << (16 - bits)) >> (16 - bits);
+}
+
+static bool interrupt_pending(struct pic16 *pic)
+{
+	uint8_t intcon = INTCON(pic);
+
+	if (intcon & (intcon >> 3) & 0x07)
+		return true;
+
+	return (intcon & INTCON_PEIE) &&
+	       ((pic->ram[PIC16_PIR1] & pic->ram[PIC16_PIE1]) || (pic->ram[PIC16_PIR2] & pic->ram[PIC16_PIE2]));
+}
+
+static void vector(struct pic16 *pic)
+{
+	/* the core registers are saved to their shadows, and restored by RETFIE */
+	push(pic, pic->pc);
+	pic->ram[PIC16_STATUS_SHAD] = pic->ram[PIC16_STATUS];
+	pic->ram[PIC16_STATUS_SHAD + 1] = pic->ram[PIC16_WREG];
+	pic->ram[PIC16_STATUS_SHAD + 2] = BSR(pic);
+	pic->ram[PIC16_STATUS_SHAD + 3] = PCLATH(pic);
+	memcpy(&pic->ram[PIC16_STATUS_SHAD + 4], &pic->ram[PIC16_FSR0L], 4);     /* FSR0L/H, FSR1L/H */
+
+	INTCON(pic) &= ~INTCON_GIE;
+	pic->pc = 0x0004;
+	pic->in_isr = true;
+}
+
+static void retfie(struct pic16 *pic)
+{
+	pic->pc = pop(pic);
+	pic->ram[PIC16_STATUS] = pic->ram[PIC16_STATUS_SHAD];
+	pic->ram[PIC16_WREG] = pic->ram[PIC16_STATUS_SHAD + 1];
+	BSR(pic) = pic->ram[PIC16_STATUS_SHAD + 2];
+	PCLATH(pic) = pic->ram[PIC16_STATUS_SHAD + 3];
+	memcpy(&pic->ram[PIC16_FSR0L], &pic->ram[PIC16_STATUS_SHAD + 4], 4);
+
+	INTCON(pic) |= INTCON_GIE;
+	pic->in_isr = false;
+}
+
+static void moviw(struct pic16 *pic, uint8_t n, int16_t offset, int mode, bool store)
+{
+	uint16_t address = fsr(pic, n);
+
+	/* ++FSRn, --FSRn, FSRn++, FSRn--, or offset[FSRn] */
+	switch (mode)
+	{
+	case 0:
+		set_fsr(pic, n, ++address);
+		break;
+	case 1:
+		set_fsr(pic, n, --address);
+		break;
+	case 2:
+		set_fsr(pic, n, address + 1);
+		break;
+	case 3:
+		set_fsr(pic, n, address - 1);
+		break;
+	default:
+		address += offset;
+		break;
+	}
+
+	if (store)
+		write_indirect(pic, address, W(pic));
+	else
+	{
+		W(pic) = read_indirect(pic, address);
+		set_flags(pic, PIC16_Z, zero(W(pic)));
+	}
+}
+
+static unsigned execute(struct pic16 *pic)
+{
+	uint16_t op, address;
+	uint8_t value, result, carry;
+	unsigned cycles = 1;
+	bool skip = false;
+
+	if ((pic->pc >= PIC16_FLASH_WORDS) || !pic->programmed[pic->pc])
+	{
+		fault(pic, "executed unprogrammed flash");
+		return 0;
+	}
+
+	op = pic->flash[pic->pc];
+	pic->pc = (pic->pc + 1) & 0x7FFF;
+	extra_cycles = 0;
+
+	address = (BSR(pic) << 7) | (op & 0x7F);
+	carry = STATUS(pic) & PIC16_C;
+
+	switch (op >> 12)
+	{
+	case 0:
+		/* byte-oriented file register operations (and the odds and ends that have no file register) */
+		switch ((op >> 8) & 0x0F)
+		{
+		case 0x0:
+			if (op & 0x80)
+			{
+				write_file(pic, address, W(pic)); /* MOVWF */
+				break;
+			}
+
+			if (0x0000 == op || 0x0064 == op)
+				break; /* NOP, CLRWDT */
+			else if (0x0001 == op)
+			{
+				pic16_reset(pic); /* RESET */
+				return 1;
+			}
+			else if (0x0008 == op)
+			{
+				pic->pc = pop(pic); /* RETURN */
+				cycles = 2;
+			}
+			else if (0x0009 == op)
+			{
+				retfie(pic); /* RETFIE */
+				cycles = 2;
+			}
+			else if (0x000A == op)
+			{
+				push(pic, pic->pc); /* CALLW */
+				pic->pc = (PCLATH(pic) << 8) | W(pic);
+				cycles = 2;
+			}
+			else if (0x000B == op)
+			{
+				pic->pc = (pic->pc + W(pic)) & 0x7FFF; /* BRW */
+				cycles = 2;
+			}
+			else if ((op & 0xFFF0) == 0x0010)
+				moviw(pic, (op >> 2) & 1, 0, op & 3, op & 0x08); /* MOVIW/MOVWI with pre/post inc/dec */
+			else if ((op & 0xFFE0) == 0x0020)
+				BSR(pic) = op & 0x1F; /* MOVLB */
+			else if (0x0063 == op)
+			{
+				pic->sleeping = true; /* SLEEP */
+				STATUS(pic) = (STATUS(pic) & ~STATUS_PD) | STATUS_TO;
+			}
+			else
+				fault(pic, "unsupported instruction");
+			break;
+
+		case 0x1:
+			/* CLRF, CLRW */
+			if (op & 0x80)
+				write_file(pic, address, 0);
+			else
+				W(pic) = 0;
+			set_flags(pic, PIC16_Z, PIC16_Z);
+			break;
+
+		default:
+			value = read_file(pic, address);
+			switch ((op >> 8) & 0x0F)
+			{
+			case 0x2: /* SUBWF */
+				result = add(pic, value, ~W(pic), 1);
+				break;
+			case 0x3: /* DECF */
+				result = value - 1;
+				set_flags(pic, PIC16_Z, zero(result));
+				break;
+			case 0x4: /* IORWF */
+				result = value | W(pic);
+				set_flags(pic, PIC16_Z, zero(result));
+				break;
+			case 0x5: /* ANDWF */
+				result = value & W(pic);
+				set_flags(pic, PIC16_Z, zero(result));
+				break;
+			case 0x6: /* XORWF */
+				result = value ^ W(pic);
+				set_flags(pic, PIC16_Z, zero(result));
+				break;
+			case 0x7: /* ADDWF */
+				result = add(pic, value, W(pic), 0);
+				break;
+			case 0x8: /* MOVF */
+				result = value;
+				set_flags(pic, PIC16_Z, zero(result));
+				break;
+			case 0x9: /* COMF */
+				result = ~value;
+				set_flags(pic, PIC16_Z, zero(result));
+				break;
+			case 0xA: /* INCF */
+				result = value + 1;
+				set_flags(pic, PIC16_Z, zero(result));
+				break;
+			case 0xB: /* DECFSZ */
+				result = value - 1;
+				skip = (0 == result);
+				break;
+			case 0xC: /* RRF */
+				result = (value >> 1) | (carry << 7);
+				set_flags(pic, PIC16_C, value & 0x01);
+				break;
+			case 0xD: /* RLF */
+				result = (value << 1) | carry;
+				set_flags(pic, PIC16_C, value >> 7);
+				break;
+			case 0xE: /* SWAPF */
+				result = (value << 4) | (value >> 4);
+				break;
+			default: /* INCFSZ */
+				result = value + 1;
+				skip = (0 == result);
+				break;
+			}
+
+			if (op & 0x80)
+				write_file(pic, address, result);
+			else
+				W(pic) = result;
+			break;
+		}
+		break;
+
+	case 1:
+		/* BCF, BSF, BTFSC, BTFSS */
+		value = read_file(pic, address);
+		switch ((op >> 10) & 0x03)
+		{
+		case 0:
+			write_file(pic, address, value & ~(1 << ((op >> 7) & 0x07)));
+			break;
+		case 1:
+			write_file(pic, address, value | (1 << ((op >> 7) & 0x07)));
+			break;
+		case 2:
+			skip = !(value & (1 << ((op >> 7) & 0x07)));
+			break;
+		default:
+			skip = value & (1 << ((op >> 7) & 0x07));
+			break;
+		}
+		break;
+
+	case 2:
+		/* CALL, GOTO: the upper address bits come from PCLATH */
+		if (!(op & 0x0800))
+			push(pic, pic->pc);
+		pic->pc = ((PCLATH(pic) & 0x78) << 8) | (op & 0x07FF);
+		cycles = 2;
+		break;
+
+	default:
+		/* literal operations, and the enhanced mid-range additions */
+		switch ((op >> 8) & 0x3F)
+		{
+		case 0x30: /* MOVLW */
+			W(pic) = op & 0xFF;
+			break;
+		case 0x31:
+			if (op & 0x80)
+				PCLATH(pic) = op & 0x7F; /* MOVLP */
+			else
+				set_fsr(pic, (op >> 6) & 1, fsr(pic, (op >> 6) & 1) + sign_extend(op & 0x3F, 6)); /* ADDFSR */
+			break;
+		case 0x32:
+		case 0x33: /* BRA */
+			pic->pc = (pic->pc + sign_extend(op & 0x1FF, 9)) & 0x7FFF;
+			cycles = 2;
+			break;
+		case 0x34: /* RETLW */
+			W(pic) = op & 0xFF;
+			pic->pc = pop(pic);
+			cycles = 2;
+			break;
+		case 0x35: /* LSLF */
+		case 0x36: /* LSRF */
+		case 0x37: /* ASRF */
+		case 0x3B: /* SUBWFB */
+		case 0x3D: /* ADDWFC */
+			value = read_file(pic, address);
+			switch ((op >> 8) & 0x3F)
+			{
+			case 0x35:
+				result = value << 1;
+				set_flags(pic, PIC16_C | PIC16_Z, (value >> 7) | zero(result));
+				break;
+			case 0x36:
+				result = value >> 1;
+				set_flags(pic, PIC16_C | PIC16_Z, (value & 0x01) | zero(result));
+				break;
+			case 0x37:
+				result = (value >> 1) | (value & 0x80);
+				set_flags(pic, PIC16_C | PIC16_Z, (value & 0x01) | zero(result));
+				break;
+			case 0x3B:
+				result = add(pic, value, ~W(pic), carry);
+				break;
+			default:
+				result = add(pic, value, W(pic), carry);
+				break;
+			}
+			if (op & 0x80)
+				write_file(pic, address, result);
+			else
+				W(pic) = result;
+			break;
+		case 0x38: /* IORLW */
+			W(pic) |= op & 0xFF;
+			set_flags(pic, PIC16_Z, zero(W(pic)));
+			break;
+		case 0x39: /* ANDLW */
+			W(pic) &= op & 0xFF;
+			set_flags(pic, PIC16_Z, zero(W(pic)));
+			break;
+		case 0x3A: /* XORLW */
+			W(pic) ^= op & 0xFF;
+			set_flags(pic, PIC16_Z, zero(W(pic)));
+			break;
+		case 0x3C: /* SUBLW */
+			W(pic) = add(pic, op & 0xFF, ~W(pic), 1);
+			break;
+		case 0x3E: /* ADDLW */
+			W(pic) = add(pic, op & 0xFF, W(pic), 0);
+			break;
+		case 0x3F: /* MOVIW/MOVWI k[FSRn] */
+			moviw(pic, (op >> 6) & 1, sign_extend(op & 0x3F, 6), -1, op & 0x80);
+			break;
+		default:
+			fault(pic, "unsupported instruction");
+			break;
+		}
+		break;
+	}
+
+	/* a skip turns the next instruction into a NOP, which costs a cycle */
+	if (skip)
+	{
+		pic->pc = (pic->pc + 1) & 0x7FFF;
+		cycles = 2;
+	}
+
+	return cycles + extra_cycles;
+}
+
+static void advance(struct pic16 *pic, unsigned cycles)
+{
+	uint8_t prescale;
+
+	pic->cycles += cycles;
+	if (pic->in_isr)
+		pic->isr_cycles += cycles;
+
+	/* the peripherals stop whilst the core sleeps, as the oscillator does */
+	if (pic->sleeping)
+		return;
+
+	/* TMR2 counts up to PR2 through its prescaler; every postscaler count of matches sets TMR2IF */
+	if (pic->ram[PIC16_T2CON] & 0x04)
+	{
+		prescale = 1 << (2 * (pic->ram[PIC16_T2CON] & 0x03));
+		pic->tmr2_prescale += cycles;
+		while (pic->tmr2_prescale >= prescale)
+		{
+			pic->tmr2_prescale -= prescale;
+			if (pic->ram[PIC16_TMR2] == pic->ram[PIC16_PR2])
+			{
+				pic->ram[PIC16_TMR2] = 0;
+				if (++pic->tmr2_postscale > ((pic->ram[PIC16_T2CON] >> 3) & 0x0F))
+				{
+					pic->tmr2_postscale = 0;
+					pic->ram[PIC16_PIR1] |= PIR1_TMR2IF;
+				}
+			}
+			else
+				pic->ram[PIC16_TMR2]++;
+		}
+	}
+
+	/* the byte has gone, and the byte clocked in alongside it waits in SSP1BUF */
+	if (pic->ssp_busy && (pic->cycles >= pic->ssp_done))
+	{
+		pic->ssp_busy = false;
+		pic->ram[PIC16_PIR1] |= PIR1_SSP1IF;
+		pic->ram[PIC16_SSP1STAT] |= 0x01;
+	}
+
+	/* the host sends a SOF every millisecond */
+	while (pic->cycles >= pic->next_sof)
+	{
+		pic->next_sof += PIC16_CYCLES_PER_MS;
+		pic->frame = (pic->frame + 1) & 0x7FF;
+		if ((pic->ram[PIC16_UCON] & (UCON_USBEN | UCON_SUSPND)) == UCON_USBEN)
+		{
+			pic->ram[PIC16_UFRML] = pic->frame & 0xFF;
+			pic->ram[PIC16_UFRMH] = pic->frame >> 8;
+			pic->ram[PIC16_UIR] |= UIR_SOFIF;
+			usb_irq(pic);
+		}
+	}
+}
+
+unsigned pic16_step(struct pic16 *pic)
+{
+	unsigned cycles;
+
+	pic->event = PIC16_EXECUTED;
+	if (pic->fault)
+	{
+		pic->event = PIC16_FAULT;
+		return 0;
+	}
+
+	if (pic->sleeping)
+	{
+		/* any enabled interrupt wakes the core; without GIE, it carries on after the SLEEP */
+		if (!interrupt_pending(pic))
+		{
+			pic->event = PIC16_SLEEPING;
+			advance(pic, 1);
+			return 1;
+		}
+		pic->sleeping = false;
+		cycles = execute(pic);
+	}
+	else if ((INTCON(pic) & INTCON_GIE) && interrupt_pending(pic))
+	{
+		/* the interrupt is taken as a CALL to the interrupt vector */
+		vector(pic);
+		pic->event = PIC16_INTERRUPTED;
+		cycles = 2;
+	}
+	else
+		cycles = execute(pic);
+
+	if (pic->fault)
+	{
+		pic->event = PIC16_FAULT;
+		return cycles;
+	}
+
+	advance(pic, cycles);
+	return cycles;
+}
+
+bool pic16_run_until(struct pic16 *pic, uint64_t cycle)
+{
+	while (pic->cycles < cycle)
+	{
+		pic16_step(pic);
+		if (pic->fault)
+			return false;
+	}
+	return true;
+}
+
+void pic16_reset(struct pic16 *pic)
+{
+	memset(pic->ram, 0, sizeof(pic->ram));
+	STATUS(pic) = STATUS_TO | STATUS_PD;
+	pic->ram[PIC16_PR2] = 0xFF;
+
+	pic->pc = 0;
+	pic->depth = 0;
+	pic->in_isr = false;
+	pic->sleeping = false;
+	pic->fault = NULL;
+	pic->tmr2_prescale = 0;
+	pic->tmr2_postscale = 0;
+	pic->ssp_busy = false;
+	memset(pic->ppbi, 0, sizeof(pic->ppbi));
+	pic->host_address = 0;
+	pic->next_sof = pic->cycles + PIC16_CYCLES_PER_MS;
+}
+
+void pic16_bootloader_vectors(struct pic16 *pic, uint16_t offset)
+{
+	uint16_t vectors[2] = { 0x0000, 0x0004 };
+	unsigned index;
+
+	for (index = 0; index < 2; index++)
+	{
+		if (pic->programmed[vectors[index]])
+			continue;
+
+		/* MOVLP high(target), GOTO target */
+		pic->flash[vectors[index]] = 0x3180 | ((offset + vectors[index]) >> 8);
+		pic->flash[vectors[index] + 1] = 0x2800 | ((offset + vectors[index]) & 0x07FF);
+		pic->programmed[vectors[index]] = true;
+		pic->programmed[vectors[index] + 1] = true;
+	}
+}
+
+static int hex_byte(const char *text)
+{
+	unsigned value;
+
+	if (1 != sscanf(text, "%2x", &value))
+		return -1;
+	return value;
+}
+
+int pic16_load_hex(struct pic16 *pic, const char *path)
+{
+	char line[600];
+	FILE *fp;
+	int count, type, byte, sum;
+	uint32_t base = 0, address;
+	int index;
+
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+
+	while (fgets(line, sizeof(line), fp))
+	{
+		if (':' != line[0])
+			continue;
+
+		count = hex_byte(line + 1);
+		if ((count < 0) || (strlen(line) < (size_t)(11 + 2 * count)))
+			goto bad;
+
+		address = (hex_byte(line + 3) << 8) | hex_byte(line + 5);
+		type = hex_byte(line + 7);
+
+		sum = 0;
+		for (index = 0; index < count + 5; index++)
+			sum += hex_byte(line + 1 + 2 * index);
+		if (sum & 0xFF)
+			goto bad;
+
+		if (0x01 == type)
+			break;
+
+		if (0x04 == type)
+		{
+			base = ((hex_byte(line + 9) << 8) | hex_byte(line + 11)) << 16;
+			continue;
+		}
+
+		if (0x00 != type)
+			continue;
+
+		/* byte addresses, little-endian words; anything beyond flash (the configuration words) is ignored */
+		for (index = 0; index < count; index++)
+		{
+			byte = hex_byte(line + 9 + 2 * index);
+			address = base + ((hex_byte(line + 3) << 8) | hex_byte(line + 5)) + index;
+			if ((address / 2) >= PIC16_FLASH_WORDS)
+				continue;
+			if (address & 1)
+				pic->flash[address / 2] = (pic->flash[address / 2] & 0x00FF) | ((byte & 0x3F) << 8);
+			else
+				pic->flash[address / 2] = (pic->flash[address / 2] & 0x3F00) | byte;
+			pic->programmed[address / 2] = true;
+		}
+	}
+
+	fclose(fp);
+	return 0;
+
+bad:
+	fclose(fp);
+	return -1;
+}
+
+/* the SIE */
+
+static bool ping_pong(struct pic16 *pic, uint8_t ep, uint8_t dir)
+{
+	switch (pic->ram[PIC16_UCFG] & 0x03)
+	{
+	case 0:
+		return false;
+	case 1:
+		return (0 == ep) && (0 == dir);
+	case 2:
+		return true;
+	default:
+		return 0 != ep;
+	}
+}
+
+uint16_t pic16_usb_bd(struct pic16 *pic, uint8_t ep, uint8_t dir)
+{
+	uint8_t odd = pic->ppbi[ep][dir];
+	unsigned index;
+
+	/* the layouts are those of the BDS0OUT() etc. macros in usb.c */
+	switch (pic->ram[PIC16_UCFG] & 0x03)
+	{
+	case 0:
+		index = ep * 2 + dir;
+		break;
+	case 1:
+		index = ((0 == ep) && (0 == dir)) ? odd : (ep * 2 + dir + 1);
+		break;
+	case 2:
+		index = ep * 4 + dir * 2 + odd;
+		break;
+	default:
+		index = (0 == ep) ? dir : (ep * 4 - 2 + dir * 2 + odd);
+		break;
+	}
+
+	return PIC16_BD_ADDR + 4 * index;
+}
+
+void pic16_usb_reset(struct pic16 *pic)
+{
+	pic->host_address = 0;
+	pic->ram[PIC16_UADDR] = 0;
+	pic->ram[PIC16_UIR] |= UIR_URSTIF;
+	usb_irq(pic);
+}
+
+int pic16_usb_token(struct pic16 *pic, uint8_t pid, uint8_t ep, uint8_t *data, uint8_t length)
+{
+	uint8_t dir = (PIC16_PID_IN == pid) ? 1 : 0;
+	uint8_t uep, stat;
+	uint16_t bd, buffer, count, index;
+
+	/* nothing answers unless the device is on the bus, at the address the host is using, with the endpoint enabled */
+	if ((ep > 15) || !(pic->ram[PIC16_UCON] & UCON_USBEN) || (pic->ram[PIC16_UADDR] != pic->host_address))
+		return PIC16_TIMEOUT;
+
+	uep = pic->ram[PIC16_UEP0 + ep];
+	if (!(uep & (dir ? UEP_EPINEN : UEP_EPOUTEN)) || ((PIC16_PID_SETUP == pid) && (uep & UEP_EPCONDIS)))
+		return PIC16_TIMEOUT;
+
+	/* USTAT only holds the one transaction, and PKTDIS holds everything off after a SETUP */
+	if ((pic->ram[PIC16_UIR] & UIR_TRNIF) || (pic->ram[PIC16_UCON] & UCON_PKTDIS))
+		return PIC16_NAK;
+
+	bd = pic16_usb_bd(pic, ep, dir);
+	stat = pic16_peek(pic, bd);
+	if ((uep & UEP_EPSTALL) || ((stat & BD_UOWN) && (stat & BD_BSTALL)))
+	{
+		pic->ram[PIC16_UIR] |= UIR_STALLIF;
+		usb_irq(pic);
+		return PIC16_STALL;
+	}
+
+	if (!(stat & BD_UOWN))
+		return PIC16_NAK;
+
+	buffer = pic16_peek(pic, bd + 2) | (pic16_peek(pic, bd + 3) << 8);
+	count = pic16_peek(pic, bd + 1) | ((stat & 0x03) << 8);
+	if (count > length)
+		count = length;
+
+	for (index = 0; index < count; index++)
+	{
+		if (dir)
+			data[index] = pic16_peek(pic, buffer + index);
+		else
+			pic16_poke(pic, buffer + index, data[index]);
+	}
+
+	/* the SIE hands the buffer descriptor back with the PID and byte count, and says which one it was in USTAT */
+	pic16_poke(pic, bd + 1, count & 0xFF);
+	pic16_poke(pic, bd, (pid << 2) | ((count >> 8) & 0x03));
+
+	pic->ram[PIC16_USTAT] = (ep << 3) | (dir << 2) | (pic->ppbi[ep][dir] << 1);
+	if (ping_pong(pic, ep, dir))
+		pic->ppbi[ep][dir] ^= 1;
+
+	if (PIC16_PID_SETUP == pid)
+		pic->ram[PIC16_UCON] |= UCON_PKTDIS;
+
+	pic->ram[PIC16_UIR] |= UIR_TRNIF;
+	usb_irq(pic);
+
+	return count;
+}
@@ -0,0 +1,180 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+an instruction-level simulator of the PIC16F1454 (enhanced mid-range core), counting instruction cycles
+
+it runs the firmware exactly as XC8 built it (blink0.hex), along with just enough of the peripherals blink0 uses:
+TMR2, the SSP in SPI master mode, the interrupt logic, and the USB SIE (with a host-side call to put tokens on the bus);
+every other SFR is plain memory
+*/
+
+#ifndef PIC16_H
+#define PIC16_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PIC16_FLASH_WORDS 0x2000
+#define PIC16_STACK_DEPTH 16
+
+/* instruction cycles per millisecond (and per USB frame) at 48MHz */
+#define PIC16_CYCLES_PER_MS 12000
+
+/* SFR addresses, as bank * 0x80 + offset */
+#define PIC16_INDF0    0x000
+#define PIC16_INDF1    0x001
+#define PIC16_PCL      0x002
+#define PIC16_STATUS   0x003
+#define PIC16_FSR0L    0x004
+#define PIC16_FSR0H    0x005
+#define PIC16_FSR1L    0x006
+#define PIC16_FSR1H    0x007
+#define PIC16_BSR      0x008
+#define PIC16_WREG     0x009
+#define PIC16_PCLATH   0x00A
+#define PIC16_INTCON   0x00B
+#define PIC16_PIR1     0x011
+#define PIC16_PIR2     0x012
+#define PIC16_TMR2     0x01A
+#define PIC16_PR2      0x01B
+#define PIC16_T2CON    0x01C
+#define PIC16_PIE1     0x091
+#define PIC16_PIE2     0x092
+#define PIC16_WDTCON   0x097
+#define PIC16_SSP1BUF  0x211
+#define PIC16_SSP1ADD  0x212
+#define PIC16_SSP1STAT 0x214
+#define PIC16_SSP1CON1 0x215
+#define PIC16_UCON     0xE8E
+#define PIC16_USTAT    0xE8F
+#define PIC16_UIR      0xE90
+#define PIC16_UCFG     0xE91
+#define PIC16_UIE      0xE92
+#define PIC16_UFRMH    0xE94
+#define PIC16_UFRML    0xE95
+#define PIC16_UADDR    0xE96
+#define PIC16_UEP0     0xE98
+#define PIC16_STATUS_SHAD 0xFE4
+
+/* STATUS bits */
+#define PIC16_C  0x01
+#define PIC16_DC 0x02
+#define PIC16_Z  0x04
+
+/* the buffer descriptors are at this linear address (BD_ADDR in usb_hal.h) */
+#define PIC16_BD_ADDR 0x2000
+
+/* results of pic16_usb_token() that didn't transfer any data */
+#define PIC16_NAK     -1
+#define PIC16_STALL   -2
+#define PIC16_TIMEOUT -3
+
+/* USB PIDs */
+#define PIC16_PID_OUT   0x1
+#define PIC16_PID_IN    0x9
+#define PIC16_PID_SETUP 0xD
+
+/* what the last call to pic16_step() did, besides executing an instruction */
+enum pic16_event
+{
+	PIC16_EXECUTED,
+	PIC16_INTERRUPTED, /* vectored to the ISR rather than executing an instruction */
+	PIC16_SLEEPING,    /* asleep; a cycle went by */
+	PIC16_FAULT,       /* something the firmware should never do (see fault) */
+};
+
+struct pic16
+{
+	uint16_t flash[PIC16_FLASH_WORDS];
+	bool programmed[PIC16_FLASH_WORDS];
+
+	/* data memory, bank by bank; the core registers and the common RAM are only kept in bank 0 */
+	uint8_t ram[32 * 0x80];
+
+	uint16_t pc;
+	uint16_t stack[PIC16_STACK_DEPTH];
+	uint8_t depth, max_depth;
+
+	uint64_t cycles;     /* instruction cycles since reset */
+	uint64_t isr_cycles; /* how many of them were spent in the ISR */
+	bool in_isr, sleeping;
+	enum pic16_event event;
+	const char *fault;
+
+	/* TMR2's prescaler and postscaler */
+	uint8_t tmr2_prescale, tmr2_postscale;
+
+	/* the SSP: when the byte being clocked out will have gone */
+	bool ssp_busy;
+	uint64_t ssp_done;
+	unsigned ssp_collisions;
+
+	/* the SIE */
+	uint8_t ppbi[16][2];
+	uint8_t host_address;
+	uint16_t frame;
+	uint64_t next_sof;
+
+	/* called for every byte written to SSP1BUF while the SSP is idle, with the cycle at which it starts to go out */
+	void (*ssp_hook)(struct pic16 *pic, uint64_t cycle, uint8_t value);
+	void *context;
+};
+
+/* load an Intel HEX file into flash; returns zero on success */
+int pic16_load_hex(struct pic16 *pic, const char *path);
+
+/*
+fill in the bootloader's reset and interrupt vectors (GOTO offset and GOTO offset + 4), for firmware built with
+--codeoffset, unless something is already programmed there
+*/
+void pic16_bootloader_vectors(struct pic16 *pic, uint16_t offset);
+
+void pic16_reset(struct pic16 *pic);
+
+/* execute one instruction (or take an interrupt, or sleep for a cycle); returns the cycles it took */
+unsigned pic16_step(struct pic16 *pic);
+
+/* run until the given cycle, or a fault; returns false on a fault */
+bool pic16_run_until(struct pic16 *pic, uint64_t cycle);
+
+/* data memory, by bank * 0x80 + offset (below 0x1000) or linear address (from 0x2000), without side effects */
+uint8_t pic16_peek(struct pic16 *pic, uint16_t address);
+void pic16_poke(struct pic16 *pic, uint16_t address, uint8_t value);
+
+/* the host's side of the bus */
+void pic16_usb_reset(struct pic16 *pic);
+int pic16_usb_token(struct pic16 *pic, uint8_t pid, uint8_t ep, uint8_t *data, uint8_t length);
+
+/* the buffer descriptor the SIE would use next for an endpoint and direction */
+uint16_t pic16_usb_bd(struct pic16 *pic, uint8_t ep, uint8_t dir);
+
+#endif /* PIC16_H */
@@ -0,0 +1,728 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+a simulated PIC16F1454, just enough of one to run blink0's main.c and the USB stack unmodified on a PC
+
+the firmware is built with gcc against the stand-in <xc.h> and sim_hal.h in this directory, and with -fpack-struct,
+so that every struct is laid out byte for byte as XC8 lays it out; main() runs as a coroutine (see sim_coro.c),
+and hands control back each time it goes around its main loop
+
+what is simulated:
+- the USB SIE: buffer descriptors (in all four ping-pong modes), STALLs, PKTDIS, the frame number and the interrupt flags;
+  a transaction goes through in one go, and USTAT is the head of a four-deep FIFO of them (the host is NAKed while it is full)
+- TMR2, counting instruction cycles at 12MHz
+- the SSP: each byte written to SSP1BUF is timestamped and decoded back into WS281x bits;
+  when the main loop starts a frame, isr() is run there and then to clock out the whole frame
+- SLEEP(), which waits for USBIF with USBIE set
+- in the USB_USE_INTERRUPTS build, the USB interrupt: isr() is run as soon as USBIF is set with USBIE, PEIE and GIE,
+  whether that is the host putting a transaction on the bus or the firmware turning an interrupt back on
+
+the main loop and the ISR take no time at all; the firmware only sees time pass between goes around its main loop
+*/
+
+#include "blink0.h"
+#include "usb_hal.h"
+
+#include "sim.h"
+#include "sim_coro.h"
+
+/* xc.h maps TMR2IF onto PIR1bits for the firmware; here it is the bit of pir1 */
+#undef TMR2IF
+
+/* the byte times: an SPI byte at Fosc/4 takes eight instruction cycles, and the WS281x latches after 50us of low */
+#define SSP_BYTE_CYCLES  8
+#define WS_RESET_CYCLES  (50 * SIM_CYCLES_PER_MS / 1000)
+
+/* the host gives up on a transaction that is still NAKed after this many goes around the main loop */
+#define NAK_RETRIES      1000
+
+/* the SIE queues up to this many completed transactions for the CPU, the one in USTAT included */
+#define USTAT_FIFO       4
+
+/* a latch holds this when nothing has been written to it */
+#define SSP_EMPTY        0x100
+
+/* the firmware's entry points */
+int blink0_main(void);
+void isr(void);
+
+/* the plain memory SFRs declared in xc.h */
+volatile PIE1bits_t PIE1bits;
+volatile PIR2bits_t PIR2bits;
+volatile PIE2bits_t PIE2bits;
+volatile INTCONbits_t INTCONbits;
+volatile UIRbits_t UIRbits;
+volatile UIEbits_t UIEbits;
+volatile UCFGbits_t UCFGbits;
+volatile USTATbits_t USTATbits;
+volatile T2CONbits_t T2CONbits;
+volatile ANSELCbits_t ANSELCbits;
+volatile TRISCbits_t TRISCbits;
+volatile WDTCONbits_t WDTCONbits;
+volatile uint8_t UEIE, UADDR, UFRML, UFRMH, PR2, SSP1STAT, SSP1CON1;
+volatile uint8_t sim_uep[16];
+
+/* and the ones behind accessors */
+static volatile PIR1bits_t pir1;
+static volatile UCONbits_t ucon;
+
+unsigned sim_isr_cycles = 24;
+unsigned sim_bus_transactions = 1;
+void (*sim_ssp_hook)(uint64_t cycle, uint8_t value);
+void (*sim_frame_hook)(const uint8_t *grb, unsigned length, bool bad);
+
+/* time */
+static uint64_t cycles;
+static uint32_t tmr2_cycles;
+static uint16_t frame;
+
+/* the bus, as the host sees it */
+static bool bus_suspended;
+static uint8_t idle_ms;
+static uint8_t host_address;
+static unsigned long naks;
+static unsigned bus_transactions;
+
+/* the transactions queued behind the one in USTAT */
+static uint8_t ustat_fifo[USTAT_FIFO - 1];
+static uint8_t ustat_count;
+
+/* the SIE's ping-pong buffer pointers, for each endpoint and direction */
+static uint8_t ppbi[16][2];
+
+/* the core */
+static bool started, asleep, in_isr;
+
+/*
+SSP1BUF writes land in a latch, and are logged the next time the firmware touches the SSP (or hands back control);
+the write that starts a frame is logged ahead of the bytes isr() then clocks out, and gets its value once it has been written
+*/
+static volatile uint16_t ssp_latch = SSP_EMPTY, kick_latch = SSP_EMPTY;
+static uint64_t ssp_time, ssp_done;
+
+static struct
+{
+	uint64_t cycle;
+	uint8_t value;
+} ssp_log[4096];
+static unsigned ssp_count;
+static int kick_index = -1;
+
+/* the WS281x frame being decoded */
+static uint8_t ws_frame[1024];
+static unsigned ws_bits;
+static bool ws_bad;
+static uint64_t ws_end;
+
+static void usb_interrupt(void);
+
+static void usb_irq(void)
+{
+	/* USBIF is set by any USB interrupt flag that is enabled in UIE */
+	if (UIR & UIE)
+		PIR2bits.USBIF = 1;
+
+	usb_interrupt();
+}
+
+static void ustat_next(void)
+{
+	/* once the CPU clears TRNIF, the next transaction in the FIFO moves up into USTAT */
+	if (UIRbits.TRNIF || !ustat_count)
+		return;
+
+	USTAT = ustat_fifo[0];
+	ustat_count--;
+	memmove(&ustat_fifo[0], &ustat_fifo[1], ustat_count);
+
+	UIRbits.TRNIF = 1;
+	usb_irq();
+}
+
+static void ssp_record(uint8_t value)
+{
+	uint64_t when = ssp_time;
+
+	/* a byte only starts once the one before it has gone */
+	if (when < ssp_done)
+		when = ssp_done;
+	ssp_done = when + SSP_BYTE_CYCLES;
+
+	if (ssp_count < sizeof(ssp_log) / sizeof(ssp_log[0]))
+	{
+		ssp_log[ssp_count].cycle = when;
+		ssp_log[ssp_count].value = value;
+		ssp_count++;
+	}
+}
+
+static void ssp_flush(void)
+{
+	if (SSP_EMPTY != kick_latch)
+	{
+		if (kick_index >= 0)
+			ssp_log[kick_index].value = kick_latch;
+		kick_latch = SSP_EMPTY;
+		kick_index = -1;
+	}
+
+	if (SSP_EMPTY == ssp_latch)
+		return;
+
+	ssp_record(ssp_latch);
+	ssp_latch = SSP_EMPTY;
+
+	/* outside the ISR, nothing else happens until the firmware looks for the byte to have gone, so it already has */
+	if (!in_isr)
+		pir1.SSP1IF = 1;
+}
+
+static void ws_emit(void)
+{
+	if (ws_bits && sim_frame_hook)
+		sim_frame_hook(ws_frame, ws_bits / 8, ws_bad || (ws_bits % 8));
+
+	ws_bits = 0;
+	ws_bad = false;
+}
+
+static void ssp_deliver(void)
+{
+	unsigned index;
+	uint8_t value;
+
+	ssp_flush();
+
+	for (index = 0; index < ssp_count; index++)
+	{
+		value = ssp_log[index].value;
+
+		if (sim_ssp_hook)
+			sim_ssp_hook(ssp_log[index].cycle, value);
+
+		/* a gap long enough for the WS281x to latch ends the frame */
+		if (ssp_log[index].cycle >= ws_end + WS_RESET_CYCLES)
+			ws_emit();
+		ws_end = ssp_log[index].cycle + SSP_BYTE_CYCLES;
+
+		/* a long pulse is a '1' and a short one a '0'; an all-low byte only lengthens the gap */
+		if ((0xFF != value) && (0xF0 != value))
+		{
+			if (0x00 != value)
+				ws_bad = true;
+			continue;
+		}
+
+		if (ws_bits < 8 * sizeof(ws_frame))
+		{
+			if (0 == (ws_bits % 8))
+				ws_frame[ws_bits / 8] = 0;
+			if (0xFF == value)
+				ws_frame[ws_bits / 8] |= 0x80 >> (ws_bits % 8);
+			ws_bits++;
+		}
+	}
+	ssp_count = 0;
+
+	/* the firmware always finishes a frame before handing back control */
+	ws_emit();
+}
+
+/* SFR accessors */
+
+volatile PIR1bits_t *sim_pir1(void)
+{
+	ssp_flush();
+	return &pir1;
+}
+
+volatile UCONbits_t *sim_ucon(void)
+{
+	/* PPBRST holds the ping-pong buffer pointers at the even buffers for as long as it is set */
+	if (ucon.PPBRST)
+		memset(ppbi, 0, sizeof(ppbi));
+	return &ucon;
+}
+
+volatile uint16_t *sim_ssp1buf(void)
+{
+	unsigned guard;
+
+	ssp_flush();
+
+	if (in_isr || !INTCONbits.GIE || !INTCONbits.PEIE || !PIE1bits.SSP1IE)
+		return &ssp_latch;
+
+	/*
+	the main loop is kicking off a frame: the byte it is about to write goes out first,
+	and then isr() runs each time SSP1IF is set, until it is done with the frame and turns its interrupt off
+	*/
+	kick_index = ssp_count;
+	ssp_time = cycles;
+	ssp_record(0);
+
+	in_isr = true;
+	for (guard = 0; INTCONbits.GIE && INTCONbits.PEIE && PIE1bits.SSP1IE && (guard < 65536); guard++)
+	{
+		pir1.SSP1IF = 1;
+		ssp_time = ssp_done + sim_isr_cycles;
+		isr();
+		ssp_flush();
+	}
+	in_isr = false;
+	ssp_time = cycles;
+
+	return &kick_latch;
+}
+
+/* the core */
+
+static void firmware(void)
+{
+	blink0_main();
+
+	/* main() should never return; if it does, the PIC just sits there */
+	for (;;)
+		sim_coro_yield();
+}
+
+void sim_usb_service(void)
+{
+	/*
+	main.c calls this in place of usb_service(), so the simulation gets a look in each time around the main loop;
+	in the USB_USE_INTERRUPTS build it is isr() that calls it, and there is no handing back control from there
+	*/
+	if (!in_isr)
+		sim_coro_yield();
+	usb_service();
+}
+
+void sim_yield(void)
+{
+	/* the main loop of the USB_USE_INTERRUPTS build: an interrupt left pending while USBIE was off is taken here at the latest */
+	usb_interrupt();
+	sim_coro_yield();
+}
+
+void sim_ei(void)
+{
+	INTCONbits.GIE = 1;
+	usb_interrupt();
+}
+
+static void usb_interrupt(void)
+{
+#ifdef USB_USE_INTERRUPTS
+	unsigned guard;
+
+	if (in_isr || !started)
+		return;
+
+	/* isr() services one transaction at a time; each one it clears lets the next one up into USTAT, which sets USBIF again */
+	in_isr = true;
+	for (guard = 0; INTCONbits.GIE && INTCONbits.PEIE && PIE2bits.USBIE && PIR2bits.USBIF && (guard < 256); guard++)
+	{
+		isr();
+		ustat_next();
+	}
+	in_isr = false;
+#endif
+}
+
+void sim_sleep(void)
+{
+	/* wake on a peripheral interrupt; without GIE set, the firmware then carries on after SLEEP() */
+	while (!(INTCONbits.PEIE && PIE2bits.USBIE && PIR2bits.USBIF))
+	{
+		asleep = true;
+		sim_coro_yield();
+	}
+	asleep = false;
+}
+
+void sim_init(void)
+{
+	if (started)
+		return;
+	started = true;
+
+	sim_coro_start(firmware);
+	sim_step();
+}
+
+void sim_step(void)
+{
+	ssp_time = cycles;
+	sim_coro_resume();
+	ssp_deliver();
+	ustat_next();
+}
+
+void sim_run(unsigned ms)
+{
+	uint32_t period;
+
+	while (ms--)
+	{
+		cycles += SIM_CYCLES_PER_MS;
+
+		if (!bus_suspended)
+		{
+			/* the host sends a SOF every millisecond, which the SIE counts */
+			frame = (frame + 1) & 0x7FF;
+			if (ucon.USBEN && !ucon.SUSPND)
+			{
+				UFRML = frame & 0xFF;
+				UFRMH = frame >> 8;
+				UIRbits.SOFIF = 1;
+			}
+			idle_ms = 0;
+		}
+		else if ((idle_ms < 3) && (3 == ++idle_ms))
+		{
+			/* 3ms without a SOF is a suspend */
+			if (ucon.USBEN)
+				UIRbits.IDLEIF = 1;
+		}
+		usb_irq();
+
+		/* TMR2 counts instruction cycles through its prescaler, and sets TMR2IF every postscaler count of periods */
+		if (T2CONbits.TMR2ON && !asleep)
+		{
+			period = (uint32_t)(PR2 + 1) * (1 << (2 * T2CONbits.T2CKPS)) * (T2CONbits.T2OUTPS + 1);
+			tmr2_cycles += SIM_CYCLES_PER_MS;
+			while (tmr2_cycles >= period)
+			{
+				tmr2_cycles -= period;
+				pir1.TMR2IF = 1;
+			}
+		}
+
+		sim_step();
+	}
+}
+
+uint64_t sim_cycles(void)
+{
+	return cycles;
+}
+
+uint16_t sim_frame_number(void)
+{
+	return frame;
+}
+
+bool sim_asleep(void)
+{
+	return asleep;
+}
+
+unsigned long sim_naks(void)
+{
+	return naks;
+}
+
+bool sim_watchdog_enabled(void)
+{
+	return WDTCONbits.SWDTEN;
+}
+
+/* the SIE */
+
+static bool ping_pong(uint8_t ep, uint8_t dir)
+{
+	switch (UCFG & 0x03)
+	{
+	case PPB_NONE:
+		return false;
+	case PPB_EPO_OUT_ONLY:
+		return (0 == ep) && (0 == dir);
+	case PPB_ALL:
+		return true;
+	default:
+		return 0 != ep;
+	}
+}
+
+static struct buffer_descriptor *buffer_descriptor(uint8_t ep, uint8_t dir)
+{
+	struct buffer_descriptor *bds = (struct buffer_descriptor *)__start_usbbd;
+	uint8_t odd = ppbi[ep][dir];
+
+	/* the layouts are those of the BDS0OUT() etc. macros in usb.c */
+	switch (UCFG & 0x03)
+	{
+	case PPB_NONE:
+		return &bds[ep * 2 + dir];
+	case PPB_EPO_OUT_ONLY:
+		return &bds[((0 == ep) && (0 == dir)) ? odd : (ep * 2 + dir + 1)];
+	case PPB_ALL:
+		return &bds[ep * 4 + dir * 2 + odd];
+	default:
+		return &bds[(0 == ep) ? dir : (ep * 4 - 2 + dir * 2 + odd)];
+	}
+}
+
+static int transaction(uint8_t pid, uint8_t ep, uint8_t *data, uint8_t length)
+{
+	uint8_t dir = (PID_IN == pid) ? 1 : 0;
+	UEP1bits_t uep;
+	struct buffer_descriptor *bd;
+	uint8_t *buf;
+	uint16_t count;
+	USTATbits_t status;
+
+	/* nothing answers unless the device is on the bus, at the address the host is using, with the endpoint enabled */
+	if ((ep > 15) || !ucon.USBEN || bus_suspended || (UADDR != host_address))
+		return SIM_TIMEOUT;
+
+	uep.reg = sim_uep[ep];
+	if ((dir ? !uep.EPINEN : !uep.EPOUTEN) || ((PID_SETUP == pid) && uep.EPCONDIS))
+		return SIM_TIMEOUT;
+
+	/* the USTAT FIFO has to have room for the transaction, and PKTDIS holds everything off after a SETUP */
+	ustat_next();
+	if ((UIRbits.TRNIF + ustat_count >= USTAT_FIFO) || ucon.PKTDIS)
+		return SIM_NAK;
+
+	bd = buffer_descriptor(ep, dir);
+	if (uep.EPSTALL || (bd->STAT.UOWN && bd->STAT.BSTALL))
+	{
+		/* the buffer descriptor is left with the CPU's settings, and the ping-pong pointer stays put */
+		UIRbits.STALLIF = 1;
+		usb_irq();
+		return SIM_STALL;
+	}
+
+	if (!bd->STAT.UOWN)
+		return SIM_NAK;
+
+	buf = __start_usbram + bd->BDnADR;
+	count = BDN_LENGTH((*bd));
+	if (dir)
+	{
+		if (count > length)
+			count = length;
+		memcpy(data, buf, count);
+	}
+	else
+	{
+		if (length < count)
+			count = length;
+		memcpy(buf, data, count);
+	}
+
+	/* the SIE hands the buffer descriptor back with the PID and byte count, and says which one it was in USTAT */
+	bd->BDnCNT = count & 0xFF;
+	bd->STAT.BDnSTAT = (pid << 2) | ((count >> 8) & 0x03);
+
+	status.reg = 0;
+	status.ENDP = ep;
+	status.DIR = dir;
+	status.PPBI = ppbi[ep][dir];
+	if (ping_pong(ep, dir))
+		ppbi[ep][dir] ^= 1;
+
+	if (PID_SETUP == pid)
+		ucon.PKTDIS = 1;
+
+	if (UIRbits.TRNIF)
+	{
+		ustat_fifo[ustat_count++] = status.reg;
+		return count;
+	}
+
+	USTAT = status.reg;
+	UIRbits.TRNIF = 1;
+	usb_irq();
+
+	return count;
+}
+
+static int retry(uint8_t pid, uint8_t ep, uint8_t *data, uint8_t length)
+{
+	unsigned tries;
+	int result = SIM_NAK;
+
+	/*
+	the host gets sim_bus_transactions transactions onto the bus (NAKed ones included) for each time the firmware goes around its main loop;
+	with the default of one, the firmware sees each transaction before anything else happens
+	*/
+	for (tries = 0; tries < NAK_RETRIES; tries++)
+	{
+		result = transaction(pid, ep, data, length);
+		if (++bus_transactions >= sim_bus_transactions)
+		{
+			bus_transactions = 0;
+			sim_step();
+		}
+		if (SIM_NAK != result)
+			break;
+	}
+
+	naks += tries;
+
+	return (SIM_NAK == result) ? SIM_TIMEOUT : result;
+}
+
+void sim_bus_reset(void)
+{
+	/* a reset also wakes a suspended bus, and the device goes back to address zero */
+	bus_suspended = false;
+	idle_ms = 0;
+	host_address = 0;
+	UADDR = 0;
+	ustat_count = 0;
+	UIRbits.URSTIF = 1;
+	usb_irq();
+	sim_step();
+}
+
+void sim_suspend(bool suspend)
+{
+	if (suspend == bus_suspended)
+		return;
+
+	bus_suspended = suspend;
+	idle_ms = 0;
+
+	/* the SIE only flags the resume if it was put into its suspended state */
+	if (!suspend && ucon.SUSPND)
+	{
+		UIRbits.ACTVIF = 1;
+		usb_irq();
+	}
+
+	sim_step();
+}
+
+int sim_setup(uint8_t ep, const uint8_t *setup)
+{
+	return retry(PID_SETUP, ep, (uint8_t *)setup, 8);
+}
+
+int sim_out(uint8_t ep, const uint8_t *data, uint8_t length)
+{
+	return retry(PID_OUT, ep, (uint8_t *)data, length);
+}
+
+int sim_in(uint8_t ep, uint8_t *data, uint8_t max)
+{
+	return transaction(PID_IN, ep, data, max);
+}
+
+int sim_control(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index, uint8_t *data, uint16_t length)
+{
+	uint8_t setup[8];
+	uint16_t done = 0;
+	uint8_t chunk;
+	int result;
+
+	setup[0] = request_type;
+	setup[1] = request;
+	setup[2] = value & 0xFF;
+	setup[3] = value >> 8;
+	setup[4] = index & 0xFF;
+	setup[5] = index >> 8;
+	setup[6] = length & 0xFF;
+	setup[7] = length >> 8;
+
+	result = sim_setup(0, setup);
+	if (result < 0)
+		return result;
+
+	if (request_type & 0x80)
+	{
+		/* device to host: IN until a short packet or everything asked for has arrived, then a zero-length OUT */
+		while (done < length)
+		{
+			chunk = ((length - done) > EP_0_LEN) ? EP_0_LEN : (length - done);
+			result = retry(PID_IN, 0, data + done, chunk);
+			if (result < 0)
+				return result;
+			done += result;
+			if (result < chunk)
+				break;
+		}
+
+		result = retry(PID_OUT, 0, NULL, 0);
+	}
+	else
+	{
+		/* host to device: OUT a packet at a time, then a zero-length IN */
+		while (done < length)
+		{
+			chunk = ((length - done) > EP_0_LEN) ? EP_0_LEN : (length - done);
+			result = retry(PID_OUT, 0, data + done, chunk);
+			if (result < 0)
+				return result;
+			done += chunk;
+		}
+
+		result = retry(PID_IN, 0, NULL, 0);
+	}
+
+	return (result < 0) ? result : done;
+}
+
+int sim_enumerate(void)
+{
+	uint8_t descriptor[18];
+
+	sim_bus_reset();
+
+	if (sim_control(0x80, GET_DESCRIPTOR, DESC_DEVICE << 8, 0, descriptor, sizeof(descriptor)) != sizeof(descriptor))
+		return -1;
+
+	/* the new address only takes effect once the firmware has seen the status stage go, which the host allows time for */
+	if (sim_control(0x00, SET_ADDRESS, 1, 0, NULL, 0) < 0)
+		return -1;
+	sim_step();
+	host_address = 1;
+
+	if (sim_control(0x00, SET_CONFIGURATION, 1, 0, NULL, 0) < 0)
+		return -1;
+
+	return 0;
+}
+
+int sim_set_report(const uint8_t *data, uint16_t length)
+{
+	/* SET_REPORT, feature report */
+	return sim_control(0x21, 0x09, (3 << 8) | data[0], 0, (uint8_t *)data, length);
+}
+
+int sim_get_report(uint8_t report_id, uint8_t *data, uint16_t length)
+{
+	/* GET_REPORT, feature report */
+	return sim_control(0xA1, 0x01, (3 << 8) | report_id, 0, data, length);
+}
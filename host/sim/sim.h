@@ -0,0 +1,112 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+blink0 firmware running on a PC: the real main.c and USB stack, built with gcc against a simulated PIC16F1454 (see sim.c)
+
+the simulation is driven a millisecond (one USB frame) at a time; the host side of the USB bus is a handful of calls
+to inject tokens and control transfers, and whatever the firmware clocks out to the WS281x is handed back through hooks
+*/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* instruction cycles per millisecond: the PIC16F1454 at 48MHz executes an instruction every four clocks */
+#define SIM_CYCLES_PER_MS 12000
+
+/* results of a transaction that didn't transfer any data */
+#define SIM_NAK     -1
+#define SIM_STALL   -2
+#define SIM_TIMEOUT -3 /* the device didn't answer at all (e.g. wrong address, or endpoint not enabled) */
+
+/* power up the PIC and run the firmware until it first comes around its main loop */
+void sim_init(void);
+
+/* run the firmware once around its main loop, without letting any time pass */
+void sim_step(void);
+
+/* let the given number of milliseconds pass, with a start-of-frame every millisecond (unless the bus is suspended) */
+void sim_run(unsigned ms);
+
+/* the host's side of the bus */
+void sim_bus_reset(void);
+void sim_suspend(bool suspend);
+int sim_setup(uint8_t ep, const uint8_t *setup);
+int sim_out(uint8_t ep, const uint8_t *data, uint8_t len);
+int sim_in(uint8_t ep, uint8_t *data, uint8_t max);
+
+/*
+a whole control transfer on EP0, retrying NAKed transactions (with the firmware going around its main loop in between);
+returns how many bytes the data stage carried, or SIM_STALL/SIM_TIMEOUT
+*/
+int sim_control(uint8_t request_type, uint8_t request, uint16_t value, uint16_t index, uint8_t *data, uint16_t length);
+
+/* reset the bus, give the device address 1 and select configuration 1, as a PC would; returns zero on success */
+int sim_enumerate(void);
+
+/* HID feature reports on interface 0; the first byte of data is the report ID */
+int sim_set_report(const uint8_t *data, uint16_t length);
+int sim_get_report(uint8_t report_id, uint8_t *data, uint16_t length);
+
+/* the state of the simulated PIC */
+uint64_t sim_cycles(void);
+uint16_t sim_frame_number(void);
+bool sim_asleep(void);
+bool sim_watchdog_enabled(void);
+
+/* how many times the device NAKed the host in a control transfer or an OUT, each costing the host a retry */
+unsigned long sim_naks(void);
+
+/*
+cycles from SSP1IF being set to isr() writing the next byte to SSP1BUF; this sets the timestamps of the bytes isr()
+clocks out, and the default is only an estimate
+*/
+extern unsigned sim_isr_cycles;
+
+/*
+how many transactions the host gets onto the bus (NAKed ones included) for each time the firmware goes around its main loop;
+the default of 1 lets the firmware deal with each transaction before the next, larger values stand for a main loop slower than the bus
+*/
+extern unsigned sim_bus_transactions;
+
+/* called for every byte written to SSP1BUF, with the instruction cycle at which it started to go out */
+extern void (*sim_ssp_hook)(uint64_t cycle, uint8_t value);
+
+/*
+called for every WS281x frame, decoded back into bytes (green, red, blue for each LED in turn);
+bad is set if any byte written to SSP1BUF was neither a WS281x '0' nor a '1'
+*/
+extern void (*sim_frame_hook)(const uint8_t *grb, unsigned length, bool bad);
+
+#endif /* SIM_H */
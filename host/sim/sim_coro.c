@@ -0,0 +1,75 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+the firmware's main() never returns, so it runs as a coroutine alongside the simulation in sim.c;
+each time the firmware goes around its main loop it hands control back, and the simulation picks up where it left off
+
+this is kept apart from sim.c, as the system headers must not be built with -fpack-struct like the firmware is
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include "sim_coro.h"
+
+#define FIRMWARE_STACK (256 * 1024)
+
+static ucontext_t sim_context, firmware_context;
+
+void sim_coro_start(void (*entry)(void))
+{
+	void *stack;
+
+	stack = malloc(FIRMWARE_STACK);
+	if (!stack)
+	{
+		perror("sim_coro_start");
+		exit(1);
+	}
+
+	getcontext(&firmware_context);
+	firmware_context.uc_stack.ss_sp = stack;
+	firmware_context.uc_stack.ss_size = FIRMWARE_STACK;
+	firmware_context.uc_link = NULL;
+	makecontext(&firmware_context, entry, 0);
+}
+
+void sim_coro_resume(void)
+{
+	swapcontext(&sim_context, &firmware_context);
+}
+
+void sim_coro_yield(void)
+{
+	swapcontext(&firmware_context, &sim_context);
+}
@@ -0,0 +1,238 @@
+/*
+    blink0: genuinely open-source firmware that emulates a Blink(1)
+
+    Copyright (C) 2015 Peter Lawrence
+
+    based on top of M-Stack USB driver stack by Alan Ott, Signal 11 Software
+
+    The author's intent in writing this code is to provide more readable 
+    firmware source code that can be used in tandem with a bootloader.
+    This enables the hobbyist/maker to experiment, innovate, and improve 
+    far more readily than may be possible with the Blink(1).
+
+    Permission is hereby granted, free of charge, to any person obtaining a 
+    copy of this software and associated documentation files (the "Software"), 
+    to deal in the Software without restriction, including without limitation 
+    the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+    and/or sell copies of the Software, and to permit persons to whom the 
+    Software is furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in 
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR 
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, 
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL 
+    THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER 
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING 
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER 
+    DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+a stand-in for XC8's <xc.h>, so that the firmware builds with gcc on a PC (see sim.c)
+
+only the SFRs and bits that blink0 and the USB stack use are here, with the same names and bit positions as on the PIC16F1454;
+most are plain memory, but the few whose reads or writes set something off on the real PIC go through sim.c
+*/
+
+#ifndef SIM_XC_H
+#define SIM_XC_H
+
+#include <stdint.h>
+
+/* interrupt and USB */
+
+typedef union
+{
+	struct
+	{
+		uint8_t TMR1IF:1, TMR2IF:1, :1, SSP1IF:1, TXIF:1, RCIF:1, ADIF:1, TMR1GIF:1;
+	};
+	uint8_t reg;
+} PIR1bits_t;
+
+typedef union
+{
+	struct
+	{
+		uint8_t TMR1IE:1, TMR2IE:1, :1, SSP1IE:1, TXIE:1, RCIE:1, ADIE:1, TMR1GIE:1;
+	};
+	uint8_t reg;
+} PIE1bits_t;
+
+typedef union
+{
+	struct
+	{
+		uint8_t :1, ACTIF:1, USBIF:1, BCL1IF:1, :1, C1IF:1, C2IF:1, OSFIF:1;
+	};
+	uint8_t reg;
+} PIR2bits_t;
+
+typedef union
+{
+	struct
+	{
+		uint8_t :1, ACTIE:1, USBIE:1, BCL1IE:1, :1, C1IE:1, C2IE:1, OSFIE:1;
+	};
+	uint8_t reg;
+} PIE2bits_t;
+
+typedef union
+{
+	struct
+	{
+		uint8_t IOCIF:1, INTF:1, TMR0IF:1, IOCIE:1, INTE:1, TMR0IE:1, PEIE:1, GIE:1;
+	};
+	uint8_t reg;
+} INTCONbits_t;
+
+typedef union
+{
+	struct
+	{
+		uint8_t URSTIF:1, UERRIF:1, ACTVIF:1, TRNIF:1, IDLEIF:1, STALLIF:1, SOFIF:1, :1;
+	};
+	uint8_t reg;
+} UIRbits_t;
+
+typedef union
+{
+	struct
+	{
+		uint8_t URSTIE:1, UERRIE:1, ACTVIE:1, TRNIE:1, IDLEIE:1, STALLIE:1, SOFIE:1, :1;
+	};
+	uint8_t reg;
+} UIEbits_t;
+
+typedef union
+{
+	struct
+	{
+		uint8_t :1, SUSPND:1, RESUME:1, USBEN:1, PKTDIS:1, SE0:1, PPBRST:1, :1;
+	};
+	uint8_t reg;
+} UCONbits_t;
+
+typedef union
+{
+	struct
+	{
+		uint8_t PPB0:1, PPB1:1, FSEN:1, UTRDIS:1, UPUEN:1, :2, UTEYE:1;
+	};
+	uint8_t reg;
+} UCFGbits_t;
+
+typedef union
+{
+	struct
+	{
+		uint8_t :1, PPBI:1, DIR:1, ENDP:4, :1;
+	};
+	uint8_t reg;
+} USTATbits_t;
+
+typedef union
+{
+	struct
+	{
+		uint8_t EPSTALL:1, EPINEN:1, EPOUTEN:1, EPCONDIS:1, EPHSHK:1, :3;
+	};
+	uint8_t reg;
+} UEP1bits_t;
+
+/* peripherals */
+
+typedef union
+{
+	struct
+	{
+		uint8_t T2CKPS:2, TMR2ON:1, T2OUTPS:4, :1;
+	};
+	uint8_t reg;
+} T2CONbits_t;
+
+typedef union
+{
+	struct
+	{
+		uint8_t ANSC0:1, ANSC1:1, ANSC2:1, ANSC3:1, :4;
+	};
+	uint8_t reg;
+} ANSELCbits_t;
+
+typedef union
+{
+	struct
+	{
+		uint8_t TRISC0:1, TRISC1:1, TRISC2:1, TRISC3:1, TRISC4:1, TRISC5:1, :2;
+	};
+	uint8_t reg;
+} TRISCbits_t;
+
+typedef union
+{
+	struct
+	{
+		uint8_t SWDTEN:1, WDTPS:5, :2;
+	};
+	uint8_t reg;
+} WDTCONbits_t;
+
+/* the plain memory SFRs */
+extern volatile PIE1bits_t PIE1bits;
+extern volatile PIR2bits_t PIR2bits;
+extern volatile PIE2bits_t PIE2bits;
+extern volatile INTCONbits_t INTCONbits;
+extern volatile UIRbits_t UIRbits;
+extern volatile UIEbits_t UIEbits;
+extern volatile UCFGbits_t UCFGbits;
+extern volatile USTATbits_t USTATbits;
+extern volatile T2CONbits_t T2CONbits;
+extern volatile ANSELCbits_t ANSELCbits;
+extern volatile TRISCbits_t TRISCbits;
+extern volatile WDTCONbits_t WDTCONbits;
+extern volatile uint8_t UEIE, UADDR, UFRML, UFRMH, PR2, SSP1STAT, SSP1CON1;
+extern volatile uint8_t sim_uep[16];
+
+#define UIR   UIRbits.reg
+#define UIE   UIEbits.reg
+#define USTAT USTATbits.reg
+#define UCFG  UCFGbits.reg
+
+#define UEP0  sim_uep[0]
+#define UEP1  sim_uep[1]
+#define UEP2  sim_uep[2]
+#define UEP3  sim_uep[3]
+
+/*
+the SFRs that need looking after: a write to SSP1BUF starts a byte going out to the WS281x, SSP1IF says when it has gone,
+and setting then clearing PPBRST resets the ping-pong buffer pointers; sim.c sees each access as it happens
+*/
+extern volatile PIR1bits_t *sim_pir1(void);
+extern volatile uint16_t *sim_ssp1buf(void);
+extern volatile UCONbits_t *sim_ucon(void);
+
+#define PIR1bits (*sim_pir1())
+#define SSP1BUF  (*sim_ssp1buf())
+#define UCONbits (*sim_ucon())
+#define UCON     UCONbits.reg
+
+#define TMR2IF   PIR1bits.TMR2IF
+
+/* where the main loop of the USB_USE_INTERRUPTS build hands control back each time around (see sim.c) */
+extern void sim_yield(void);
+
+/* the compiler's built-ins */
+extern void sim_sleep(void);
+extern void sim_ei(void);
+
+#define interrupt
+#define di()     (INTCONbits.GIE = 0)
+#define ei()     sim_ei()
+#define SLEEP()  sim_sleep()
+#define NOP()
+#define CLRWDT()
+
+#endif /* SIM_XC_H */